@@ -0,0 +1,347 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "search.h"
+#include "frame.h"
+#include "screen.h"
+#include "finder.h"
+#include "latency.h"
+#include "editor.h"
+#include "window.h"
+
+/* Benchmarks of the paths a key takes through the editor, on every
+ * storage backend and a range of file sizes, one row per workload in
+ * CSV or JSON so that versions can be compared.
+ *
+ * Usage: rye-bench [-s sizes] [-b backends] [-t seconds] [-j]
+ *   -s  sizes separated by commas, with K, M or G, 1K,64K,1M,16M,256M,1G
+ *       by default
+ *   -b  backends separated by commas, all of them by default
+ *   -t  seconds a workload runs at most, 0.5 by default
+ *   -j  JSON instead of CSV
+ */
+
+#define BENCH_OPS (100000)     // operations a workload runs at most
+#define BENCH_ROWS (48)        // rows of text on the screen rendered
+#define BENCH_COLS (160)       // cols of the screen rendered
+#define BENCH_LINE (64)        // bytes of a line of the text
+
+static double budget = 0.5;    // seconds a workload runs at most
+static bool json = false;      // print JSON instead of CSV
+static size_t rows = 0;        // rows printed so far
+static volatile size_t kept;   // results of lookups, so they are not optimized out
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// whether a workload that started at start and ran ops times goes on;
+// the clock is read after 1, 2, 4, ... operations so that slow ones stop
+// early, and then every 64 so that it costs nothing for fast ones
+static bool more(size_t ops, double start) {
+  if (ops >= BENCH_OPS) return false;
+  if (ops % 64 != 0 && (ops & (ops - 1)) != 0) return true;
+  return now() - start < budget;
+}
+
+// one result: ops operations took seconds, and went through bytes
+// each if that is how the workload is measured, else 0
+static void report(const char* workload, const char* backend, size_t size,
+                   size_t ops, double seconds, size_t bytes) {
+  double nsPerOp = ops > 0 ? seconds * 1e9 / ops : 0;
+  double mbPerS = bytes > 0 && seconds > 0 ? (double)bytes * ops / seconds / 1e6 : 0;
+  if (json) {
+    printf("%s\n  {\"workload\": \"%s\", \"backend\": \"%s\", \"bytes\": %zu, "
+           "\"ops\": %zu, \"seconds\": %.6f, \"ns_per_op\": %.1f, ",
+           rows == 0 ? "[" : ",", workload, backend, size, ops, seconds, nsPerOp);
+    if (bytes > 0) printf("\"mb_per_s\": %.1f}", mbPerS);
+    else printf("\"mb_per_s\": null}");
+  }
+  else {
+    if (rows == 0) printf("workload,backend,bytes,ops,seconds,ns_per_op,mb_per_s\n");
+    printf("%s,%s,%zu,%zu,%.6f,%.1f,", workload, backend, size, ops, seconds, nsPerOp);
+    if (bytes > 0) printf("%.1f", mbPerS);
+    printf("\n");
+  }
+  fflush(stdout);
+  rows += 1;
+}
+
+// a random offset in [0, n)
+static size_t randomOffset(size_t n) {
+  return ((size_t)rand() * RAND_MAX + rand()) % n;
+}
+
+// write a temporary file of size bytes of lines of text, its name
+static char* makeFile(size_t size) {
+  const char* dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+  char* path = xmalloc(strlen(dir) + sizeof("/rye-bench-XXXXXX"));
+  strcpy(path, dir);
+  strcat(path, "/rye-bench-XXXXXX");
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    perror(path);
+    exit(1);
+  }
+
+  // a block of lines with a tab in each, written over and over
+  size_t blocklen = 1 << 20;
+  char* block = xmalloc(blocklen);
+  const char* line = "the quick brown fox\tjumps over the lazy dog, again and again, ";
+  for (size_t i = 0; i < blocklen; i += BENCH_LINE) {
+    memcpy(block + i, line, BENCH_LINE - 1);
+    block[i + BENCH_LINE - 1] = '\n';
+  }
+  for (size_t written = 0; written < size; ) {
+    size_t n = size - written < blocklen ? size - written : blocklen;
+    ssize_t w = write(fd, block, n);
+    if (w <= 0) {
+      perror(path);
+      exit(1);
+    }
+    written += w;
+  }
+  free(block);
+  close(fd);
+  return path;
+}
+
+static editor* loadFile(const storage_ops* ops, const char* path) {
+  editor* E = editor_new_storage(ops);
+  int fd = open(path, O_RDONLY);
+  if (fd == -1 || !editor_load(E, fd)) {
+    perror(path);
+    exit(1);
+  }
+  close(fd);
+  return E;
+}
+
+// a window showing E on a screen of its own, drawn into a frame that
+// is then thrown away, without a terminal
+static window* benchWindow(editor* E) {
+  window* W = xcalloc(1, sizeof(window));
+  W->editorList = xmalloc(2 * sizeof(editor*));
+  W->editorList[0] = E;
+  W->editorList[1] = NULL;
+  W->editorLim = 2;
+  W->editorLen = 1;
+  W->activeIndex = 0;
+  W->editor = E;
+  W->storage = E->buffer->ops;
+  W->frame = frame_new(1 << 14);
+  W->line = frame_new(256);
+  W->screen = screen_new(BENCH_ROWS + 3, BENCH_COLS);
+  W->finder = finder_new();
+  W->latency = latency_new();
+  W->screenrows = BENCH_ROWS;
+  W->screencols = BENCH_COLS;
+  W->message[0] = '\0';
+  return W;
+}
+
+static void freeWindow(window* W) {
+  free(W->editorList);
+  frame_free(W->frame);
+  frame_free(W->line);
+  screen_free(W->screen);
+  finder_free(W->finder);
+  latency_free(W->latency);
+  free(W);
+}
+
+static void bench(const storage_ops* backend, size_t size, const char* path, int sink) {
+  const char* name = backend->name;
+  size_t ops;
+  double start;
+
+  // opening the file, fresh each time
+  editor* E = NULL;
+  start = now();
+  for (ops = 0; ops == 0 || more(ops, start); ops++) {
+    if (E != NULL) editor_free(E);
+    E = loadFile(backend, path);
+  }
+  report("load", name, size, ops, now() - start, size);
+  storage* S = E->buffer;
+  size_t len = storage_len(S);
+
+  // a search for a string that is not there reads all of the text
+  start = now();
+  for (ops = 0; ops == 0 || more(ops, start); ops++) {
+    size_t match;
+    if (search_forward(S, "zebra", 5, 0, &match)) abort();
+  }
+  report("search", name, size, ops, now() - start, len);
+
+  // the row of a random offset and the start of that row
+  start = now();
+  size_t sum = 0;
+  for (ops = 0; more(ops, start); ops++) {
+    size_t row = storage_row_at(S, randomOffset(len + 1));
+    sum += storage_line_start(S, row);
+  }
+  report("lookup", name, size, ops, now() - start, 0);
+
+  // the cursor down to the last row and back up
+  editor_goto(E, 0);
+  bool down = true;
+  start = now();
+  for (ops = 0; more(ops, start); ops++) {
+    if (down && E->row == E->numrows) down = false;
+    else if (!down && E->row == 1) down = true;
+    if (down) editor_down(E);
+    else editor_up(E);
+  }
+  report("sweep", name, size, ops, now() - start, 0);
+
+  // page moves, the same way
+  window* W = benchWindow(E);
+  editor_goto(E, 0);
+  down = true;
+  start = now();
+  for (ops = 0; more(ops, start); ops++) {
+    if (down && E->row == E->numrows) down = false;
+    else if (!down && E->row == 1) down = true;
+    movePage(W, down ? PAGE_DOWN : PAGE_UP);
+  }
+  report("page", name, size, ops, now() - start, 0);
+
+  // drawing a new page of text every frame
+  size_t row = 1;
+  start = now();
+  for (ops = 0; more(ops, start); ops++) {
+    editor_goto(E, storage_line_start(S, row));
+    scroll(W);
+    render(W);
+    frame_flush(W->frame, sink);
+    row = row + BENCH_ROWS <= E->numrows ? row + BENCH_ROWS : 1;
+  }
+  report("render", name, size, ops, now() - start, 0);
+  freeWindow(W);
+
+  // typing in the middle of the text, a newline now and then
+  const char* typed = "typing a line of text\n";
+  editor_goto(E, len / 2);
+  start = now();
+  for (ops = 0; more(ops, start); ops++) {
+    editor_insert(E, typed[ops % strlen(typed)]);
+  }
+  report("typing", name, size, ops, now() - start, 0);
+
+  // short inserts at random places
+  srand(15122);
+  start = now();
+  for (ops = 0; more(ops, start); ops++) {
+    editor_goto(E, randomOffset(storage_len(S) + 1));
+    editor_insert_n(E, "edit\n", 5);
+  }
+  report("random_insert", name, size, ops, now() - start, 0);
+
+  // deleting short ranges at random places
+  start = now();
+  for (ops = 0; more(ops, start); ops++) {
+    size_t offset = randomOffset(storage_len(S) + 1);
+    editor_delete_range(E, offset, offset + 5);
+  }
+  report("random_delete", name, size, ops, now() - start, 0);
+
+  // writing the edited text to a file of its own
+  char* savepath = xmalloc(strlen(path) + sizeof(".save"));
+  strcpy(savepath, path);
+  strcat(savepath, ".save");
+  len = storage_len(S);
+  start = now();
+  for (ops = 0; ops == 0 || more(ops, start); ops++) {
+    int fd = open(savepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || !storage_write(S, fd) || close(fd) == -1) {
+      perror(savepath);
+      exit(1);
+    }
+  }
+  report("save", name, size, ops, now() - start, len);
+  unlink(savepath);
+  free(savepath);
+
+  editor_free(E);
+  kept = sum;
+}
+
+// size like 64K or 1G, 0 if malformed
+static size_t parseSize(const char* s, char** end) {
+  size_t size = strtoul(s, end, 10);
+  if (**end == 'K' || **end == 'k') size <<= 10;
+  else if (**end == 'M' || **end == 'm') size <<= 20;
+  else if (**end == 'G' || **end == 'g') size <<= 30;
+  else return size;
+  *end += 1;
+  return size;
+}
+
+int main(int argc, char** argv) {
+  const char* sizes = "1K,64K,1M,16M,256M,1G";
+  const char* backends = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) sizes = argv[++i];
+    else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) backends = argv[++i];
+    else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) budget = atof(argv[++i]);
+    else if (strcmp(argv[i], "-j") == 0) json = true;
+    else {
+      fprintf(stderr, "Usage: rye-bench [-s 1K,64K,1M,16M,256M,1G] [-b gapbuf,piecetable,rope] "
+                      "[-t seconds] [-j]\n");
+      return 1;
+    }
+  }
+
+  // the backends asked for, in order
+  const storage_ops* list[3] = {&gapbuf_storage, &piecetable_storage, &rope_storage};
+  size_t count = 3;
+  if (backends != NULL) {
+    char* names = xmalloc(strlen(backends) + 1);
+    strcpy(names, backends);
+    count = 0;
+    for (char* name = strtok(names, ","); name != NULL && count < 3; name = strtok(NULL, ",")) {
+      list[count] = storage_backend(name);
+      if (list[count] == NULL) {
+        fprintf(stderr, "Unknown storage '%s', use gapbuf, piecetable or rope\n", name);
+        return 1;
+      }
+      count += 1;
+    }
+    free(names);
+  }
+
+  int sink = open("/dev/null", O_WRONLY);
+  if (sink == -1) {
+    perror("/dev/null");
+    return 1;
+  }
+  const char* s = sizes;
+  while (*s != '\0') {
+    char* end;
+    size_t size = parseSize(s, &end);
+    if (size == 0 || (*end != ',' && *end != '\0')) {
+      fprintf(stderr, "Bad size '%s'\n", s);
+      return 1;
+    }
+    char* path = makeFile(size);
+    for (size_t b = 0; b < count; b++) bench(list[b], size, path, sink);
+    unlink(path);
+    free(path);
+    s = *end == ',' ? end + 1 : end;
+  }
+  if (json) printf(rows > 0 ? "\n]\n" : "[]\n");
+  close(sink);
+  return 0;
+}
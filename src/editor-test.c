@@ -1,9 +1,11 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
 #include "lib/contracts.h"
 #include "lib/xalloc.h"
 #include "gapbuf.h"
+#include "storage.h"
 #include "editor.h"
 
 /* TO-DO: more testing on rendercol functions */
@@ -175,6 +177,143 @@ int main(void) {
 
   editor_free(B);
 
+  editor* C = editor_new();
+  editor_insert(C, 'a');
+  editor_insert(C, '\t');
+  editor_insert(C, 'b');
+  editor_insert(C, '\n');
+  editor_insert(C, 'c');
+  editor_insert(C, '\n');
+  editor_insert(C, 'd'); // a\tb\nc\nd[]
+  editor_goto(C, 0);
+  assert(is_editor(C));
+  assert(C->row == 1);
+  assert(C->col == 0);
+  editor_goto(C, 3); // a\tb[]\nc\nd
+  assert(is_editor(C));
+  assert(C->row == 1);
+  assert(C->col == 3);
+  assert(C->rendercol == 9);
+  editor_goto(C, 5); // a\tb\nc[]\nd
+  assert(is_editor(C));
+  assert(C->row == 2);
+  assert(C->col == 1);
+  editor_goto(C, 100); // a\tb\nc\nd[]
+  assert(is_editor(C));
+  assert(C->row == 3);
+  assert(C->col == 1);
+
+  editor_insert_n(C, "x\ty\nzz", 6); // a\tb\nc\ndx\ty\nzz[]
+  assert(is_editor(C));
+  assert(C->row == 4);
+  assert(C->col == 2);
+  assert(C->rendercol == 2);
+  assert(C->numrows == 4);
+  editor_goto(C, 2);
+  editor_insert_n(C, "\t", 1); // a\t\t[]b\nc\ndx\ty\nzz
+  assert(is_editor(C));
+  assert(C->col == 3);
+  assert(C->rendercol == 16);
+  editor_delete_range(C, 1, 7); // a[]dx\ty\nzz
+  assert(is_editor(C));
+  assert(C->row == 1);
+  assert(C->col == 1);
+  assert(C->numrows == 2);
+  editor_delete_range(C, 0, 100); // []
+  assert(is_editor(C));
+  assert(C->numrows == 1);
+  editor_free(C);
+
+  // same operations with the piece table backend
+  editor* D = editor_new_storage(&piecetable_storage);
+  editor_insert_n(D, "a\tb\nc\nd", 7); // a\tb\nc\nd[]
+  assert(is_editor(D));
+  assert(D->row == 3);
+  assert(D->numrows == 3);
+  editor_up(D);
+  editor_up(D); // a[]\tb\nc\nd
+  assert(is_editor(D));
+  assert(D->row == 1);
+  assert(D->col == 1);
+  editor_forward(D); // a\t[]b\nc\nd
+  assert(D->rendercol == 8);
+  editor_endline(D);
+  editor_delete(D);
+  editor_delete(D); // a[]\nc\nd
+  assert(is_editor(D));
+  assert(D->col == 1);
+  assert(D->rendercol == 1);
+  editor_forward(D);
+  editor_delete(D); // a[]c\nd
+  assert(is_editor(D));
+  assert(D->row == 1);
+  assert(D->numrows == 2);
+  editor_free(D);
+
+  // and with the rope backend
+  editor* R = editor_new_storage(&rope_storage);
+  editor_insert_n(R, "a\tb\nc\nd", 7); // a\tb\nc\nd[]
+  assert(is_editor(R));
+  assert(R->row == 3);
+  assert(R->numrows == 3);
+  editor_goto(R, 2); // a\t[]b\nc\nd
+  assert(is_editor(R));
+  assert(R->rendercol == 8);
+  editor_delete_range(R, 1, 5); // a[]c\nd
+  assert(is_editor(R));
+  assert(R->row == 1);
+  assert(R->col == 1);
+  assert(R->numrows == 2);
+
+  // a new text replaces the old one at once
+  storage* T = storage_new(&rope_storage);
+  storage_insert(T, "x\ny\nz\nw", 7);
+  int dirty = R->dirty;
+  unsigned long edits = R->edits;
+  editor_replace_buffer(R, T, 4); // x\ny\n[]z\nw
+  assert(is_editor(R));
+  assert(R->buffer == T);
+  assert(R->row == 3);
+  assert(R->col == 0);
+  assert(R->numrows == 4);
+  assert(R->dirty == dirty + 1);
+  assert(R->edits == edits + 1);
+  editor_free(R);
+
+  // ranges of every backend by name
+  const char* names[] = {"gapbuf", "piecetable", "rope"};
+  for (size_t i = 0; i < 3; i++) {
+    const storage_ops* ops = storage_backend(names[i]);
+    assert(ops != NULL);
+    storage* S = storage_new(ops);
+    storage_insert(S, "hello\nworld", 11);
+    storage_move_to(S, 5);
+    storage_insert(S, ", you", 5); // hello, you\nworld
+    char* sub = storage_substr(S, 3, 13);
+    assert(strcmp(sub, "lo, you\nwo") == 0);
+    free(sub);
+    size_t offset = 4;
+    size_t total = 0;
+    size_t n;
+    const char* span;
+    while ((span = storage_next_span(S, &offset, 9, &n)) != NULL) {
+      assert(n > 0);
+      total += n;
+    }
+    assert(offset == 9);
+    assert(total == 5);
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(storage_write(S, fds[1]));
+    close(fds[1]);
+    char buf[32];
+    assert(read(fds[0], buf, sizeof(buf)) == 16);
+    assert(strncmp(buf, "hello, you\nworld", 16) == 0);
+    close(fds[0]);
+    storage_free(S);
+  }
+  assert(storage_backend("linkedlist") == NULL);
+
   printf("Passed all tests!\n");
 
   return 0;
@@ -15,22 +15,32 @@
 #include "lib/contracts.h"
 #include "lib/xalloc.h"
 #include "gapbuf.h"
+#include "storage.h"
 #include "editor.h"
 
+// rendercol of the cursor, from the start of its line
+static size_t editor_rendercol(editor* E);
+
 bool is_editor(editor* E) {
   if (E == NULL) return false;
-  if (!is_gapbuf(E->buffer)) return false;
-  if (E->row != gapbuf_row(E->buffer)) return false;
-  if (E->col != gapbuf_col(E->buffer)) return false;
-  if (E->rendercol != gapbuf_rendercol(E->buffer)) return false;
-  if (E->numrows != gapbuf_numrows(E->buffer)) return false;
+  if (!is_storage(E->buffer)) return false;
+  if (E->row != storage_row(E->buffer)) return false;
+  if (E->col != storage_cursor(E->buffer)
+                - storage_line_start(E->buffer, E->row)) return false;
+  if (E->rendercol != editor_rendercol(E)) return false;
+  if (E->numrows != storage_numrows(E->buffer)) return false;
   return true;
 }
 
 editor* editor_new(void) {
+  return editor_new_storage(&gapbuf_storage);
+}
+
+editor* editor_new_storage(const storage_ops* ops) {
+  REQUIRES(ops != NULL);
   editor* E = xmalloc(sizeof(editor));
 
-  E->buffer = gapbuf_new(10);
+  E->buffer = storage_new(ops);
   E->row = 1;
   E->col = 0;
   E->rendercol = 0;
@@ -41,6 +51,7 @@ editor* editor_new(void) {
 
   E->filename = NULL;
   E->dirty = 0;
+  E->edits = 0;
   E->quit_times = QUIT_TIMES;
 
   ENSURES(is_editor(E));
@@ -49,14 +60,44 @@ editor* editor_new(void) {
 
 /* editor operations */
 
+// rendercol after rendering s[0, n) from rendercol, s has no newline
+static size_t advance_rendercol(size_t rendercol, const char* s, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (s[i] == '\t') {
+      rendercol += (TAB_STOP - 1) - (rendercol % TAB_STOP);
+    }
+    rendercol += 1;
+  }
+  return rendercol;
+}
+
+static size_t editor_rendercol(editor* E) {
+  size_t offset = storage_line_start(E->buffer, E->row);
+  size_t cursor = storage_cursor(E->buffer);
+  size_t rendercol = 0;
+  size_t n;
+  const char* s;
+  while ((s = storage_next_span(E->buffer, &offset, cursor, &n)) != NULL) {
+    rendercol = advance_rendercol(rendercol, s, n);
+  }
+  return rendercol;
+}
+
+// recompute row, col and rendercol from the line index
+static void editor_fixpos(editor* E) {
+  E->row = storage_row(E->buffer);
+  E->col = storage_cursor(E->buffer) - storage_line_start(E->buffer, E->row);
+  E->rendercol = editor_rendercol(E);
+}
+
 void editor_forward(editor* E) {
   REQUIRES(is_editor(E));
-  if (gapbuf_at_right(E->buffer)) return;
+  size_t cursor = storage_cursor(E->buffer);
+  if (cursor == storage_len(E->buffer)) return;
 
-  ASSERT(!gapbuf_at_right(E->buffer));
   // character to the right of cursor
-  char c = E->buffer->back[E->buffer->backlen - 1];
-  gapbuf_forward(E->buffer);
+  char c = storage_char_at(E->buffer, cursor);
+  storage_move_to(E->buffer, cursor + 1);
   if (c == '\n') {
     E->row += 1;
     E->col = 0;
@@ -77,20 +118,20 @@ void editor_forward(editor* E) {
 
 void editor_backward(editor* E) {
   REQUIRES(is_editor(E));
-  if (gapbuf_at_left(E->buffer)) return;
+  size_t cursor = storage_cursor(E->buffer);
+  if (cursor == 0) return;
 
-  ASSERT(!gapbuf_at_left(E->buffer));
   // character to the left of cursor
-  char c = E->buffer->front[E->buffer->frontlen - 1];
-  gapbuf_backward(E->buffer);
+  char c = storage_char_at(E->buffer, cursor - 1);
+  storage_move_to(E->buffer, cursor - 1);
   if (c == '\n') {
     E->row -= 1;
-    E->col = gapbuf_col(E->buffer);
-    E->rendercol = gapbuf_rendercol(E->buffer);
+    E->col = cursor - 1 - storage_line_start(E->buffer, E->row);
+    E->rendercol = editor_rendercol(E);
   }
   else if (c == '\t') {
     E->col -= 1;
-    E->rendercol = gapbuf_rendercol(E->buffer);
+    E->rendercol = editor_rendercol(E);
   }
   else {
     E->col -= 1;
@@ -105,9 +146,7 @@ void editor_up(editor* E) {
   
   // if already at first line, move to left most
   if (E->row == 1) {
-    while (!gapbuf_at_left(E->buffer)) {
-      editor_backward(E);
-    }
+    editor_goto(E, 0);
     ENSURES(is_editor(E));
     return;
   }
@@ -128,9 +167,7 @@ void editor_down(editor* E) {
 
   // if already at final line, move to rightmost
   if (E->row == E->numrows) {
-    while(!gapbuf_at_right(E->buffer)) {
-      editor_forward(E);
-    }
+    editor_goto(E, storage_len(E->buffer));
     ENSURES(is_editor(E));
     return;
   }
@@ -143,8 +180,8 @@ void editor_down(editor* E) {
   }
 
   while (E->col < orig_col 
-        && (!gapbuf_at_right(E->buffer)) 
-        && E->buffer->back[E->buffer->backlen-1] != '\n') {
+        && storage_cursor(E->buffer) < storage_len(E->buffer)
+        && storage_char_at(E->buffer, storage_cursor(E->buffer)) != '\n') {
     editor_forward(E);
   }
 
@@ -154,8 +191,8 @@ void editor_down(editor* E) {
 
 void editor_endline(editor* E) {
   REQUIRES(is_editor(E));
-  while (!gapbuf_at_right(E->buffer) 
-          && E->buffer->back[E->buffer->backlen - 1] != '\n') {
+  while (storage_cursor(E->buffer) < storage_len(E->buffer)
+          && storage_char_at(E->buffer, storage_cursor(E->buffer)) != '\n') {
     editor_forward(E);
   }
   E->quit_times = QUIT_TIMES;
@@ -164,17 +201,42 @@ void editor_endline(editor* E) {
 
 void editor_startline(editor* E) {
   REQUIRES(is_editor(E));
-  while (!gapbuf_at_left(E->buffer)
-          && E->buffer->front[E->buffer->frontlen - 1] != '\n') {
+  while (storage_cursor(E->buffer) > 0
+          && storage_char_at(E->buffer, storage_cursor(E->buffer) - 1) != '\n') {
     editor_backward(E);
   }
   E->quit_times = QUIT_TIMES;
   ENSURES(is_editor(E));
 }
 
+bool editor_load(editor* E, int fd) {
+  REQUIRES(is_editor(E));
+  REQUIRES(storage_len(E->buffer) == 0);
+
+  bool ok = storage_load(E->buffer, fd);
+  E->numrows = storage_numrows(E->buffer);
+  editor_fixpos(E);
+  E->dirty = 0;
+  E->edits += 1;
+
+  ENSURES(is_editor(E));
+  return ok;
+}
+
+void editor_goto(editor* E, size_t offset) {
+  REQUIRES(is_editor(E));
+  if (offset > storage_len(E->buffer)) offset = storage_len(E->buffer);
+
+  storage_move_to(E->buffer, offset);
+  editor_fixpos(E);
+
+  E->quit_times = QUIT_TIMES;
+  ENSURES(is_editor(E));
+}
+
 void editor_insert(editor* E, char c) {
   REQUIRES(is_editor(E));
-  gapbuf_insert(E->buffer, c);
+  storage_insert(E->buffer, &c, 1);
   if (c == '\n') {
     E->row += 1;
     E->col = 0;
@@ -191,41 +253,117 @@ void editor_insert(editor* E, char c) {
     E->rendercol += 1;
   }
   E->dirty += 1;
+  E->edits += 1;
   E->quit_times = QUIT_TIMES;
   ENSURES(is_editor(E));
 }
 
 void editor_delete(editor* E) {
   REQUIRES(is_editor(E));
-  if (gapbuf_at_left(E->buffer)) return;
+  size_t cursor = storage_cursor(E->buffer);
+  if (cursor == 0) return;
 
-  ASSERT(!gapbuf_at_left(E->buffer));
-  char c = gapbuf_delete(E->buffer);
+  char c = storage_char_at(E->buffer, cursor - 1);
+  storage_delete_range(E->buffer, cursor - 1, cursor);
   if (c == '\n') {
     E->row -= 1;
-    E->col = gapbuf_col(E->buffer);
-    E->rendercol = gapbuf_rendercol(E->buffer);
+    E->col = cursor - 1 - storage_line_start(E->buffer, E->row);
+    E->rendercol = editor_rendercol(E);
     E->numrows -= 1;
   }
   else if (c == '\t') {
     E->col -= 1;
-    E->rendercol = gapbuf_rendercol(E->buffer);
+    E->rendercol = editor_rendercol(E);
   }
   else {
     E->col -= 1;
     E->rendercol -= 1;
   }
   E->dirty += 1;
+  E->edits += 1;
+  E->quit_times = QUIT_TIMES;
+  ENSURES(is_editor(E));
+}
+
+void editor_insert_n(editor* E, const char* s, size_t n) {
+  REQUIRES(is_editor(E));
+  REQUIRES(s != NULL || n == 0);
+  if (n == 0) return;
+
+  // the storage counts the newlines in s while indexing them
+  storage_insert(E->buffer, s, n);
+  size_t numrows = storage_numrows(E->buffer);
+  if (numrows != E->numrows) {
+    E->numrows = numrows;
+    editor_fixpos(E);
+  }
+  else {
+    E->col += n;
+    E->rendercol = advance_rendercol(E->rendercol, s, n);
+  }
+  E->dirty += 1;
+  E->edits += 1;
   E->quit_times = QUIT_TIMES;
   ENSURES(is_editor(E));
 }
 
+void editor_delete_range(editor* E, size_t start, size_t end) {
+  REQUIRES(is_editor(E));
+  if (end > storage_len(E->buffer)) end = storage_len(E->buffer);
+  if (start >= end) return;
+
+  // cursor moves to start, which keeps row and col
+  editor_goto(E, start);
+  storage_delete_range(E->buffer, start, end);
+  E->numrows = storage_numrows(E->buffer);
+
+  E->dirty += 1;
+  E->edits += 1;
+  E->quit_times = QUIT_TIMES;
+  ENSURES(is_editor(E));
+}
+
+void editor_replace_buffer(editor* E, storage* S, size_t offset) {
+  REQUIRES(is_editor(E));
+  REQUIRES(is_storage(S) && S != E->buffer);
+  if (offset > storage_len(S)) offset = storage_len(S);
+
+  // whoever watched the old text watches the new one, which replaced
+  // all of it
+  storage_watch_fn* watch = E->buffer->watch;
+  void* data = E->buffer->watchdata;
+  size_t oldlen = storage_len(E->buffer);
+  storage_watch(E->buffer, NULL, NULL);
+
+  // rows are counted once for the whole new text
+  storage_free(E->buffer);
+  E->buffer = S;
+  storage_move_to(E->buffer, offset);
+  E->numrows = storage_numrows(E->buffer);
+  editor_fixpos(E);
+  if (watch != NULL) {
+    storage_watch(S, watch, data);
+    (*watch)(data, S, 0, oldlen, storage_len(S));
+  }
+
+  E->dirty += 1;
+  E->edits += 1;
+  E->quit_times = QUIT_TIMES;
+  ENSURES(is_editor(E));
+}
+
+void editor_sync(editor* E) {
+  REQUIRES(E != NULL && is_storage(E->buffer));
+  E->numrows = storage_numrows(E->buffer);
+  editor_fixpos(E);
+  ENSURES(is_editor(E));
+}
 
 /* free */
 
 void editor_free(editor* E) {
   REQUIRES(is_editor(E));
-  gapbuf_free(E->buffer);
+  storage_free(E->buffer);
   if (E->filename != NULL) free(E->filename);
   free(E);
 }
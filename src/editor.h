@@ -4,6 +4,7 @@
 #include <string.h>
 #include <termios.h>
 #include "gapbuf.h"
+#include "storage.h"
 
 #ifndef EDITOR_H
 #define EDITOR_H
@@ -11,7 +12,7 @@
 #define QUIT_TIMES (3)
 
 struct editor_header {
-  gapbuf* buffer;
+  storage* buffer;      // text, with any storage backend
   size_t row;           // current row
   size_t col;           // current col
   size_t rendercol;     // col when render, considering tabs
@@ -20,6 +21,7 @@ struct editor_header {
   size_t coloff;        // first visible col
   char* filename;       // name of file
   int dirty;            // dirty flag to show modified
+  unsigned long edits;  // times the text changed, unlike dirty never reset
   int quit_times;       // times need to quit
 };
 typedef struct editor_header editor;
@@ -27,6 +29,8 @@ typedef struct editor_header editor;
 bool is_editor(editor* E);                    // representation invariant
 
 editor* editor_new(void); 	                  // create a new and empty editor
+editor* editor_new_storage(const storage_ops* ops);
+                                              // create a new and empty editor with storage backend ops
 
 /* editor operations */
 
@@ -36,8 +40,20 @@ void editor_up(editor* E);
 void editor_down(editor* E);
 void editor_endline(editor* E);
 void editor_startline(editor* E);
+bool editor_load(editor* E, int fd);          // read file into empty editor, false on error
+void editor_goto(editor* E, size_t offset);   // move the cursor to offset, clamped to the end
 void editor_insert(editor* E, char c);        // insert c to the cursor’s left
 void editor_delete(editor* E);                // remove the node to the cursor’s left
+void editor_insert_n(editor* E, const char* s, size_t n);
+                                              // insert n chars of s to the cursor’s left
+void editor_delete_range(editor* E, size_t start, size_t end);
+                                              // remove chars in [start, end), cursor moves to start
+void editor_replace_buffer(editor* E, storage* S, size_t offset);
+                                              // free the text and edit S instead, cursor at
+                                              // offset clamped to the end
+void editor_sync(editor* E);                   // count rows and place the cursor again
+                                              // after the text changed other than
+                                              // through E
 
 /* free */
 
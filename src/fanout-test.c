@@ -0,0 +1,81 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "fanout.h"
+
+// the hits are exactly the matches of query in texts, by brute force
+static void check_hits(fanout* P, char** texts, size_t* lens, size_t numfiles,
+                       const char* query) {
+  size_t n = strlen(query);
+  size_t count = 0;
+  for (size_t f = 0; f < numfiles; f++) {
+    for (size_t i = 0; i + n <= lens[f]; i++) {
+      if (memcmp(texts[f] + i, query, n) != 0) continue;
+      assert(P->hits[count].file == f);
+      assert(P->hits[count].offset == i);
+      count += 1;
+    }
+  }
+  assert(P->total == count);
+  assert(P->numhits == count);
+}
+
+int main(void) {
+  printf("Testing fanout library...\n");
+  const storage_ops* backends[] = {&gapbuf_storage, &piecetable_storage, &rope_storage};
+
+  // files of every backend, some larger than a chunk, some empty
+  size_t numfiles = 7;
+  storage* files[7];
+  char* texts[7];
+  size_t lens[7];
+  for (size_t f = 0; f < numfiles; f++) {
+    lens[f] = f == 0 || f == 3 ? FANOUT_CHUNK + 5 : f == 4 ? 0 : 1000 + f;
+    texts[f] = xmalloc(lens[f] + 1);
+    for (size_t i = 0; i < lens[f]; i++) {
+      texts[f][i] = i % 4096 < 60 ? "abcab\n"[(i + f) % 6] : 'x';
+    }
+    files[f] = storage_new(backends[f % 3]);
+    storage_insert(files[f], texts[f], lens[f]);
+    storage_move_to(files[f], lens[f] / 2);
+  }
+
+  fanout* P = fanout_new(3);
+  assert(fanout_search(P, files, numfiles, "ab", 2) == P->total);
+  check_hits(P, texts, lens, numfiles, "ab");
+  fanout_search(P, files, numfiles, "b\na", 3);
+  check_hits(P, texts, lens, numfiles, "b\na");
+  fanout_search(P, files, numfiles, "zz", 2);
+  check_hits(P, texts, lens, numfiles, "zz");
+
+  // first hit at or after a place
+  fanout_search(P, files, numfiles, "c", 1);
+  check_hits(P, texts, lens, numfiles, "c");
+  size_t k = fanout_find(P, 1, 0);
+  assert(P->hits[k].file == 1 && P->hits[k].offset == 1);
+  k = fanout_find(P, 1, 2);
+  assert(P->hits[k].file == 1 && P->hits[k].offset == 7);
+  k = fanout_find(P, 4, 0);
+  assert(P->hits[k].file == 5);
+  assert(fanout_find(P, numfiles, 0) == P->numhits);
+
+  fanout_clear(P);
+  assert(P->numhits == 0 && P->querylen == 0);
+  fanout_free(P);
+
+  // one worker per core besides the calling thread
+  P = fanout_new(0);
+  fanout_search(P, files, 3, "abc", 3);
+  check_hits(P, texts, lens, 3, "abc");
+  fanout_free(P);
+
+  for (size_t f = 0; f < numfiles; f++) {
+    storage_free(files[f]);
+    free(texts[f]);
+  }
+  printf("All test cases passed!\n");
+  return 0;
+}
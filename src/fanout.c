@@ -0,0 +1,236 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "search.h"
+#include "fanout.h"
+
+bool is_fanout(fanout* P) {
+  if (P == NULL) return false;
+  if (P->numthreads > FANOUT_THREADS) return false;
+  if (P->query == NULL || P->querylen > P->querylimit) return false;
+  if (P->tasks == NULL || P->numtasks > P->tasklimit) return false;
+  if (P->nexttask > P->numtasks) return false;
+  if (P->hits == NULL || P->numhits > P->hitlimit) return false;
+  if (P->numhits > FANOUT_HITS || P->total < P->numhits) return false;
+  for (size_t i = 1; i < P->numhits; i++) {
+    struct fanout_hit a = P->hits[i-1];
+    struct fanout_hit b = P->hits[i];
+    if (a.file > b.file || (a.file == b.file && a.offset >= b.offset)) return false;
+  }
+  return true;
+}
+
+// collect the matches of one task, without the lock
+static void fanout_run(fanout* P, struct fanout_task* T) {
+  storage* S = P->files[T->file];
+  size_t at = T->from;
+  while (true) {
+    // once FANOUT_HITS are kept, the rest are only counted
+    size_t batch[FANOUT_BATCH];
+    size_t* out = batch;
+    size_t max = FANOUT_BATCH;
+    bool keep = T->numhits < FANOUT_HITS;
+    if (keep) {
+      if (max > FANOUT_HITS - T->numhits) max = FANOUT_HITS - T->numhits;
+      if (T->numhits + max > T->hitlimit) {
+        while (T->numhits + max > T->hitlimit) T->hitlimit *= 2;
+        T->hits = xrealloc(T->hits, T->hitlimit * sizeof(size_t));
+      }
+      out = T->hits + T->numhits;
+    }
+    size_t k = search_range(S, P->query, P->querylen, at, T->to, out, max);
+    if (keep) T->numhits += k;
+    T->total += k;
+    if (k < max) return;
+    at = out[k - 1] + 1;
+  }
+}
+
+// take tasks until none are left, lock held
+static void fanout_work(fanout* P) {
+  while (P->nexttask < P->numtasks) {
+    struct fanout_task* T = &P->tasks[P->nexttask];
+    P->nexttask += 1;
+    P->running += 1;
+    pthread_mutex_unlock(&P->lock);
+    fanout_run(P, T);
+    pthread_mutex_lock(&P->lock);
+    P->running -= 1;
+    if (P->running == 0 && P->nexttask == P->numtasks) pthread_cond_broadcast(&P->idle);
+  }
+}
+
+static void* fanout_worker(void* arg) {
+  fanout* P = arg;
+  pthread_mutex_lock(&P->lock);
+  while (!P->quit) {
+    if (P->nexttask == P->numtasks) {
+      pthread_cond_wait(&P->wake, &P->lock);
+      continue;
+    }
+    fanout_work(P);
+  }
+  pthread_mutex_unlock(&P->lock);
+  return NULL;
+}
+
+fanout* fanout_new(size_t threads) {
+  if (threads == 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cores > 1 ? (size_t)cores - 1 : 0;
+  }
+  if (threads > FANOUT_THREADS) threads = FANOUT_THREADS;
+
+  fanout* P = xmalloc(sizeof(fanout));
+  pthread_mutex_init(&P->lock, NULL);
+  pthread_cond_init(&P->wake, NULL);
+  pthread_cond_init(&P->idle, NULL);
+  P->quit = false;
+  P->files = NULL;
+  P->numfiles = 0;
+  P->querylimit = 64;
+  P->query = xmalloc(P->querylimit * sizeof(char));
+  P->querylen = 0;
+  P->tasklimit = 64;
+  P->tasks = xmalloc(P->tasklimit * sizeof(struct fanout_task));
+  P->numtasks = 0;
+  P->nexttask = 0;
+  P->running = 0;
+  P->hitlimit = FANOUT_BATCH;
+  P->hits = xmalloc(P->hitlimit * sizeof(struct fanout_hit));
+  P->numhits = 0;
+  P->total = 0;
+
+  P->numthreads = 0;
+  for (size_t i = 0; i < threads; i++) {
+    if (pthread_create(&P->threads[i], NULL, fanout_worker, P) != 0) {
+      fprintf(stderr, "cannot start search thread\n");
+      abort();
+    }
+    P->numthreads += 1;
+  }
+  ENSURES(is_fanout(P));
+  return P;
+}
+
+size_t fanout_search(fanout* P, storage** files, size_t numfiles,
+                     const char* query, size_t n) {
+  REQUIRES(is_fanout(P));
+  REQUIRES(files != NULL || numfiles == 0);
+  REQUIRES(query != NULL && n > 0);
+
+  pthread_mutex_lock(&P->lock);
+  P->files = files;
+  P->numfiles = numfiles;
+  if (n > P->querylimit) {
+    while (n > P->querylimit) P->querylimit *= 2;
+    P->query = xrealloc(P->query, P->querylimit * sizeof(char));
+  }
+  if (P->query != query) memmove(P->query, query, n);
+  P->querylen = n;
+
+  // one task per storage, or per chunk of a large one
+  P->numtasks = 0;
+  for (size_t f = 0; f < numfiles; f++) {
+    ASSERT(is_storage(files[f]));
+    size_t len = storage_len(files[f]);
+    size_t from = 0;
+    do {
+      if (P->numtasks == P->tasklimit) {
+        P->tasklimit *= 2;
+        P->tasks = xrealloc(P->tasks, P->tasklimit * sizeof(struct fanout_task));
+      }
+      struct fanout_task* T = &P->tasks[P->numtasks];
+      T->file = f;
+      T->from = from;
+      T->to = len - from > FANOUT_CHUNK ? from + FANOUT_CHUNK : len;
+      T->hitlimit = 16;
+      T->hits = xmalloc(T->hitlimit * sizeof(size_t));
+      T->numhits = 0;
+      T->total = 0;
+      P->numtasks += 1;
+      from = T->to;
+    } while (from < len);
+  }
+
+  // the workers and this thread share the tasks
+  P->nexttask = 0;
+  pthread_cond_broadcast(&P->wake);
+  fanout_work(P);
+  while (P->running > 0) pthread_cond_wait(&P->idle, &P->lock);
+
+  // tasks are in order, so their hits are too
+  P->numhits = 0;
+  P->total = 0;
+  for (size_t t = 0; t < P->numtasks; t++) {
+    struct fanout_task* T = &P->tasks[t];
+    size_t keep = T->numhits;
+    if (keep > FANOUT_HITS - P->numhits) keep = FANOUT_HITS - P->numhits;
+    if (P->numhits + keep > P->hitlimit) {
+      while (P->numhits + keep > P->hitlimit) P->hitlimit *= 2;
+      P->hits = xrealloc(P->hits, P->hitlimit * sizeof(struct fanout_hit));
+    }
+    for (size_t i = 0; i < keep; i++) {
+      P->hits[P->numhits + i].file = T->file;
+      P->hits[P->numhits + i].offset = T->hits[i];
+    }
+    P->numhits += keep;
+    P->total += T->total;
+    free(T->hits);
+  }
+  P->files = NULL;
+  P->numtasks = 0;
+  P->nexttask = 0;
+  pthread_mutex_unlock(&P->lock);
+
+  ENSURES(is_fanout(P));
+  return P->total;
+}
+
+size_t fanout_find(fanout* P, size_t file, size_t offset) {
+  REQUIRES(is_fanout(P));
+  size_t lo = 0;
+  size_t hi = P->numhits;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    struct fanout_hit h = P->hits[mid];
+    if (h.file < file || (h.file == file && h.offset < offset)) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+void fanout_clear(fanout* P) {
+  REQUIRES(is_fanout(P));
+  P->files = NULL;
+  P->numfiles = 0;
+  P->querylen = 0;
+  P->numhits = 0;
+  P->total = 0;
+  ENSURES(is_fanout(P));
+}
+
+void fanout_free(fanout* P) {
+  REQUIRES(is_fanout(P));
+  pthread_mutex_lock(&P->lock);
+  P->quit = true;
+  pthread_cond_broadcast(&P->wake);
+  pthread_mutex_unlock(&P->lock);
+  for (size_t i = 0; i < P->numthreads; i++) pthread_join(P->threads[i], NULL);
+
+  pthread_mutex_destroy(&P->lock);
+  pthread_cond_destroy(&P->wake);
+  pthread_cond_destroy(&P->idle);
+  free(P->query);
+  free(P->tasks);
+  free(P->hits);
+  free(P);
+}
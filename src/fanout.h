@@ -0,0 +1,76 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "storage.h"
+
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#define FANOUT_THREADS (64)        // most worker threads
+#define FANOUT_CHUNK (1 << 22)     // bytes of a storage searched by one task
+#define FANOUT_BATCH (4096)        // matches collected by one search_range
+#define FANOUT_HITS (1 << 22)      // most hits kept, the rest are only counted
+
+/* Searching many storages at once. The search is split into tasks of
+ * one storage, or one chunk of a large storage, which a pool of worker
+ * threads and the calling thread take in turn. Each task collects its
+ * own hits, so the threads never share results, and the hits come out
+ * ordered by storage and offset by putting the tasks back in order.
+ *
+ * The storages must not change while they are searched. Reading a
+ * storage never changes it, so several threads can read one at once.
+ */
+struct fanout_task {
+  size_t file;               // index of the storage searched
+  size_t from;               // matches starting in [from, to)
+  size_t to;
+  size_t* hits;              // their offsets, increasing
+  size_t numhits;            // number of offsets in hits, <= FANOUT_HITS
+  size_t hitlimit;           // \length(hits) = hitlimit
+  size_t total;              // matches counted, total >= numhits
+};
+
+struct fanout_hit {
+  size_t file;               // index of the storage
+  size_t offset;             // offset of the match in it
+};
+
+struct fanout_header {
+  pthread_t threads[FANOUT_THREADS];
+  size_t numthreads;         // workers started, besides the calling thread
+  pthread_mutex_t lock;      // guards the tasks
+  pthread_cond_t wake;       // workers wait here for tasks
+  pthread_cond_t idle;       // fanout_search waits here for the last task
+  bool quit;                 // the workers exit
+  storage** files;           // storages being searched, NULL between searches
+  size_t numfiles;           // number of storages last searched
+  char* query;               // last query, querylen = 0 if none
+  size_t querylen;           // length of query
+  size_t querylimit;         // bytes allocated for query, querylen <= querylimit
+  struct fanout_task* tasks; // tasks of the current search, in order
+  size_t numtasks;           // number of tasks
+  size_t tasklimit;          // \length(tasks) = tasklimit
+  size_t nexttask;           // first task no thread has taken yet
+  size_t running;            // tasks taken but not finished
+  struct fanout_hit* hits;   // hits of the last search, by file and offset
+  size_t numhits;            // number of hits, <= FANOUT_HITS
+  size_t hitlimit;           // \length(hits) = hitlimit
+  size_t total;              // matches counted, total >= numhits
+};
+typedef struct fanout_header fanout;
+
+bool is_fanout(fanout* P);                       // representation invariant
+
+fanout* fanout_new(size_t threads);              // create with threads workers,
+                                                 // or one per core but one if 0
+size_t fanout_search(fanout* P, storage** files, size_t numfiles,
+                     const char* query, size_t n);
+                                                 // every match of query[0, n) in
+                                                 // files, returns how many, n > 0
+size_t fanout_find(fanout* P, size_t file, size_t offset);
+                                                 // first hit at or after offset of
+                                                 // file, numhits if none
+void fanout_clear(fanout* P);                    // forget the last search
+void fanout_free(fanout* P);                     // stop the workers and free
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "search.h"
+#include "finder.h"
+
+// waits for the worker to count every match
+static void wait_done(finder* F) {
+  while (true) {
+    finder_lock(F);
+    bool done = F->done;
+    finder_unlock(F);
+    if (done) return;
+  }
+}
+
+// the kept matches are exactly those of query in text, by brute force
+static void check_matches(finder* F, const char* text, size_t len, const char* query) {
+  finder_lock(F);
+  size_t n = strlen(query);
+  size_t count = 0;
+  for (size_t i = 0; i + n <= len; i++) {
+    if (memcmp(text + i, query, n) != 0) continue;
+    if (count < F->nummatches) assert(F->matches[count] == i);
+    count += 1;
+  }
+  assert(F->total == count);
+  assert(F->nummatches == (count < FINDER_MATCHES ? count : FINDER_MATCHES));
+  finder_unlock(F);
+}
+
+int main(void) {
+  printf("Testing finder library...\n");
+  finder* F = finder_new();
+
+  // a text of two chunks with a match across the gap
+  size_t len = FINDER_CHUNK + 1002;
+  char* text = xmalloc(len + 3);
+  for (size_t i = 0; i < len; i++) text[i] = "abcab\n"[i % 6];
+  storage* S = storage_new(&gapbuf_storage);
+  storage_insert(S, text, len);
+  storage_move_to(S, FINDER_CHUNK - 1);
+
+  finder_start(F, S, "ab", 2);
+  wait_done(F);
+  check_matches(F, text, len, "ab");
+  finder_lock(F);
+  size_t match;
+  assert(finder_next(F, 4, &match) && match == 6);
+  assert(finder_index(F, 6) == 3);
+  assert(finder_index(F, 7) == 0);
+  assert(!finder_next(F, len, &match));
+  finder_unlock(F);
+
+  // a longer query narrows the matches, a shorter one counts again
+  finder_start(F, S, "abc", 3);
+  wait_done(F);
+  check_matches(F, text, len, "abc");
+  finder_start(F, S, "abcab", 5);
+  wait_done(F);
+  check_matches(F, text, len, "abcab");
+  finder_start(F, S, "b\na", 3);
+  wait_done(F);
+  check_matches(F, text, len, "b\na");
+
+  // a new query cancels the scan, the cursor moves while it runs
+  finder_start(F, S, "c", 1);
+  finder_lock(F);
+  storage_move_to(S, 17);
+  finder_unlock(F);
+  finder_start(F, S, "ca", 2);
+  wait_done(F);
+  check_matches(F, text, len, "ca");
+
+  // stop waits for the worker, after which the storage may change
+  finder_start(F, S, "a", 1);
+  finder_stop(F);
+  finder_lock(F);
+  assert(F->S == NULL && F->total == 0 && !F->done);
+  finder_unlock(F);
+  storage_move_to(S, len);
+  storage_insert(S, "xyz", 3);
+  memcpy(text + len, "xyz", 3);
+  finder_start(F, S, "xyz", 3);
+  wait_done(F);
+  check_matches(F, text, len + 3, "xyz");
+  finder_stop(F);
+  storage_free(S);
+  free(text);
+
+  finder_free(F);
+  printf("All test cases passed!\n");
+  return 0;
+}
@@ -0,0 +1,274 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "search.h"
+#include "finder.h"
+
+bool is_finder(finder* F) {
+  if (F == NULL) return false;
+  if (F->query == NULL) return false;
+  if (F->querylen > F->querylimit) return false;
+  if (F->matches == NULL || F->candidates == NULL) return false;
+  if (F->nummatches > F->matchlimit || F->nummatches > FINDER_MATCHES) return false;
+  if (F->numcandidates > F->candidatelimit) return false;
+  if (F->total < F->nummatches) return false;
+  if (F->narrow >= F->querylen && F->narrow != 0) return false;
+  for (size_t i = 1; i < F->nummatches; i++) {
+    if (F->matches[i-1] >= F->matches[i]) return false;
+  }
+  return true;
+}
+
+void finder_lock(finder* F) {
+  // the worker hands the lock over between chunks while someone waits
+  __atomic_add_fetch(&F->waiting, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_lock(&F->lock);
+  __atomic_sub_fetch(&F->waiting, 1, __ATOMIC_SEQ_CST);
+  F->handovers += 1;
+  pthread_cond_broadcast(&F->turn);
+}
+
+void finder_unlock(finder* F) {
+  pthread_mutex_unlock(&F->lock);
+}
+
+// between chunks: let a waiting thread have the lock first, once, so
+// that one locking over and over cannot starve the worker
+static void finder_yield(finder* F) {
+  if (__atomic_load_n(&F->waiting, __ATOMIC_SEQ_CST) > 0) {
+    unsigned long handovers = F->handovers;
+    while (F->handovers == handovers) pthread_cond_wait(&F->turn, &F->lock);
+  }
+}
+
+// room for at least n match offsets
+static void finder_reserve(finder* F, size_t n) {
+  if (n <= F->matchlimit) return;
+  while (n > F->matchlimit) F->matchlimit *= 2;
+  F->matches = xrealloc(F->matches, F->matchlimit * sizeof(size_t));
+}
+
+// count and collect the matches of the query, a chunk at a time
+static void finder_count(finder* F, unsigned long generation) {
+  storage* S = F->S;
+  size_t len = storage_len(S);
+  size_t offset = 0;
+  while (offset < len) {
+    size_t to = len - offset > FINDER_CHUNK ? offset + FINDER_CHUNK : len;
+    size_t at = offset;
+    while (true) {
+      // once FINDER_MATCHES are kept, the rest are only counted
+      size_t batch[FINDER_BATCH];
+      size_t* out = batch;
+      size_t max = FINDER_BATCH;
+      bool keep = F->nummatches < FINDER_MATCHES;
+      if (keep) {
+        if (max > FINDER_MATCHES - F->nummatches) max = FINDER_MATCHES - F->nummatches;
+        finder_reserve(F, F->nummatches + max);
+        out = F->matches + F->nummatches;
+      }
+      size_t k = search_range(S, F->query, F->querylen, at, to, out, max);
+      if (keep) F->nummatches += k;
+      F->total += k;
+      if (k < max) break;
+      at = out[k - 1] + 1;
+    }
+    offset = to;
+
+    finder_yield(F);
+    if (F->generation != generation) return;
+  }
+  F->done = true;
+}
+
+// keep the matches of the previous query that continue with this one
+static void finder_narrow(finder* F, unsigned long generation) {
+  for (size_t i = 0; i < F->numcandidates; i += FINDER_BATCH) {
+    size_t count = F->numcandidates - i < FINDER_BATCH ? F->numcandidates - i : FINDER_BATCH;
+    size_t k = search_filter(F->S, F->candidates + i, count, F->narrow,
+                             F->query + F->narrow, F->querylen - F->narrow,
+                             F->matches + F->nummatches);
+    F->nummatches += k;
+    F->total += k;
+
+    finder_yield(F);
+    if (F->generation != generation) return;
+  }
+  F->done = true;
+}
+
+static void* finder_run(void* arg) {
+  finder* F = arg;
+  pthread_mutex_lock(&F->lock);
+  while (!F->quit) {
+    if (F->finished == F->generation) {
+      pthread_cond_wait(&F->wake, &F->lock);
+      continue;
+    }
+
+    // a newer generation may come while scanning, then this one is abandoned
+    unsigned long generation = F->generation;
+    if (F->S != NULL && F->narrow > 0) finder_narrow(F, generation);
+    else if (F->S != NULL) finder_count(F, generation);
+    F->finished = generation;
+    pthread_cond_broadcast(&F->idle);
+  }
+  pthread_mutex_unlock(&F->lock);
+  return NULL;
+}
+
+finder* finder_new(void) {
+  finder* F = xmalloc(sizeof(finder));
+  pthread_mutex_init(&F->lock, NULL);
+  pthread_cond_init(&F->wake, NULL);
+  pthread_cond_init(&F->idle, NULL);
+  pthread_cond_init(&F->turn, NULL);
+  F->waiting = 0;
+  F->handovers = 0;
+  F->generation = 0;
+  F->finished = 0;
+  F->quit = false;
+  F->S = NULL;
+  F->querylimit = 64;
+  F->query = xmalloc(F->querylimit * sizeof(char));
+  F->querylen = 0;
+  F->narrow = 0;
+  F->matchlimit = FINDER_BATCH;
+  F->matches = xmalloc(F->matchlimit * sizeof(size_t));
+  F->nummatches = 0;
+  F->candidatelimit = FINDER_BATCH;
+  F->candidates = xmalloc(F->candidatelimit * sizeof(size_t));
+  F->numcandidates = 0;
+  F->total = 0;
+  F->done = false;
+  ENSURES(is_finder(F));
+
+  if (pthread_create(&F->thread, NULL, finder_run, F) != 0) {
+    fprintf(stderr, "cannot start search thread\n");
+    abort();
+  }
+  return F;
+}
+
+void finder_start(finder* F, storage* S, const char* query, size_t n) {
+  REQUIRES(is_storage(S));
+  REQUIRES(query != NULL && n > 0);
+  finder_lock(F);
+  REQUIRES(is_finder(F));
+
+  // every match of a longer query is a match of its prefix, so if all
+  // of those were kept they are the only candidates
+  size_t oldlen = F->querylen;
+  bool narrow = F->S == S && F->done && F->total == F->nummatches
+    && oldlen > 0 && n > oldlen && memcmp(F->query, query, oldlen) == 0;
+  if (narrow) {
+    size_t* swap = F->candidates;
+    F->candidates = F->matches;
+    F->numcandidates = F->nummatches;
+    F->matches = swap;
+    size_t limit = F->candidatelimit;
+    F->candidatelimit = F->matchlimit;
+    F->matchlimit = limit;
+    finder_reserve(F, F->numcandidates);
+  }
+
+  if (n > F->querylimit) {
+    while (n > F->querylimit) F->querylimit *= 2;
+    F->query = xrealloc(F->query, F->querylimit * sizeof(char));
+  }
+  memcpy(F->query, query, n);
+  F->querylen = n;
+  F->narrow = narrow ? oldlen : 0;
+  F->S = S;
+  F->nummatches = 0;
+  F->total = 0;
+  F->done = false;
+  F->generation += 1;
+  pthread_cond_signal(&F->wake);
+
+  ENSURES(is_finder(F));
+  finder_unlock(F);
+}
+
+void finder_stop(finder* F) {
+  finder_lock(F);
+  REQUIRES(is_finder(F));
+
+  F->S = NULL;
+  F->querylen = 0;
+  F->narrow = 0;
+  F->nummatches = 0;
+  F->total = 0;
+  F->done = false;
+  F->generation += 1;
+  pthread_cond_signal(&F->wake);
+  while (F->finished != F->generation) pthread_cond_wait(&F->idle, &F->lock);
+
+  ENSURES(is_finder(F));
+  finder_unlock(F);
+}
+
+bool finder_next(finder* F, size_t from, size_t* match) {
+  REQUIRES(is_finder(F));
+  REQUIRES(F->S != NULL);
+  REQUIRES(match != NULL);
+
+  // first kept match at or after from
+  size_t lo = 0;
+  size_t hi = F->nummatches;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (F->matches[mid] < from) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < F->nummatches) {
+    *match = F->matches[lo];
+    return true;
+  }
+
+  // past the kept ones matches are dense, the next one is close
+  if (F->nummatches == FINDER_MATCHES) {
+    size_t after = F->matches[F->nummatches - 1] + 1;
+    return search_forward(F->S, F->query, F->querylen, from > after ? from : after, match);
+  }
+  return false;
+}
+
+size_t finder_index(finder* F, size_t offset) {
+  REQUIRES(is_finder(F));
+  size_t lo = 0;
+  size_t hi = F->nummatches;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (F->matches[mid] < offset) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo < F->nummatches && F->matches[lo] == offset) return lo + 1;
+  return 0;
+}
+
+void finder_free(finder* F) {
+  finder_lock(F);
+  REQUIRES(is_finder(F));
+  F->quit = true;
+  F->generation += 1;
+  pthread_cond_signal(&F->wake);
+  finder_unlock(F);
+  pthread_join(F->thread, NULL);
+
+  pthread_mutex_destroy(&F->lock);
+  pthread_cond_destroy(&F->wake);
+  pthread_cond_destroy(&F->idle);
+  pthread_cond_destroy(&F->turn);
+  free(F->query);
+  free(F->matches);
+  free(F->candidates);
+  free(F);
+}
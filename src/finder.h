@@ -0,0 +1,71 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "storage.h"
+
+#ifndef FINDER_H
+#define FINDER_H
+
+#define FINDER_CHUNK (1 << 20)     // bytes scanned at a time, between checks
+                                   // for a new query or a waiting main thread
+#define FINDER_BATCH (4096)        // matches collected by one search_range
+#define FINDER_MATCHES (1 << 22)   // most match offsets kept
+
+/* Searching in the background. A worker thread counts and collects
+ * the matches of the query in a storage, a chunk at a time, while the
+ * main thread keeps reading input and drawing.
+ *
+ * The text must not change while it is searched, but the main thread
+ * may move the cursor, which can move the text around in memory (the
+ * gap of a gap buffer), as long as it holds the lock. The worker only
+ * reads the storage while it holds the lock, and hands the lock over
+ * between chunks whenever the main thread waits for it.
+ */
+struct finder_header {
+  pthread_t thread;          // worker
+  pthread_mutex_t lock;      // guards the fields below and the storage
+  pthread_cond_t wake;       // the worker waits here for a new generation
+  pthread_cond_t idle;       // finder_stop waits here for the worker
+  pthread_cond_t turn;       // the worker waits here for a waiting thread
+                             // to get the lock
+  int waiting;               // threads waiting in finder_lock, atomic
+  unsigned long handovers;   // times finder_lock got the lock
+  unsigned long generation;  // bumped by each finder_start and finder_stop
+  unsigned long finished;    // last generation the worker finished or abandoned
+  bool quit;                 // the worker exits
+  storage* S;                // storage searched, NULL if none
+  char* query;               // current query
+  size_t querylen;           // length of query
+  size_t querylimit;         // bytes allocated for query, querylen <= querylimit
+  size_t narrow;             // length of the previous query if the current one
+                             // extends it and its matches can be narrowed, else 0
+  size_t* matches;           // offsets of the first matches found, increasing
+  size_t nummatches;         // number of offsets in matches, <= FINDER_MATCHES
+  size_t matchlimit;         // \length(matches) = matchlimit
+  size_t* candidates;        // matches of the previous query, when narrowing
+  size_t numcandidates;      // number of offsets in candidates
+  size_t candidatelimit;     // \length(candidates) = candidatelimit
+  size_t total;              // matches counted so far, total >= nummatches
+  bool done;                 // every match of query has been counted
+};
+typedef struct finder_header finder;
+
+bool is_finder(finder* F);                       // representation invariant,
+                                                 // lock held
+
+finder* finder_new(void);                        // create finder, start its worker
+void finder_lock(finder* F);                     // lock storage and results
+void finder_unlock(finder* F);                   // unlock them
+void finder_start(finder* F, storage* S, const char* query, size_t n);
+                                                 // cancel the scan and search S for
+                                                 // query[0, n) instead, n > 0
+void finder_stop(finder* F);                     // cancel the scan and wait for the
+                                                 // worker, S may change afterwards
+bool finder_next(finder* F, size_t from, size_t* match);
+                                                 // first match found at or after
+                                                 // from, lock held
+size_t finder_index(finder* F, size_t offset);   // k if the match at offset is the
+                                                 // k-th, 0 if none, lock held
+void finder_free(finder* F);                     // stop the worker and free finder
+
+#endif
@@ -0,0 +1,57 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "frame.h"
+
+int main(void) {
+  printf("Testing frame library...\n");
+
+  frame* F = frame_new(4);
+  assert(is_frame(F));
+  assert(F->len == 0);
+
+  frame_appends(F, "\x1b[H");
+  frame_appendc(F, 'a');
+  frame_fill(F, ' ', 3);
+  frame_append(F, "bcdef", 2);
+  frame_printf(F, "\x1b[%zu;%zuH", (size_t)12, (size_t)345);
+  assert(is_frame(F));
+  const char* expect = "\x1b[Ha   bc\x1b[12;345H";
+  assert(F->len == strlen(expect));
+  assert(strncmp(F->buf, expect, F->len) == 0);
+
+  // the whole frame goes out and the allocation is kept
+  int fds[2];
+  assert(pipe(fds) == 0);
+  size_t limit = F->limit;
+  assert(frame_flush(F, fds[1]));
+  assert(F->len == 0);
+  assert(F->limit == limit);
+  char buf[64];
+  assert(read(fds[0], buf, sizeof(buf)) == (ssize_t)strlen(expect));
+  assert(strncmp(buf, expect, strlen(expect)) == 0);
+
+  // a second frame of the same size does not grow
+  frame_appends(F, "\x1b[Ha   bc");
+  frame_printf(F, "\x1b[%zu;%zuH", (size_t)12, (size_t)345);
+  assert(F->limit == limit);
+  assert(frame_flush(F, fds[1]));
+  close(fds[1]);
+  close(fds[0]);
+
+  // large formatted output
+  char big[1000];
+  memset(big, 'x', sizeof(big) - 1);
+  big[sizeof(big) - 1] = '\0';
+  frame_printf(F, "[%s]", big);
+  assert(is_frame(F));
+  assert(F->len == sizeof(big) + 1);
+  assert(F->buf[0] == '[' && F->buf[F->len - 1] == ']');
+
+  frame_free(F);
+  printf("All test cases passed!\n");
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "frame.h"
+
+bool is_frame(frame* F) {
+  if (F == NULL) return false;
+  if (F->buf == NULL) return false;
+  if (F->limit <= 0) return false;
+  if (F->len > F->limit) return false;
+  // \length(F->buf) = F->limit
+  return true;
+}
+
+frame* frame_new(size_t init_limit) {
+  REQUIRES(init_limit > 0);
+  frame* F = xmalloc(sizeof(frame));
+  F->buf = xmalloc(init_limit * sizeof(char));
+  F->len = 0;
+  F->limit = init_limit;
+
+  ENSURES(is_frame(F));
+  return F;
+}
+
+// make room for at least n more chars
+static void frame_grow(frame* F, size_t n) {
+  REQUIRES(is_frame(F));
+  if (F->limit - F->len >= n) return;
+
+  size_t new_limit = 2 * F->limit;
+  if (new_limit - F->len < n) new_limit = F->len + n;
+  F->buf = xrealloc(F->buf, new_limit * sizeof(char));
+  F->limit = new_limit;
+
+  ENSURES(is_frame(F));
+  ENSURES(F->limit - F->len >= n);
+}
+
+void frame_append(frame* F, const char* s, size_t n) {
+  REQUIRES(is_frame(F));
+  REQUIRES(s != NULL || n == 0);
+
+  frame_grow(F, n);
+  memcpy(F->buf + F->len, s, n);
+  F->len += n;
+
+  ENSURES(is_frame(F));
+}
+
+void frame_appendc(frame* F, char c) {
+  REQUIRES(is_frame(F));
+
+  if (F->len == F->limit) frame_grow(F, 1);
+  F->buf[F->len] = c;
+  F->len += 1;
+
+  ENSURES(is_frame(F));
+}
+
+void frame_appends(frame* F, const char* s) {
+  REQUIRES(is_frame(F));
+  REQUIRES(s != NULL);
+  frame_append(F, s, strlen(s));
+}
+
+void frame_fill(frame* F, char c, size_t n) {
+  REQUIRES(is_frame(F));
+
+  frame_grow(F, n);
+  memset(F->buf + F->len, c, n);
+  F->len += n;
+
+  ENSURES(is_frame(F));
+}
+
+void frame_printf(frame* F, const char* fmt, ...) {
+  REQUIRES(is_frame(F));
+  REQUIRES(fmt != NULL);
+
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(F->buf + F->len, F->limit - F->len, fmt, ap);
+  va_end(ap);
+  ASSERT(n >= 0);
+
+  // did not fit, grow and format again
+  if ((size_t)n >= F->limit - F->len) {
+    frame_grow(F, n + 1);
+    va_start(ap, fmt);
+    vsnprintf(F->buf + F->len, F->limit - F->len, fmt, ap);
+    va_end(ap);
+  }
+  F->len += n;
+
+  ENSURES(is_frame(F));
+}
+
+void frame_truncate(frame* F, size_t len) {
+  REQUIRES(is_frame(F));
+  REQUIRES(len <= F->len);
+  F->len = len;
+  ENSURES(is_frame(F));
+}
+
+bool frame_flush(frame* F, int fd) {
+  REQUIRES(is_frame(F));
+
+  size_t done = 0;
+  bool ok = true;
+  while (done < F->len) {
+    ssize_t n = write(fd, F->buf + done, F->len - done);
+    if (n == -1 && errno == EINTR) continue;
+    if (n <= 0) {
+      ok = false;
+      break;
+    }
+    done += n;
+  }
+  F->len = 0;
+
+  ENSURES(is_frame(F));
+  ENSURES(F->len == 0);
+  return ok;
+}
+
+void frame_free(frame* F) {
+  REQUIRES(is_frame(F));
+  free(F->buf);
+  free(F);
+}
@@ -0,0 +1,32 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef FRAME_H
+#define FRAME_H
+
+/* Output arena for one screen frame. Rendering appends escape
+ * sequences and text to it, and the frame goes to the terminal in
+ * a single write. The allocation is kept between frames, so once it
+ * has grown to the size of a full redraw appending never allocates.
+ */
+struct frame_header {
+  char* buf;          // bytes of the frame so far
+  size_t len;         // number of bytes in buf
+  size_t limit;       // bytes allocated for buf, len <= limit, limit > 0
+};
+typedef struct frame_header frame;
+
+bool is_frame(frame* F);                              // representation invariant
+
+frame* frame_new(size_t init_limit);                  // create new empty frame
+void frame_append(frame* F, const char* s, size_t n); // append n chars of s
+void frame_appendc(frame* F, char c);                 // append one char
+void frame_appends(frame* F, const char* s);          // append string s
+void frame_fill(frame* F, char c, size_t n);          // append n copies of c
+void frame_printf(frame* F, const char* fmt, ...);    // append formatted string
+void frame_truncate(frame* F, size_t len);            // keep only the first len chars
+bool frame_flush(frame* F, int fd);                   // write frame to fd and empty it,
+                                                      // false on error
+void frame_free(frame* F);                            // free frame
+
+#endif
@@ -1,6 +1,8 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include "lib/contracts.h"
 #include "lib/xalloc.h"
 #include "gapbuf.h"
@@ -132,6 +134,153 @@ int main(void) {
 
   gapbuf_free(C);
 
+  // growing with text on both sides of the gap
+  gapbuf* D = gapbuf_new(2);
+  gapbuf_insert(D, 'p');
+  gapbuf_insert(D, 'e');
+  gapbuf_backward(D);
+  gapbuf_insert(D, 'i'); // pi[]e
+  gapbuf_backward(D);
+  gapbuf_backward(D);
+  gapbuf_insert(D, 'a');
+  gapbuf_insert(D, 'p');
+  gapbuf_insert(D, 'p');
+  gapbuf_insert(D, 'l');
+  gapbuf_insert(D, 'e'); // apple[]pie
+  assert(is_gapbuf(D));
+  assert(D->frontlen == 5);
+  assert(D->backlen == 3);
+  assert(gapbuf_col(D) == 5);
+  char* s6 = gapbuf_str(D);
+  assert(strcmp(s6, "applepie") == 0);
+  free(s6);
+  assert(gapbuf_delete_right(D) == 'p');
+  assert(gapbuf_delete(D) == 'e'); // appl[]ie
+  char* s7 = gapbuf_str(D);
+  assert(strcmp(s7, "applie") == 0);
+  free(s7);
+  gapbuf_move_to(D, 0); // []applie
+  assert(is_gapbuf(D));
+  assert(gapbuf_at_left(D));
+  gapbuf_move_to(D, 6); // applie[]
+  assert(gapbuf_at_right(D));
+  gapbuf_move_to(D, 2); // ap[]plie
+  assert(D->frontlen == 2);
+  assert(gapbuf_col(D) == 2);
+  char* s8 = gapbuf_str(D);
+  assert(strcmp(s8, "applie") == 0);
+  free(s8);
+
+  gapbuf_insert_n(D, "ple\npie", 7); // apple\npie[]plie
+  assert(is_gapbuf(D));
+  assert(gapbuf_row(D) == 2);
+  assert(gapbuf_col(D) == 3);
+  gapbuf_delete_range(D, 9, 13); // apple\npie[]
+  assert(is_gapbuf(D));
+  assert(gapbuf_at_right(D));
+  gapbuf_delete_range(D, 0, 6); // []pie
+  assert(gapbuf_at_left(D));
+  char* s9 = gapbuf_str(D);
+  assert(strcmp(s9, "pie") == 0);
+  free(s9);
+  gapbuf_free(D);
+
+  // line index
+  printf("Testing line index...\n");
+  gapbuf* E = gapbuf_new(4);
+  gapbuf_insert_n(E, "ab\n\ncd\nef", 9); // ab\n\ncd\nef[]
+  assert(gapbuf_numrows(E) == 4);
+  assert(gapbuf_row(E) == 4);
+  assert(gapbuf_col(E) == 2);
+  gapbuf_move_to(E, 3); // ab\n[]\ncd\nef
+  assert(is_gapbuf(E));
+  assert(gapbuf_row(E) == 2);
+  assert(gapbuf_col(E) == 0);
+  assert(gapbuf_line_start(E, 1) == 0);
+  assert(gapbuf_line_start(E, 2) == 3);
+  assert(gapbuf_line_start(E, 3) == 4);
+  assert(gapbuf_line_start(E, 4) == 7);
+  assert(gapbuf_row_at(E, 0) == 1);
+  assert(gapbuf_row_at(E, 2) == 1);
+  assert(gapbuf_row_at(E, 3) == 2);
+  assert(gapbuf_row_at(E, 4) == 3);
+  assert(gapbuf_row_at(E, 6) == 3);
+  assert(gapbuf_row_at(E, 9) == 4);
+  gapbuf_delete_right(E); // ab\n[]cd\nef
+  assert(gapbuf_numrows(E) == 3);
+  assert(gapbuf_line_start(E, 3) == 6);
+
+  // random operations keep the index consistent (checked with -DDEBUG)
+  srand(15122);
+  for (int i = 0; i < 2000; i++) {
+    size_t len = E->frontlen + E->backlen;
+    switch (rand() % 6) {
+      case 0: gapbuf_insert(E, rand() % 3 == 0 ? '\n' : 'x'); break;
+      case 1: gapbuf_insert_n(E, "\nab\n", 4); break;
+      case 2: if (!gapbuf_at_left(E)) gapbuf_delete(E); break;
+      case 3: if (!gapbuf_at_right(E)) gapbuf_delete_right(E); break;
+      case 4: gapbuf_move_to(E, rand() % (len + 1)); break;
+      case 5: {
+        size_t a = rand() % (len + 1);
+        size_t b = a + rand() % (len - a + 1) / 4;
+        gapbuf_delete_range(E, a, b);
+        break;
+      }
+    }
+    assert(is_gapbuf(E));
+    size_t newlines = 0;
+    for (size_t j = 0; j < E->frontlen; j++) {
+      if (E->front[j] == '\n') newlines += 1;
+    }
+    assert(gapbuf_row(E) == newlines + 1);
+    assert(gapbuf_row_at(E, E->frontlen) == gapbuf_row(E));
+  }
+  gapbuf_free(E);
+
+  printf("Testing file loading...\n");
+  gapbuf* F = gapbuf_new(16);
+  int fd = open("test/hi.txt", O_RDONLY);
+  assert(fd != -1);
+  assert(gapbuf_load(F, fd));
+  close(fd);
+  assert(is_gapbuf(F));
+  assert(F->frontlen == 0);
+  assert(gapbuf_numrows(F) == 3);
+  assert(gapbuf_line_start(F, 2) == 8);
+  assert(gapbuf_row_at(F, 8) == 2);
+  char* s10 = gapbuf_str(F);
+  assert(strcmp(s10, "hello ?\nedit some file\nadd a new line") == 0);
+  free(s10);
+  gapbuf_move_to(F, 8);
+  gapbuf_insert_n(F, "and\n", 4);
+  assert(is_gapbuf(F));
+  assert(gapbuf_numrows(F) == 4);
+  gapbuf_free(F);
+
+  // a reserved gap takes the insertion without growing
+  gapbuf* R = gapbuf_new(1);
+  gapbuf_reserve(R, 100);
+  size_t limit = R->limit;
+  char* front = R->front;
+  for (int i = 0; i < 10; i++) gapbuf_insert_n(R, "0123456789", 10);
+  assert(R->limit == limit && R->front == front);
+  assert(is_gapbuf(R));
+  gapbuf_free(R);
+
+  // a pipe has no size, so everything is appended after the first read
+  int fds[2];
+  assert(pipe(fds) == 0);
+  assert(write(fds[1], "a\nb\nc", 5) == 5);
+  close(fds[1]);
+  gapbuf* G = gapbuf_new(16);
+  assert(gapbuf_load(G, fds[0]));
+  close(fds[0]);
+  assert(is_gapbuf(G));
+  assert(G->frontlen == 0);
+  assert(G->backlen == 5);
+  assert(gapbuf_numrows(G) == 3);
+  gapbuf_free(G);
+
   printf("All test cases passed!\n");
 
   return 0;
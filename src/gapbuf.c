@@ -1,22 +1,63 @@
+#define _DEFAULT_SOURCE
+
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "lib/contracts.h"
 #include "lib/xalloc.h"
 #include "gapbuf.h"
 
+// length of the whole text
+static size_t gapbuf_len(gapbuf* gb) {
+  return gb->frontlen + gb->backlen;
+}
+
+// newlines after the gap, back[0] is the one closest to the cursor
+static size_t* gapbuf_lineback(gapbuf* gb) {
+  return gb->lines + gb->linelimit - gb->lineback;
+}
+
+// line index agrees with the text, O(n)
+static bool is_gapbuf_lines(gapbuf* gb) {
+  size_t len = gapbuf_len(gb);
+  size_t newlines = 0;
+  for (size_t i = 0; i < gb->frontlen; i++) {
+    if (gb->front[i] == '\n') newlines += 1;
+  }
+  for (size_t j = 0; j < gb->backlen; j++) {
+    if (gb->back[j] == '\n') newlines += 1;
+  }
+  if (newlines != gb->linefront + gb->lineback) return false;
+
+  for (size_t i = 0; i < gb->linefront; i++) {
+    if (gb->lines[i] >= gb->frontlen) return false;
+    if (gb->front[gb->lines[i]] != '\n') return false;
+  }
+  size_t* back = gapbuf_lineback(gb);
+  for (size_t j = 0; j < gb->lineback; j++) {
+    if (back[j] == 0 || back[j] > gb->backlen) return false;
+    if (gb->back[len - back[j] - gb->frontlen] != '\n') return false;
+  }
+  return true;
+}
+
 bool is_gapbuf(gapbuf* gb) {
   if (gb == NULL) return false;
   if (gb->front == NULL) return false;
   if (gb->back == NULL) return false;
   if (gb->limit <= 0) return false;
-  if (gb->frontlen >= gb->limit) return false;
-  if (gb->backlen >= gb->limit) return false;
-  if (gb->front[gb->frontlen] != '\0') return false;
-  if (gb->back[gb->backlen] != '\0') return false;
-  if (strlen(gb->front) != gb->frontlen) return false;
-  if (strlen(gb->back) != gb->backlen) return false;
-  // \length(gb->front) = \length(gb->back) = fb->limit
+  if (gb->frontlen > gb->limit) return false;
+  if (gb->backlen > gb->limit - gb->frontlen) return false;
+  if (gb->back != gb->front + gb->limit - gb->backlen) return false;
+  // \length(gb->front) = gb->limit
+  if (gb->lines == NULL) return false;
+  if (gb->linelimit <= 0) return false;
+  if (gb->linefront > gb->linelimit) return false;
+  if (gb->lineback > gb->linelimit - gb->linefront) return false;
+  // \length(gb->lines) = gb->linelimit
+  if (!is_gapbuf_lines(gb)) return false;
   return true;
 }
 
@@ -33,48 +74,83 @@ bool gapbuf_at_right(gapbuf *gb) {
 gapbuf* gapbuf_new(size_t init_limit) {
   REQUIRES(init_limit > 0);
   gapbuf* gb = xmalloc(sizeof(gapbuf));
-  gb->front = xcalloc(init_limit, sizeof(char));
-  gb->back = xcalloc(init_limit, sizeof(char));
+  gb->front = xmalloc(init_limit * sizeof(char));
   gb->frontlen = 0;
   gb->backlen = 0;
   gb->limit = init_limit;
+  gb->back = gb->front + gb->limit;
+
+  gb->lines = xmalloc(sizeof(size_t));
+  gb->linefront = 0;
+  gb->lineback = 0;
+  gb->linelimit = 1;
 
   ENSURES(is_gapbuf(gb));
   return gb;
 }
 
-void gapbuf_forward(gapbuf* gb) {
+// make room for at least n more characters in the gap
+static void gapbuf_grow(gapbuf* gb, size_t n) {
   REQUIRES(is_gapbuf(gb));
-  REQUIRES(!gapbuf_at_right(gb));
+  if (gb->limit - gb->frontlen - gb->backlen >= n) return;
 
-  if (gb->frontlen + 2 >= gb->limit) {
-    // if front buffer is full, reallocate and double size
-    size_t new_limit = 3 * gb->limit;
-    char* new_front = xcalloc(new_limit, sizeof(char));
-    char* new_back = xcalloc(new_limit, sizeof(char));
-    
-    size_t i;
-    for (i = 0; i < gb->frontlen; i++) {
-      new_front[i] = gb->front[i];
-    }
-    for (i = 0; i < gb->backlen; i++) {
-      new_back[i] = gb->back[i];
-    }
-    free(gb->front);
-    free(gb->back);
-    gb->limit = new_limit;
-    gb->front = new_front;
-    gb->back = new_back;
+  // double size, or more if n does not fit after doubling
+  size_t new_limit = 2 * gb->limit;
+  if (new_limit - gb->frontlen - gb->backlen < n) {
+    new_limit = gb->frontlen + gb->backlen + n;
   }
-  ASSERT(gb->frontlen + 2 < gb->limit);
+  gb->front = xrealloc(gb->front, new_limit * sizeof(char));
+  // back string stays at the end of the allocation
+  memmove(gb->front + new_limit - gb->backlen,
+          gb->front + gb->limit - gb->backlen, gb->backlen);
+  gb->limit = new_limit;
+  gb->back = gb->front + gb->limit - gb->backlen;
 
-  char c = gb->back[gb->backlen - 1];
-  ASSERT(c != '\0');
-  gb->front[gb->frontlen] = c;
-  gb->front[gb->frontlen + 1] = '\0';
-  gb->back[gb->backlen - 1]  = '\0';
+  ENSURES(is_gapbuf(gb));
+  ENSURES(gb->limit - gb->frontlen - gb->backlen >= n);
+}
+
+// record a newline at offset, just before the gap
+static void gapbuf_push_line(gapbuf* gb, size_t offset) {
+  if (gb->linefront + gb->lineback == gb->linelimit) {
+    // double size, back entries stay at the end of the allocation
+    size_t new_limit = 2 * gb->linelimit;
+    gb->lines = xrealloc(gb->lines, new_limit * sizeof(size_t));
+    memmove(gb->lines + new_limit - gb->lineback,
+            gb->lines + gb->linelimit - gb->lineback,
+            gb->lineback * sizeof(size_t));
+    gb->linelimit = new_limit;
+  }
+  gb->lines[gb->linefront] = offset;
+  gb->linefront += 1;
+}
+
+// move the gap of the line index so that it agrees with frontlen
+static void gapbuf_move_lines(gapbuf* gb) {
+  size_t len = gapbuf_len(gb);
+  while (gb->linefront > 0 && gb->lines[gb->linefront - 1] >= gb->frontlen) {
+    size_t offset = gb->lines[gb->linefront - 1];
+    gb->linefront -= 1;
+    gb->lineback += 1;
+    gapbuf_lineback(gb)[0] = len - offset;
+  }
+  while (gb->lineback > 0 && len - gapbuf_lineback(gb)[0] < gb->frontlen) {
+    size_t offset = len - gapbuf_lineback(gb)[0];
+    gb->lineback -= 1;
+    gb->lines[gb->linefront] = offset;
+    gb->linefront += 1;
+  }
+}
+
+void gapbuf_forward(gapbuf* gb) {
+  REQUIRES(is_gapbuf(gb));
+  REQUIRES(!gapbuf_at_right(gb));
+
+  gb->front[gb->frontlen] = gb->back[0];
   gb->frontlen += 1;
   gb->backlen -= 1;
+  gb->back += 1;
+  if (gb->front[gb->frontlen - 1] == '\n') gapbuf_move_lines(gb);
 
   ENSURES(is_gapbuf(gb));
 }
@@ -83,75 +159,142 @@ void gapbuf_backward(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
   REQUIRES(!gapbuf_at_left(gb));
 
-  if (gb->backlen + 2 >= gb->limit) {
-    // if backbuffer is full, reallocate and double size
-    size_t new_limit = 3 * gb->limit;
-    char* new_front = xcalloc(new_limit, sizeof(char));
-    char* new_back = xcalloc(new_limit, sizeof(char));
-    
-    size_t i;
-    for (i = 0; i < gb->frontlen; i++) {
-      new_front[i] = gb->front[i];
-    }
-    for (i = 0; i < gb->backlen; i++) {
-      new_back[i] = gb->back[i];
-    }
-    free(gb->front);
-    free(gb->back);
-    gb->limit = new_limit;
-    gb->front = new_front;
-    gb->back = new_back;
-  }
-  ASSERT(gb->backlen + 2 < gb->limit);
-
-  char c = gb->front[gb->frontlen - 1];
-  ASSERT(c != '\0');
-  gb->back[gb->backlen] = c;
-  gb->back[gb->backlen + 1] = '\0';
-  gb->front[gb->frontlen - 1] = '\0';
+  gb->back -= 1;
+  gb->back[0] = gb->front[gb->frontlen - 1];
   gb->frontlen -= 1;
   gb->backlen += 1;
+  if (gb->back[0] == '\n') gapbuf_move_lines(gb);
 
   ENSURES(is_gapbuf(gb));
 }
 
-void gapbuf_insert(gapbuf* gb, char c) {
+void gapbuf_move_to(gapbuf* gb, size_t offset) {
   REQUIRES(is_gapbuf(gb));
+  REQUIRES(offset <= gb->frontlen + gb->backlen);
 
-  if (gb->frontlen + 2 >= gb->limit) {
-    // if front buffer is full, reallocate and double size
-    size_t new_limit = 3 * gb->limit;
-    char* new_front = xcalloc(new_limit, sizeof(char));
-    char* new_back = xcalloc(new_limit, sizeof(char));
-    
-    size_t i;
-    for (i = 0; i < gb->frontlen; i++) {
-      new_front[i] = gb->front[i];
-    }
-    for (i = 0; i < gb->backlen; i++) {
-      new_back[i] = gb->back[i];
-    }
-    free(gb->front);
-    free(gb->back);
-    gb->limit = new_limit;
-    gb->front = new_front;
-    gb->back = new_back;
+  // front and back may overlap if the gap is smaller than
+  // the distance moved, hence memmove instead of memcpy
+  if (offset < gb->frontlen) {
+    size_t n = gb->frontlen - offset;
+    gb->back -= n;
+    memmove(gb->back, gb->front + offset, n);
+    gb->frontlen -= n;
+    gb->backlen += n;
+  }
+  else if (offset > gb->frontlen) {
+    size_t n = offset - gb->frontlen;
+    memmove(gb->front + gb->frontlen, gb->back, n);
+    gb->back += n;
+    gb->frontlen += n;
+    gb->backlen -= n;
   }
-  ASSERT(gb->frontlen + 2 < gb->limit);
+  gapbuf_move_lines(gb);
+
+  ENSURES(is_gapbuf(gb));
+  ENSURES(gb->frontlen == offset);
+}
+
+void gapbuf_insert(gapbuf* gb, char c) {
+  REQUIRES(is_gapbuf(gb));
+
+  gapbuf_grow(gb, 1);
+  ASSERT(gb->frontlen + gb->backlen < gb->limit);
 
   gb->front[gb->frontlen] = c;
+  if (c == '\n') gapbuf_push_line(gb, gb->frontlen);
   gb->frontlen += 1;
 
   ENSURES(is_gapbuf(gb));
 }
 
+void gapbuf_insert_n(gapbuf* gb, const char* s, size_t n) {
+  REQUIRES(is_gapbuf(gb));
+  REQUIRES(s != NULL || n == 0);
+
+  gapbuf_grow(gb, n);
+  ASSERT(gb->frontlen + gb->backlen + n <= gb->limit);
+
+  memcpy(gb->front + gb->frontlen, s, n);
+  const char* p = s;
+  while ((p = memchr(p, '\n', s + n - p)) != NULL) {
+    gapbuf_push_line(gb, gb->frontlen + (p - s));
+    p += 1;
+  }
+  gb->frontlen += n;
+
+  ENSURES(is_gapbuf(gb));
+}
+
+void gapbuf_reserve(gapbuf* gb, size_t n) {
+  REQUIRES(is_gapbuf(gb));
+  gapbuf_grow(gb, n);
+  ENSURES(gb->limit - gb->frontlen - gb->backlen >= n);
+}
+
+bool gapbuf_load(gapbuf* gb, int fd) {
+  REQUIRES(is_gapbuf(gb));
+  REQUIRES(gapbuf_len(gb) == 0);
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) return false;
+  size_t size = S_ISREG(st.st_mode) ? (size_t)st.st_size : 0;
+
+  // allocate once, the text goes after the gap with the cursor at the start
+  size_t limit = size + size / 16 + gb->limit;
+  gb->front = xrealloc(gb->front, limit * sizeof(char));
+  gb->limit = limit;
+  char* text = gb->front + limit - size;
+
+  // read in blocks and index the newlines of each block while it is in
+  // cache, as offsets from the start of text for now
+  size_t len = 0;
+  ssize_t n = 0;
+  while (len < size) {
+    size_t want = size - len < GAPBUF_BLOCK ? size - len : GAPBUF_BLOCK;
+    n = read(fd, text + len, want);
+    if (n <= 0) break;
+    const char* p = text + len;
+    while ((p = memchr(p, '\n', text + len + n - p)) != NULL) {
+      gapbuf_push_line(gb, p - text);
+      p += 1;
+    }
+    len += n;
+  }
+
+  // the file may have shrunk since fstat
+  if (len < size) memmove(gb->front + limit - len, text, len);
+  gb->backlen = len;
+  gb->back = gb->front + limit - len;
+
+  // all newlines are after the gap, as distances from the end
+  size_t count = gb->linefront;
+  memmove(gb->lines + gb->linelimit - count, gb->lines, count * sizeof(size_t));
+  gb->linefront = 0;
+  gb->lineback = count;
+  size_t* back = gapbuf_lineback(gb);
+  for (size_t i = 0; i < count; i++) back[i] = len - back[i];
+  if (n < 0) return false;
+
+  // not a regular file, or it grew since fstat: append the rest
+  char buf[BUFSIZ];
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    gapbuf_move_to(gb, gapbuf_len(gb));
+    gapbuf_insert_n(gb, buf, n);
+  }
+  gapbuf_move_to(gb, 0);
+
+  ENSURES(is_gapbuf(gb));
+  ENSURES(gb->frontlen == 0);
+  return n == 0;
+}
+
 char gapbuf_delete(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
   REQUIRES(!gapbuf_at_left(gb));
 
   char c = gb->front[gb->frontlen - 1];
-  gb->front[gb->frontlen - 1] = '\0';
   gb->frontlen -= 1;
+  if (c == '\n') gb->linefront -= 1;
 
   ENSURES(is_gapbuf(gb));
   return c;
@@ -161,41 +304,47 @@ char gapbuf_delete_right(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
   REQUIRES(!gapbuf_at_right(gb));
 
-  gapbuf_forward(gb);
-  char c = gapbuf_delete(gb);
+  char c = gb->back[0];
+  gb->backlen -= 1;
+  gb->back += 1;
+  if (c == '\n') gb->lineback -= 1;
 
   ENSURES(is_gapbuf(gb));
   return c;
 }
 
+void gapbuf_delete_range(gapbuf* gb, size_t start, size_t end) {
+  REQUIRES(is_gapbuf(gb));
+  REQUIRES(start <= end && end <= gb->frontlen + gb->backlen);
+
+  gapbuf_move_to(gb, start);
+  // deleted newlines are the first entries of the back line index
+  size_t len = gapbuf_len(gb);
+  while (gb->lineback > 0 && len - gapbuf_lineback(gb)[0] < end) {
+    gb->lineback -= 1;
+  }
+  gb->backlen -= end - start;
+  gb->back += end - start;
+
+  ENSURES(is_gapbuf(gb));
+  ENSURES(gb->frontlen == start);
+}
 
 size_t gapbuf_row(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
-  size_t i;
-  int row = 1;
-  for (i = 0; i < gb->frontlen; i++) {
-    if (gb->front[i] == '\n') row++;
-  }
-  return row;
+  return gb->linefront + 1;
 }
 
 size_t gapbuf_col(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
-  size_t i;
-  int col = 0;
-  for (i = 0; i < gb->frontlen; i++) {
-    if (gb->front[i] == '\n') col = 0;
-    else col++;
-  }
-  return col;
+  return gb->frontlen - gapbuf_line_start(gb, gapbuf_row(gb));
 }
 
 size_t gapbuf_rendercol(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
   int rendercol = 0;
-  for (size_t i = 0; i < gb->frontlen; i++) {
-    if (gb->front[i] == '\n') rendercol = 0;
-    else if (gb->front[i] == '\t') {
+  for (size_t i = gapbuf_line_start(gb, gapbuf_row(gb)); i < gb->frontlen; i++) {
+    if (gb->front[i] == '\t') {
       rendercol += (TAB_STOP - 1) - (rendercol % TAB_STOP);
       rendercol += 1;
     }
@@ -206,56 +355,71 @@ size_t gapbuf_rendercol(gapbuf* gb) {
 
 size_t gapbuf_numrows(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
-  size_t row = 1;
-  for (size_t i = 0; i < gb->frontlen; i++) {
-    if (gb->front[i] == '\n') row += 1;
+  return gb->linefront + gb->lineback + 1;
+}
+
+size_t gapbuf_row_at(gapbuf* gb, size_t offset) {
+  REQUIRES(is_gapbuf(gb));
+  REQUIRES(offset <= gb->frontlen + gb->backlen);
+
+  // binary search for the number of newlines before offset
+  size_t lo, hi;
+  if (offset <= gb->frontlen) {
+    // first entry of front with lines[i] >= offset
+    lo = 0;
+    hi = gb->linefront;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (gb->lines[mid] < offset) lo = mid + 1;
+      else hi = mid;
+    }
+    return lo + 1;
   }
-  for (size_t j = 0; j < gb->backlen; j++) {
-    if (gb->back[j] == '\n') row += 1;
+  // first entry of back with len - back[j] >= offset
+  size_t len = gapbuf_len(gb);
+  size_t* back = gapbuf_lineback(gb);
+  lo = 0;
+  hi = gb->lineback;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (len - back[mid] < offset) lo = mid + 1;
+    else hi = mid;
   }
-  return row;
+  return gb->linefront + lo + 1;
+}
+
+size_t gapbuf_line_start(gapbuf* gb, size_t row) {
+  REQUIRES(is_gapbuf(gb));
+  REQUIRES(row >= 1 && row <= gapbuf_numrows(gb));
+
+  // row starts right after newline number row - 1
+  if (row == 1) return 0;
+  size_t i = row - 2;
+  if (i < gb->linefront) return gb->lines[i] + 1;
+  return gapbuf_len(gb) - gapbuf_lineback(gb)[i - gb->linefront] + 1;
 }
 
 void gapbuf_free(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
   free(gb->front);
-  free(gb->back);
+  free(gb->lines);
   free(gb);
 }
-
 char* gapbuf_str(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
-  int len = gb->frontlen + gb->backlen;
-  char* s = xcalloc(len+1, sizeof(char));
-  size_t i;
-  for (i = 0; i < gb->frontlen; i++) {
-    s[i] = gb->front[i];
-  }
-  size_t j;
-  for (j = 0; j < gb->backlen; j++) {
-    s[len-1-j] = gb->back[j];
-  }
+  size_t len = gb->frontlen + gb->backlen;
+  char* s = xmalloc((len+1) * sizeof(char));
+  memcpy(s, gb->front, gb->frontlen);
+  memcpy(s + gb->frontlen, gb->back, gb->backlen);
+  s[len] = '\0';
   return s;
 }
 
 void gapbuf_print(gapbuf* gb) {
   REQUIRES(is_gapbuf(gb));
-  int len = gb->frontlen + gb->backlen;
-  char* s = xcalloc(len+3, sizeof(char));
-  size_t i;
-  for (i = 0; i < gb->frontlen; i++) {
-    s[i] = gb->front[i];
-  }
-  ASSERT(i == gb->frontlen);
-  s[i] = '[';
-  s[i+1] = ']';
-  size_t j;
-  for (j = 0; j < gb->backlen; j++) {
-    s[len+1-j] = gb->back[j];
-  }
   printf("-- gapbuf print -- \n");
-  printf("content: %s\n", s);
+  printf("content: %.*s[]%.*s\n", (int)gb->frontlen, gb->front,
+                                  (int)gb->backlen, gb->back);
   printf("limit: %zu\n", gb->limit);
   printf("------------------ \n");
-  free(s);
 }
@@ -5,15 +5,26 @@
 #define GAPBUF_H
 
 #define TAB_STOP 8
+#define GAPBUF_BLOCK (1 << 20)  // bytes read at a time by gapbuf_load
 
 struct gapbuf_header {
-  char* front;        // string before the gap
-  char* back;         // string after the gap, inverted
-  size_t frontlen;    // length of front string, frontlen < limit
-  size_t backlen;     // length of back string, backlen < limit
-  size_t limit;       // bytes allocated for front and back buffer
-  					          // (we require them to have the same length),
-  					          // limit > 0
+  char* front;        // single allocation, string before the gap at the start
+  char* back;         // string after the gap, in order, at the end of
+                      // the same allocation: back = front + limit - backlen
+  size_t frontlen;    // length of front string
+  size_t backlen;     // length of back string
+  size_t limit;       // bytes allocated for front, gap and back together,
+                      // frontlen + backlen <= limit, limit > 0
+
+  // line index, a gap buffer of newline positions with the same gap:
+  size_t* lines;      // lines[0, linefront) = offsets of newlines in front,
+                      // increasing; lines[linelimit - lineback, linelimit)
+                      // = newlines in back as distance from end of text,
+                      // decreasing
+  size_t linefront;   // number of newlines in front
+  size_t lineback;    // number of newlines in back
+  size_t linelimit;   // entries allocated for lines,
+                      // linefront + lineback <= linelimit, linelimit > 0
 };
 typedef struct gapbuf_header gapbuf;
 
@@ -25,17 +36,30 @@ bool gapbuf_at_right(gapbuf* gb);           // return true if cursor(gap) is at
 gapbuf* gapbuf_new(size_t init_limit);      // create new empty gap buffer
 void gapbuf_forward(gapbuf* gb);            // move the cursor forward (to the right)
 void gapbuf_backward(gapbuf* gb);           // move the cursor backward (to the left)
+void gapbuf_move_to(gapbuf* gb, size_t offset);
+                                            // move the cursor so that frontlen = offset
 void gapbuf_insert(gapbuf* gb, char c);     // insert a character before cursor
+void gapbuf_insert_n(gapbuf* gb, const char* s, size_t n);
+                                            // insert n characters of s before cursor
+void gapbuf_reserve(gapbuf* gb, size_t n);  // make the gap at least n characters wide
+bool gapbuf_load(gapbuf* gb, int fd);       // read file into empty gap buffer, cursor at
+                                            // start, false on error
 char gapbuf_delete(gapbuf* gb);             // delete a character before cursor and return deleted char
 char gapbuf_delete_right(gapbuf* gb);       // delete a character after the cursor and return deleted char
+void gapbuf_delete_range(gapbuf* gb, size_t start, size_t end);
+                                            // delete characters in [start, end), cursor moves to start
 
 // void strbuf_add(strbuf *sb, char *str, size_t len);
 // void strbuf_addstr(strbuf *sb, char *str);
 
-size_t gapbuf_row(gapbuf* gb);                 // row of cursor position
-size_t gapbuf_col(gapbuf* gb);                 // column of cursor position
-size_t gapbuf_rendercol(gapbuf* gb);
-size_t gapbuf_numrows(gapbuf* gb);             // number of rows in gap buffer
+size_t gapbuf_row(gapbuf* gb);                 // row of cursor position, O(1)
+size_t gapbuf_col(gapbuf* gb);                 // column of cursor position, O(1)
+size_t gapbuf_rendercol(gapbuf* gb);           // column considering tabs, O(col)
+size_t gapbuf_numrows(gapbuf* gb);             // number of rows in gap buffer, O(1)
+size_t gapbuf_row_at(gapbuf* gb, size_t offset);
+                                               // row of offset, O(log numrows)
+size_t gapbuf_line_start(gapbuf* gb, size_t row);
+                                               // offset of first char of row, O(1)
 
 void gapbuf_free(gapbuf* gb);              // free allocated gapbuffer, and return the string contained
 char* gapbuf_str(gapbuf* gb);               // the string contained in the text buffer
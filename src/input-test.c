@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "input.h"
+
+int main(void) {
+  printf("Testing input library...\n");
+
+  int fds[2];
+  assert(pipe(fds) == 0);
+  input* I = input_new(fds[0]);
+  assert(is_input(I));
+  assert(!input_pending(I));
+  assert(input_getc(I, 0) == INPUT_NONE);
+
+  // everything available is read at once
+  assert(write(fds[1], "ab\x1b[A", 5) == 5);
+  assert(input_pending(I));
+  assert(input_fill(I, 0) == 5);
+  assert(I->len == 5);
+  assert(input_getc(I, 0) == 'a');
+  assert(input_getc(I, 0) == 'b');
+  assert(input_getc(I, 0) == '\x1b');
+  assert(input_getc(I, 0) == '[');
+  assert(input_getc(I, 0) == 'A');
+  assert(!input_pending(I));
+
+  // bytes above 127 are not negative
+  assert(write(fds[1], "\xe9", 1) == 1);
+  assert(input_getc(I, -1) == 0xe9);
+
+  // wrap around the end of the ring buffer
+  char buf[INPUT_SIZE];
+  for (int round = 0; round < 5; round++) {
+    for (size_t i = 0; i < sizeof(buf); i++) buf[i] = (char)('a' + (i + round) % 26);
+    assert(write(fds[1], buf, INPUT_SIZE - 100) == INPUT_SIZE - 100);
+    for (size_t i = 0; i < INPUT_SIZE - 100; i++) {
+      assert(input_getc(I, 0) == buf[i]);
+      assert(is_input(I));
+    }
+  }
+  assert(!input_pending(I));
+
+  // a full buffer reads nothing more
+  for (size_t i = 0; i < sizeof(buf); i++) buf[i] = 'x';
+  assert(write(fds[1], buf, INPUT_SIZE) == INPUT_SIZE);
+  assert(write(fds[1], "y", 1) == 1);
+  while (I->len < INPUT_SIZE) assert(input_fill(I, 0) > 0);
+  assert(input_fill(I, 0) == 0);
+  for (size_t i = 0; i < INPUT_SIZE; i++) assert(input_getc(I, 0) == 'x');
+  assert(input_getc(I, 0) == 'y');
+
+  // key decoding
+  printf("Testing key decoder...\n");
+  const char* keys = "a\x1b[A\x1b[B\x1bOH\x1b[5~\x1b[3~\x1b[1;5C\x1b[4~\x1b[Fz";
+  assert(write(fds[1], keys, strlen(keys)) == (ssize_t)strlen(keys));
+  assert(input_key(I, 0) == 'a');
+  assert(input_key(I, 0) == ARROW_UP);
+  assert(input_key(I, 0) == ARROW_DOWN);
+  assert(input_key(I, 0) == HOME_KEY);
+  assert(input_key(I, 0) == PAGE_UP);
+  assert(input_key(I, 0) == DEL_KEY);
+  assert(input_key(I, 0) == ARROW_RIGHT);
+  assert(input_key(I, 0) == END_KEY);
+  assert(input_key(I, 0) == END_KEY);
+  assert(input_key(I, 0) == 'z');
+  assert(input_key(I, 0) == INPUT_NONE);
+
+  // a lone escape, or escape and another key, after the timeout
+  assert(write(fds[1], "\x1b", 1) == 1);
+  assert(input_key(I, 0) == '\x1b');
+  assert(write(fds[1], "\x1bx", 2) == 2);
+  assert(input_key(I, 0) == '\x1b');
+  assert(input_key(I, 0) == 'x');
+
+  // a sequence split across reads
+  assert(write(fds[1], "\x1b[", 2) == 2);
+  assert(input_fill(I, 0) == 2);
+  assert(write(fds[1], "6~", 2) == 2);
+  assert(input_key(I, 0) == PAGE_DOWN);
+
+  // a bracketed paste is one key and its text
+  printf("Testing bracketed paste...\n");
+  const char* paste = "\x1b[200~one\rtwo \x1b[A\x1b[201~x";
+  assert(write(fds[1], paste, strlen(paste)) == (ssize_t)strlen(paste));
+  assert(input_key(I, 0) == PASTE_KEY);
+  size_t n;
+  char* text = input_paste(I, &n);
+  assert(n == 11);
+  assert(strncmp(text, "one\rtwo \x1b[A", n) == 0);
+  free(text);
+  assert(input_key(I, 0) == 'x');
+
+  // the end marker split across reads, around the end of the ring
+  char big[INPUT_SIZE - 3];
+  memset(big, 'p', sizeof(big));
+  assert(write(fds[1], "\x1b[200~", 6) == 6);
+  assert(input_key(I, 0) == PASTE_KEY);
+  assert(write(fds[1], big, sizeof(big)) == (ssize_t)sizeof(big));
+  assert(write(fds[1], "\x1b[20", 4) == 4);
+  assert(input_fill(I, 0) > 0);
+  assert(write(fds[1], "1~", 2) == 2);
+  text = input_paste(I, &n);
+  assert(n == sizeof(big));
+  assert(text[0] == 'p' && text[n - 1] == 'p');
+  free(text);
+  assert(I->len == 0);
+
+  // timers arrive as keys, the earliest first
+  printf("Testing timers...\n");
+  input_timer(I, 60, 2001);
+  input_timer(I, 20, 2002);
+  input_timer(I, 50, 2001); // replaces the first one
+  assert(input_key(I, 0) == INPUT_NONE);
+  assert(input_key(I, -1) == 2002);
+  assert(input_key(I, -1) == 2001);
+  assert(I->numtimers == 0);
+  input_timer(I, 1000, 2003);
+  assert(write(fds[1], "q", 1) == 1);
+  assert(input_key(I, -1) == 'q');
+  assert(I->numtimers == 1);
+
+  // waiting for a key leaves it to be decoded
+  assert(!input_ready(I, 10));
+  assert(write(fds[1], "\x1b[A", 3) == 3);
+  assert(input_ready(I, -1));
+  assert(input_ready(I, 0));
+  assert(input_key(I, 0) == ARROW_UP);
+  input_timer(I, 10, 2003);
+  assert(input_ready(I, -1));
+  assert(I->numtimers == 1);
+  assert(input_key(I, 0) == 2003);
+
+  close(fds[1]);
+  close(fds[0]);
+  input_free(I);
+  printf("All test cases passed!\n");
+  return 0;
+}
@@ -0,0 +1,333 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/uio.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "input.h"
+
+bool is_input(input* I) {
+  if (I == NULL) return false;
+  if (I->fd < 0) return false;
+  if (I->start >= INPUT_SIZE) return false;
+  if (I->len > INPUT_SIZE) return false;
+  if (I->numtimers > INPUT_TIMERS) return false;
+  return true;
+}
+
+input* input_new(int fd) {
+  REQUIRES(fd >= 0);
+  input* I = xmalloc(sizeof(input));
+  I->fd = fd;
+  I->start = 0;
+  I->len = 0;
+  I->numtimers = 0;
+
+  ENSURES(is_input(I));
+  return I;
+}
+
+// wait up to timeout ms for fd to be readable
+static bool input_wait(input* I, int timeout) {
+  struct pollfd p = { .fd = I->fd, .events = POLLIN };
+  int n;
+  while ((n = poll(&p, 1, timeout)) == -1 && errno == EINTR) {}
+  return n > 0;
+}
+
+int input_fill(input* I, int timeout) {
+  REQUIRES(is_input(I));
+  if (I->len == INPUT_SIZE) return 0;
+  if (!input_wait(I, timeout)) return INPUT_NONE;
+
+  // free space of the ring, in at most two pieces
+  size_t end = (I->start + I->len) % INPUT_SIZE;
+  struct iovec iov[2];
+  int count = 1;
+  iov[0].iov_base = I->buf + end;
+  if (end >= I->start) {
+    iov[0].iov_len = INPUT_SIZE - end;
+    iov[1].iov_base = I->buf;
+    iov[1].iov_len = I->start;
+    if (I->start > 0) count = 2;
+  }
+  else {
+    iov[0].iov_len = I->start - end;
+  }
+
+  // fd was readable, so reading nothing means end of file
+  ssize_t n = readv(I->fd, iov, count);
+  if (n == -1) return errno == EAGAIN || errno == EINTR ? INPUT_NONE : INPUT_ERROR;
+  if (n == 0) return INPUT_ERROR;
+  I->len += n;
+
+  ENSURES(is_input(I));
+  return n;
+}
+
+bool input_pending(input* I) {
+  REQUIRES(is_input(I));
+  return I->len > 0 || input_wait(I, 0);
+}
+
+int input_getc(input* I, int timeout) {
+  REQUIRES(is_input(I));
+  if (I->len == 0) {
+    int n = input_fill(I, timeout);
+    if (n < 0) return n;
+    if (I->len == 0) return INPUT_NONE;
+  }
+  unsigned char c = I->buf[I->start];
+  I->start = (I->start + 1) % INPUT_SIZE;
+  I->len -= 1;
+
+  ENSURES(is_input(I));
+  return c;
+}
+
+/* decoder */
+
+// byte i of the unread input, i < len
+static int input_peek(input* I, size_t i) {
+  REQUIRES(i < I->len);
+  return (unsigned char)I->buf[(I->start + i) % INPUT_SIZE];
+}
+
+// consume n unread bytes
+static void input_drop(input* I, size_t n) {
+  REQUIRES(n <= I->len);
+  I->start = (I->start + n) % INPUT_SIZE;
+  I->len -= n;
+}
+
+// wait for at least n unread bytes, as the rest of an escape sequence
+static bool input_need(input* I, size_t n) {
+  while (I->len < n) {
+    if (input_fill(I, INPUT_ESC_TIMEOUT) <= 0) return false;
+  }
+  return true;
+}
+
+// key of the final byte of <esc>[...x or <esc>Ox
+static int input_final_key(int final, int param) {
+  switch (final) {
+    case 'A': return ARROW_UP;
+    case 'B': return ARROW_DOWN;
+    case 'C': return ARROW_RIGHT;
+    case 'D': return ARROW_LEFT;
+    case 'H': return HOME_KEY;
+    case 'F': return END_KEY;
+    case '~': {
+      switch (param) {
+        case 1: case 7: return HOME_KEY;
+        case 3: return DEL_KEY;
+        case 4: case 8: return END_KEY;
+        case 5: return PAGE_UP;
+        case 6: return PAGE_DOWN;
+        case 200: return PASTE_KEY;
+      }
+    }
+  }
+  return '\x1b';
+}
+
+// decode one key from the unread input, len > 0
+static int input_decode(input* I) {
+  REQUIRES(I->len > 0);
+
+  int c = input_peek(I, 0);
+  if (c != '\x1b') {
+    input_drop(I, 1);
+    return c;
+  }
+
+  // a lone <esc>, or <esc> followed by something that starts no
+  // sequence, is the escape key
+  if (!input_need(I, 2)) {
+    input_drop(I, 1);
+    return '\x1b';
+  }
+  int kind = input_peek(I, 1);
+
+  // <esc>O x
+  if (kind == 'O') {
+    if (!input_need(I, 3)) {
+      input_drop(I, 1);
+      return '\x1b';
+    }
+    int final = input_peek(I, 2);
+    input_drop(I, 3);
+    return input_final_key(final, 0);
+  }
+  if (kind != '[') {
+    input_drop(I, 1);
+    return '\x1b';
+  }
+
+  // <esc>[ parameter bytes, intermediate bytes, final byte; only the
+  // first number parameter matters for the keys we know
+  size_t i = 2;
+  int param = 0;
+  bool first = true;
+  while (true) {
+    if (i > 32 || !input_need(I, i + 1)) {
+      input_drop(I, 1);
+      return '\x1b';
+    }
+    int b = input_peek(I, i);
+    if (b >= 0x30 && b <= 0x3f) {
+      if (b == ';') first = false;
+      else if (first && b >= '0' && b <= '9' && param < 10000) param = 10 * param + (b - '0');
+    }
+    else if (!(b >= 0x20 && b <= 0x2f)) break;
+    i += 1;
+  }
+  int final = input_peek(I, i);
+  input_drop(I, i + 1);
+  return input_final_key(final, param);
+}
+
+char* input_paste(input* I, size_t* n) {
+  REQUIRES(is_input(I));
+  REQUIRES(n != NULL);
+
+  const char* end = "\x1b[201~";
+  size_t endlen = strlen(end);
+  size_t len = 0;
+  size_t limit = 64;
+  char* s = xmalloc(limit * sizeof(char));
+
+  while (true) {
+    if (I->len == 0 && input_fill(I, INPUT_PASTE_TIMEOUT) <= 0) break;
+
+    // copy the contiguous unread bytes up to the next <esc>
+    size_t run = I->len;
+    if (run > INPUT_SIZE - I->start) run = INPUT_SIZE - I->start;
+    const char* p = I->buf + I->start;
+    const char* esc = memchr(p, '\x1b', run);
+    if (esc != NULL) run = esc - p;
+    if (run == 0) {
+      // the end marker, maybe split across reads, or a plain <esc>
+      size_t k = 0;
+      while (k < endlen && (k < I->len || input_need(I, k + 1))
+             && input_peek(I, k) == end[k]) {
+        k += 1;
+      }
+      if (k == endlen) {
+        input_drop(I, endlen);
+        break;
+      }
+      run = 1;
+    }
+
+    if (limit - len < run) {
+      while (limit - len < run) limit *= 2;
+      s = xrealloc(s, limit * sizeof(char));
+    }
+    memcpy(s + len, p, run);
+    len += run;
+    input_drop(I, run);
+  }
+
+  *n = len;
+  ENSURES(is_input(I));
+  return s;
+}
+
+/* timers */
+
+// CLOCK_MONOTONIC in ms
+static long input_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+void input_timer(input* I, int delay, int key) {
+  REQUIRES(is_input(I));
+  REQUIRES(delay >= 0);
+
+  size_t i = 0;
+  while (i < I->numtimers && I->timers[i].key != key) i += 1;
+  if (i == I->numtimers) {
+    REQUIRES(I->numtimers < INPUT_TIMERS);
+    I->numtimers += 1;
+  }
+  I->timers[i].deadline = input_now() + delay;
+  I->timers[i].key = key;
+
+  ENSURES(is_input(I));
+}
+
+// remove and return the key of a timer that fired by now, INPUT_NONE if none
+static int input_fired(input* I, long now) {
+  for (size_t i = 0; i < I->numtimers; i++) {
+    if (I->timers[i].deadline <= now) {
+      int key = I->timers[i].key;
+      I->timers[i] = I->timers[I->numtimers - 1];
+      I->numtimers -= 1;
+      return key;
+    }
+  }
+  return INPUT_NONE;
+}
+
+bool input_ready(input* I, int timeout) {
+  REQUIRES(is_input(I));
+
+  long start = input_now();
+  while (true) {
+    if (I->len > 0) return true;
+    long now = input_now();
+    for (size_t i = 0; i < I->numtimers; i++) {
+      if (I->timers[i].deadline <= now) return true;
+    }
+    if (timeout >= 0 && now - start >= timeout) return false;
+
+    // sleep like input_key, an error is left for it to report
+    long wait = timeout >= 0 ? start + timeout - now : -1;
+    for (size_t i = 0; i < I->numtimers; i++) {
+      long left = I->timers[i].deadline - now;
+      if (wait < 0 || left < wait) wait = left;
+    }
+    if (input_fill(I, (int)wait) == INPUT_ERROR) return true;
+  }
+}
+
+int input_key(input* I, int timeout) {
+  REQUIRES(is_input(I));
+
+  long start = input_now();
+  while (true) {
+    if (I->len > 0) return input_decode(I);
+    long now = input_now();
+    int key = input_fired(I, now);
+    if (key != INPUT_NONE) return key;
+
+    // sleep until input arrives, the timeout ends or a timer fires
+    long wait = -1;
+    if (timeout >= 0) {
+      wait = start + timeout - now;
+      if (wait < 0) wait = 0;
+    }
+    for (size_t i = 0; i < I->numtimers; i++) {
+      long left = I->timers[i].deadline - now;
+      if (wait < 0 || left < wait) wait = left;
+    }
+    if (input_fill(I, (int)wait) == INPUT_ERROR) return INPUT_ERROR;
+    if (I->len == 0 && timeout >= 0 && input_now() - start >= timeout) {
+      return input_fired(I, input_now());
+    }
+  }
+}
+
+void input_free(input* I) {
+  REQUIRES(is_input(I));
+  free(I);
+}
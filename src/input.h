@@ -0,0 +1,72 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef INPUT_H
+#define INPUT_H
+
+#define INPUT_SIZE 4096     // bytes buffered from the terminal
+#define INPUT_TIMERS 8      // timers pending at the same time
+#define INPUT_ESC_TIMEOUT 100
+                            // ms to wait for the rest of an escape sequence
+#define INPUT_PASTE_TIMEOUT 1000
+                            // ms to wait for the rest of a paste
+#define INPUT_NONE (-1)     // no byte arrived within the timeout
+#define INPUT_ERROR (-2)    // reading the terminal failed
+
+enum key {
+  ENTER_KEY = 13,
+  BACKSPACE = 127,
+  ARROW_LEFT = 1000,
+  ARROW_RIGHT,
+  ARROW_UP,
+  ARROW_DOWN,
+  DEL_KEY,
+  HOME_KEY,
+  END_KEY,
+  PAGE_UP,
+  PAGE_DOWN,
+  PASTE_KEY,                // start of a bracketed paste, read it with input_paste
+};
+
+struct input_timer {
+  long deadline;            // CLOCK_MONOTONIC ms when the timer fires
+  int key;                  // key delivered when it fires
+};
+
+/* Bytes read from the terminal but not yet decoded, kept in a ring
+ * buffer. Reads take everything that is available at once, so keys
+ * that arrive together (a paste, a held key) are read together.
+ * Waiting for input also waits for timers, which arrive as keys.
+ */
+struct input_header {
+  int fd;                   // file descriptor to read from
+  char buf[INPUT_SIZE];     // ring buffer
+  size_t start;             // index of first unread byte, start < INPUT_SIZE
+  size_t len;               // number of unread bytes, len <= INPUT_SIZE
+  struct input_timer timers[INPUT_TIMERS];
+  size_t numtimers;         // timers[0, numtimers) are pending
+};
+typedef struct input_header input;
+
+bool is_input(input* I);                    // representation invariant
+
+input* input_new(int fd);                   // create empty input reading fd
+int input_fill(input* I, int timeout);      // read what is available, waiting up to
+                                            // timeout ms (-1 for ever) for something;
+                                            // number of bytes, INPUT_NONE or INPUT_ERROR
+bool input_pending(input* I);               // unread bytes buffered or ready on fd
+int input_getc(input* I, int timeout);      // next byte as unsigned char, waiting up to
+                                            // timeout ms, INPUT_NONE or INPUT_ERROR
+bool input_ready(input* I, int timeout);     // wait up to timeout ms until a byte is
+                                            // buffered or a timer is due, without
+                                            // decoding it, false if neither
+int input_key(input* I, int timeout);       // next key or fired timer, waiting up to
+                                            // timeout ms, INPUT_NONE or INPUT_ERROR
+char* input_paste(input* I, size_t* n);     // text of the paste after PASTE_KEY up to its
+                                            // end marker, *n chars, not terminated
+void input_timer(input* I, int delay, int key);
+                                            // deliver key after delay ms, replacing
+                                            // the pending timer for key
+void input_free(input* I);                  // free input
+
+#endif
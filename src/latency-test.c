@@ -0,0 +1,87 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "lib/contracts.h"
+#include "latency.h"
+
+int main(void) {
+  printf("Testing latency library...\n");
+  latency* T = latency_new();
+  assert(latency_percentile(T, LATENCY_KEY, 50) == 0);
+
+  // small times are exact
+  for (uint64_t ns = 1; ns <= 50; ns++) latency_record(T, LATENCY_INPUT, ns);
+  assert(is_latency(T));
+  assert(latency_percentile(T, LATENCY_INPUT, 50) == 25);
+  assert(latency_percentile(T, LATENCY_INPUT, 100) == 50);
+  assert(latency_percentile(T, LATENCY_INPUT, 0) == 1);
+
+  // larger ones are within 1/32, and never above the longest
+  uint64_t times[] = {100, 1000, 12345, 999999, 1000000, 123456789, 5000000000ull};
+  for (size_t i = 0; i < sizeof(times) / sizeof(times[0]); i++) {
+    latency* U = latency_new();
+    latency_record(U, LATENCY_TEXT, times[i]);
+    latency_record(U, LATENCY_TEXT, 2 * times[i]);
+    uint64_t p = latency_percentile(U, LATENCY_TEXT, 50);
+    assert(p >= times[i] && p - times[i] <= times[i] / 32);
+    assert(latency_percentile(U, LATENCY_TEXT, 99) == 2 * times[i]);
+    assert(U->stages[LATENCY_TEXT].max == 2 * times[i]);
+    latency_free(U);
+  }
+
+  // the tail shows in p99 but not in p50
+  for (int i = 0; i < 990; i++) latency_record(T, LATENCY_KEY, 50000);
+  for (int i = 0; i < 10; i++) latency_record(T, LATENCY_KEY, 20000000);
+  uint64_t p50 = latency_percentile(T, LATENCY_KEY, 50);
+  uint64_t p99 = latency_percentile(T, LATENCY_KEY, 99);
+  uint64_t p999 = latency_percentile(T, LATENCY_KEY, 99.9);
+  assert(p50 >= 50000 && p50 < 52000);
+  assert(p99 == p50);
+  assert(p999 == 20000000);
+  assert(latency_since(T, LATENCY_EDIT, latency_now()) > 0);
+  assert(T->stages[LATENCY_EDIT].count == 1);
+
+  char buf[16];
+  latency_format(850, buf, sizeof(buf));
+  assert(strcmp(buf, "850ns") == 0);
+  latency_format(12345, buf, sizeof(buf));
+  assert(strcmp(buf, "12.3us") == 0);
+  latency_format(2500000, buf, sizeof(buf));
+  assert(strcmp(buf, "2.5ms") == 0);
+  latency_format(2500000, buf, 3);
+  assert(strcmp(buf, "2.") == 0);
+
+  // a row per stage after the header
+  char path[] = "/tmp/latency-test-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd != -1);
+  close(fd);
+  assert(latency_dump(T, path));
+  FILE* f = fopen(path, "r");
+  char line[256];
+  int rows = 0;
+  bool key = false;
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (strncmp(line, "key ", 4) == 0) {
+      unsigned long long count;
+      double d50, d99, dmax;
+      assert(sscanf(line + 4, "%llu %lf %lf %lf", &count, &d50, &d99, &dmax) == 4);
+      assert(count == 1000 && dmax == 20000.0);
+      key = true;
+    }
+    rows += 1;
+  }
+  fclose(f);
+  unlink(path);
+  assert(rows == LATENCY_STAGES + 1 && key);
+  assert(!latency_dump(T, "/nonexistent/latency"));
+
+  latency_free(T);
+  printf("All test cases passed!\n");
+  return 0;
+}
@@ -0,0 +1,146 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "latency.h"
+
+static const char* const latency_names[LATENCY_STAGES] = {
+  [LATENCY_INPUT] = "input",
+  [LATENCY_EDIT] = "edit",
+  [LATENCY_SCROLL] = "scroll",
+  [LATENCY_FILEBAR] = "filebar",
+  [LATENCY_TEXT] = "text",
+  [LATENCY_STATUSBAR] = "statusbar",
+  [LATENCY_MESSAGEBAR] = "messagebar",
+  [LATENCY_WRITE] = "write",
+  [LATENCY_KEY] = "key",
+};
+
+bool is_latency(latency* T) {
+  if (T == NULL) return false;
+  for (int s = 0; s < LATENCY_STAGES; s++) {
+    struct latency_histogram* H = &T->stages[s];
+    uint64_t count = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) count += H->counts[i];
+    if (count != H->count) return false;
+    if (count == 0 && H->max != 0) return false;
+  }
+  return true;
+}
+
+latency* latency_new(void) {
+  latency* T = xcalloc(1, sizeof(latency));
+  ENSURES(is_latency(T));
+  return T;
+}
+
+uint64_t latency_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec + 1;
+}
+
+// position of the highest bit set in v > 0
+static int latency_msb(uint64_t v) {
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll(v);
+#else
+  int k = 0;
+  while (v >>= 1) k += 1;
+  return k;
+#endif
+}
+
+// bucket of ns: the value itself when small, else the power of two and
+// the LATENCY_SUB_BITS bits below the highest one
+static size_t latency_bucket(uint64_t ns) {
+  if (ns < 2 * LATENCY_SUB) return (size_t)ns;
+  int shift = latency_msb(ns) - LATENCY_SUB_BITS;
+  return (size_t)LATENCY_SUB * (shift + 1) + (size_t)(ns >> shift) - LATENCY_SUB;
+}
+
+// largest value in bucket i
+static uint64_t latency_highest(size_t i) {
+  if (i < 2 * LATENCY_SUB) return i;
+  int shift = (int)(i / LATENCY_SUB) - 1;
+  uint64_t top = i % LATENCY_SUB + LATENCY_SUB;
+  return ((top + 1) << shift) - 1;
+}
+
+void latency_record(latency* T, enum latency_stage stage, uint64_t ns) {
+  REQUIRES(T != NULL && stage < LATENCY_STAGES);
+  struct latency_histogram* H = &T->stages[stage];
+  H->counts[latency_bucket(ns)] += 1;
+  H->count += 1;
+  if (ns > H->max) H->max = ns;
+}
+
+uint64_t latency_since(latency* T, enum latency_stage stage, uint64_t start) {
+  uint64_t now = latency_now();
+  latency_record(T, stage, now > start ? now - start : 0);
+  return now;
+}
+
+uint64_t latency_percentile(latency* T, enum latency_stage stage, double p) {
+  REQUIRES(is_latency(T) && stage < LATENCY_STAGES);
+  REQUIRES(0 <= p && p <= 100);
+  struct latency_histogram* H = &T->stages[stage];
+  if (H->count == 0) return 0;
+
+  // the bucket of the k-th shortest time, k >= 1
+  uint64_t k = (uint64_t)(p / 100 * H->count + 0.5);
+  if (k == 0) k = 1;
+  if (k > H->count) k = H->count;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += H->counts[i];
+    if (seen >= k) {
+      uint64_t highest = latency_highest(i);
+      return highest < H->max ? highest : H->max;
+    }
+  }
+  return H->max;
+}
+
+const char* latency_name(enum latency_stage stage) {
+  REQUIRES(stage < LATENCY_STAGES);
+  return latency_names[stage];
+}
+
+size_t latency_format(uint64_t ns, char* buf, size_t n) {
+  REQUIRES(buf != NULL && n > 0);
+  int len;
+  if (ns < 1000) len = snprintf(buf, n, "%uns", (unsigned)ns);
+  else if (ns < 1000000) len = snprintf(buf, n, "%.1fus", ns / 1e3);
+  else if (ns < 1000000000) len = snprintf(buf, n, "%.1fms", ns / 1e6);
+  else len = snprintf(buf, n, "%.1fs", ns / 1e9);
+  return (size_t)len < n ? (size_t)len : n - 1;
+}
+
+bool latency_dump(latency* T, const char* path) {
+  REQUIRES(is_latency(T) && path != NULL);
+  FILE* f = fopen(path, "w");
+  if (f == NULL) return false;
+
+  // one row per stage, times in us
+  fprintf(f, "%-12s %10s %12s %12s %12s\n", "stage", "count", "p50_us", "p99_us", "max_us");
+  for (int s = 0; s < LATENCY_STAGES; s++) {
+    fprintf(f, "%-12s %10llu %12.3f %12.3f %12.3f\n", latency_names[s],
+            (unsigned long long)T->stages[s].count,
+            latency_percentile(T, s, 50) / 1e3,
+            latency_percentile(T, s, 99) / 1e3,
+            T->stages[s].max / 1e3);
+  }
+  bool ok = !ferror(f);
+  return fclose(f) == 0 && ok;
+}
+
+void latency_free(latency* T) {
+  REQUIRES(is_latency(T));
+  free(T);
+}
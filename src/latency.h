@@ -0,0 +1,68 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#define LATENCY_SUB_BITS (5)                  // buckets per power of two, as bits
+#define LATENCY_SUB (1 << LATENCY_SUB_BITS)   // buckets per power of two, each
+                                              // at most 1/32 of its values wide
+#define LATENCY_BUCKETS (LATENCY_SUB * (64 - LATENCY_SUB_BITS + 1))
+                                              // buckets for every uint64_t
+
+/* Stages of handling a key that are timed. A key is the time from
+ * starting to decode it until the frame after it has been written.
+ */
+enum latency_stage {
+  LATENCY_INPUT,          // decoding the key
+  LATENCY_EDIT,           // processing it, unless it opened a prompt
+  LATENCY_SCROLL,         // scroll
+  LATENCY_FILEBAR,        // renderFileBar
+  LATENCY_TEXT,           // renderText
+  LATENCY_STATUSBAR,      // renderStatusBar
+  LATENCY_MESSAGEBAR,     // renderMessageBar
+  LATENCY_WRITE,          // writing the frame
+  LATENCY_KEY,            // all of the above, for one key
+  LATENCY_STAGES,         // number of stages
+};
+
+/* Histograms of how long each stage took, in ns, bucketed like an HDR
+ * histogram: exact below 2 * LATENCY_SUB, then LATENCY_SUB buckets for
+ * every power of two, so a percentile is off by at most about 3%.
+ * Recording a time is one increment, so timing is always on.
+ */
+struct latency_histogram {
+  uint64_t counts[LATENCY_BUCKETS];  // times recorded in each bucket
+  uint64_t count;                    // times recorded
+  uint64_t max;                      // longest time recorded
+};
+
+struct latency_header {
+  struct latency_histogram stages[LATENCY_STAGES];
+  uint64_t keystart;                 // when the key being handled started,
+                                     // 0 if none
+};
+typedef struct latency_header latency;
+
+bool is_latency(latency* T);                     // representation invariant
+
+latency* latency_new(void);                      // create with nothing recorded
+uint64_t latency_now(void);                      // monotonic time in ns, > 0
+void latency_record(latency* T, enum latency_stage stage, uint64_t ns);
+                                                 // a stage took ns
+uint64_t latency_since(latency* T, enum latency_stage stage, uint64_t start);
+                                                 // a stage took from start until
+                                                 // now, returns now
+uint64_t latency_percentile(latency* T, enum latency_stage stage, double p);
+                                                 // time that p percent of the
+                                                 // stage took at most, 0 if none
+const char* latency_name(enum latency_stage stage);
+                                                 // name of stage
+size_t latency_format(uint64_t ns, char* buf, size_t n);
+                                                 // ns in a short unit into buf
+bool latency_dump(latency* T, const char* path); // count, p50, p99 and max of every
+                                                 // stage into the file, false on error
+void latency_free(latency* T);                   // free
+
+#endif
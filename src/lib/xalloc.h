@@ -31,5 +31,18 @@ static inline void* xmalloc(size_t size) {
   return p;
 }
 
+/* xrealloc(p, size) resizes the object pointed to by p
+ * to size bytes and exits if the allocation fails.
+ * Like realloc, new bytes are not initialized.
+ */
+static inline void* xrealloc(void* p, size_t size) {
+  void* q = realloc(p, size);
+  if (q == NULL) {
+    fprintf(stderr, "allocation failed\n");
+    abort();
+  }
+  return q;
+}
+
 
 #endif
@@ -7,14 +7,59 @@
 #include "lib/contracts.h"
 #include "lib/xalloc.h"
 #include "gapbuf.h"
+#include "storage.h"
 #include "editor.h"
+#include "latency.h"
 #include "window.h"
 
 int main(int argc, char* argv[]) {
-  window* W = window_new();
+  // options come before the file names:
+  //   -s <backend>  text storage, gap buffer by default
+  //   -f            fsync every saved file
+  //   -i            index opened files for repeated searches
+  //   -l <file>     write how long keys took to file on exit
+  const storage_ops* ops = &gapbuf_storage;
+  bool sync = false;
+  bool index = false;
+  const char* latencyFile = NULL;
+  int first = 1;
+  while (first < argc && argv[first][0] == '-') {
+    if (strcmp(argv[first], "-s") == 0 && first + 1 < argc) {
+      ops = storage_backend(argv[first + 1]);
+      if (ops == NULL) {
+        fprintf(stderr, "Unknown storage '%s', use gapbuf, piecetable or rope\n", argv[first + 1]);
+        return 1;
+      }
+      first += 2;
+    }
+    else if (strcmp(argv[first], "-f") == 0) {
+      sync = true;
+      first += 1;
+    }
+    else if (strcmp(argv[first], "-i") == 0) {
+      index = true;
+      first += 1;
+    }
+    else if (strcmp(argv[first], "-l") == 0 && first + 1 < argc) {
+      latencyFile = argv[first + 1];
+      first += 2;
+    }
+    else if (strcmp(argv[first], "--") == 0) {
+      first += 1;
+      break;
+    }
+    else {
+      fprintf(stderr, "Usage: rye [-s gapbuf|piecetable|rope] [-f] [-i] [-l file] <file names>\n");
+      return 1;
+    }
+  }
+
+  window* W = window_new(ops);
+  W->syncOnSave = sync;
+  W->indexFiles = index;
   enableRawMode(W);
-  if (argc >= 2) {
-    for (int i = 1; i < argc; i++) {
+  if (argc >= first + 1) {
+    for (int i = first; i < argc; i++) {
       char* s = xcalloc(strlen(argv[i])+1, sizeof(char));
       s = strcpy(s, argv[i]);
       openFile(W, s);
@@ -28,10 +73,13 @@ int main(int argc, char* argv[]) {
 
   while (*go) {
     refresh(W);
-    processKey(W, go);
+    processInput(W, go);
   }
 
   disableRawMode(W);
+  if (latencyFile != NULL && !latency_dump(W->latency, latencyFile)) {
+    perror(latencyFile);
+  }
   window_free(W);
   free(go);
   printf("Thanks for using RYe's editor\n");
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "occur.h"
+
+// the view shows exactly the lines of text holding query, and maps
+// each of its offsets back into text
+static void check_view(storage* V, const char* text, size_t len, const char* query) {
+  size_t n = strlen(query);
+  char* view = storage_str(V);
+  size_t at = 0;
+  size_t rows = 1;
+  size_t start = 0;
+  while (start < len) {
+    size_t end = start;
+    while (end < len && text[end] != '\n') end++;
+    if (end < len) end++;
+    bool found = false;
+    for (size_t i = start; i + n <= end && !found; i++) {
+      found = memcmp(text + i, query, n) == 0;
+    }
+    if (found) {
+      assert(at + (end - start) <= storage_len(V));
+      assert(memcmp(view + at, text + start, end - start) == 0);
+      assert(storage_line_start(V, rows) == at);
+      assert(storage_row_at(V, at) == rows);
+      assert(occur_source(V, at) == start);
+      assert(occur_source(V, at + (end - start) - 1) == end - 1);
+      if (text[end - 1] == '\n') rows += 1;
+      at += end - start;
+    }
+    start = end;
+  }
+  assert(storage_len(V) == at);
+  assert(storage_numrows(V) == rows);
+  free(view);
+}
+
+int main(void) {
+  printf("Testing occur library...\n");
+  const storage_ops* backends[] = {&gapbuf_storage, &piecetable_storage, &rope_storage};
+  srand(23);
+
+  for (size_t b = 0; b < 3; b++) {
+    // a view of a few lines, the last one without a newline
+    const char* start = "foo bar\nbaz\nfoofoo\n\nqux foo";
+    char text[4096];
+    size_t len = strlen(start);
+    memcpy(text, start, len);
+    storage* S = storage_new(backends[b]);
+    storage_insert(S, text, len);
+    storage* V = occur_new(S, "foo", 3);
+    assert(is_storage(V));
+    char* view = storage_str(V);
+    assert(strcmp(view, "foo bar\nfoofoo\nqux foo") == 0);
+    free(view);
+    assert(storage_numrows(V) == 3);
+    assert(occur_source(V, 8) == 12);
+    check_view(V, text, len, "foo");
+
+    // edits to the source rescan the lines they touch
+    for (int e = 0; e < 150; e++) {
+      size_t at = rand() % (len + 1);
+      if (rand() % 2 == 0 && len + 20 < sizeof(text)) {
+        size_t n = 1 + rand() % 6;
+        char s[8];
+        for (size_t i = 0; i < n; i++) s[i] = "fo\nxo"[rand() % 5];
+        storage_move_to(S, at);
+        storage_insert(S, s, n);
+        memmove(text + at + n, text + at, len - at);
+        memcpy(text + at, s, n);
+        len += n;
+      }
+      else {
+        size_t to = at + rand() % 8;
+        if (to > len) to = len;
+        storage_delete_range(S, at, to);
+        memmove(text + at, text + to, len - to);
+        len -= to - at;
+      }
+      check_view(V, text, len, "foo");
+    }
+
+    // the view is read-only
+    size_t viewlen = storage_len(V);
+    storage_move_to(V, 0);
+    storage_insert(V, "x", 1);
+    assert(storage_len(V) == viewlen);
+
+    // a view of a freed source is empty
+    storage_free(S);
+    assert(storage_len(V) == 0 && storage_numrows(V) == 1);
+    storage_free(V);
+  }
+
+  // a view freed first stops watching, and a new one takes its place
+  storage* S = storage_new(&gapbuf_storage);
+  storage_insert(S, "a\nb\na\n", 6);
+  storage* V = occur_new(S, "a", 1);
+  assert(storage_len(V) == 4);
+  storage_free(V);
+  assert(S->watch == NULL);
+  V = occur_new(S, "b", 1);
+  storage_move_to(S, 0);
+  storage_insert(S, "b", 1);
+  check_view(V, "ba\nb\na\n", 7, "b");
+  storage_free(V);
+  storage_free(S);
+
+  // more matching lines than a batch
+  size_t len = (OCCUR_BATCH + 100) * 4;
+  char* text = xmalloc(len);
+  for (size_t i = 0; i < len; i++) text[i] = "xaa\n"[i % 4];
+  S = storage_new(&gapbuf_storage);
+  storage_insert(S, text, len);
+  V = occur_new(S, "a", 1);
+  assert(storage_len(V) == len);
+  assert(storage_numrows(V) == OCCUR_BATCH + 101);
+  storage_free(V);
+  storage_free(S);
+  free(text);
+
+  printf("All test cases passed!\n");
+  return 0;
+}
@@ -0,0 +1,318 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "search.h"
+#include "occur.h"
+
+bool is_occur(occur* V) {
+  if (V == NULL) return false;
+  if (V->starts == NULL || V->viewstarts == NULL || V->query == NULL) return false;
+  if (V->limit == 0 || V->count > V->limit) return false;
+  if (V->source == NULL && V->count > 0) return false;
+  if (V->source != NULL && V->querylen == 0) return false;
+  if (V->viewstarts[0] != 0) return false;
+  for (size_t i = 0; i < V->count; i++) {
+    // lines are never empty: each holds the query
+    if (V->viewstarts[i + 1] <= V->viewstarts[i]) return false;
+    if (i > 0 && V->starts[i] <= V->starts[i - 1]) return false;
+  }
+  if (V->cursor > V->viewstarts[V->count]) return false;
+  return true;
+}
+
+/* scanning the source */
+
+// lines found by a scan, in order
+struct occur_lines {
+  size_t* starts;        // offsets in the source of the lines
+  size_t* lens;          // their lengths, newline included
+  size_t count;
+  size_t limit;          // \length(starts) = \length(lens) = limit
+};
+
+// end of the line of S starting at start, after its newline if any
+static size_t line_end(storage* S, size_t start) {
+  size_t row = storage_row_at(S, start);
+  if (row < storage_numrows(S)) return storage_line_start(S, row + 1);
+  return storage_len(S);
+}
+
+// append to L the lines of S with a match of query[0, n) in [from, to)
+static void occur_scan(storage* S, const char* query, size_t n,
+                       size_t from, size_t to, struct occur_lines* L) {
+  size_t out[OCCUR_BATCH];
+  size_t k;
+  do {
+    k = search_range(S, query, n, from, to, out, OCCUR_BATCH);
+    for (size_t j = 0; j < k; j++) {
+      if (out[j] < from) continue;         // in the line just added
+      size_t start = storage_line_start(S, storage_row_at(S, out[j]));
+      size_t end = line_end(S, out[j]);
+      if (L->count == L->limit) {
+        L->limit *= 2;
+        L->starts = xrealloc(L->starts, L->limit * sizeof(size_t));
+        L->lens = xrealloc(L->lens, L->limit * sizeof(size_t));
+      }
+      L->starts[L->count] = start;
+      L->lens[L->count] = end - start;
+      L->count += 1;
+      from = end;
+    }
+    // the rest of a full batch is searched again, past the last line
+    if (k > 0 && out[k - 1] + 1 > from) from = out[k - 1] + 1;
+  } while (k == OCCUR_BATCH && from < to);
+}
+
+static void occur_lines_init(struct occur_lines* L) {
+  L->limit = 16;
+  L->count = 0;
+  L->starts = xmalloc(L->limit * sizeof(size_t));
+  L->lens = xmalloc(L->limit * sizeof(size_t));
+}
+
+// room for count lines in V
+static void occur_reserve(occur* V, size_t count) {
+  if (count <= V->limit) return;
+  while (count > V->limit) V->limit *= 2;
+  V->starts = xrealloc(V->starts, V->limit * sizeof(size_t));
+  V->viewstarts = xrealloc(V->viewstarts, (V->limit + 1) * sizeof(size_t));
+}
+
+// first line of V starting at or after offset in the source
+static size_t occur_find(occur* V, size_t offset) {
+  size_t lo = 0;
+  size_t hi = V->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (V->starts[mid] < offset) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+// line of V holding offset in the view, offset < length of the view
+static size_t occur_line(occur* V, size_t offset) {
+  size_t lo = 0;
+  size_t hi = V->count - 1;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo + 1) / 2;
+    if (V->viewstarts[mid] <= offset) lo = mid;
+    else hi = mid - 1;
+  }
+  return lo;
+}
+
+// the source changed: rescan the lines the change touched, shift the rest
+static void occur_watch(void* data, storage* S, size_t start, size_t removed, size_t added) {
+  occur* V = data;
+  if (S == NULL) {
+    V->source = NULL;
+    V->count = 0;
+    V->cursor = 0;
+    ENSURES(is_occur(V));
+    return;
+  }
+  V->source = S;
+
+  // the whole lines around the change, in the new text and in the old
+  size_t ls = storage_line_start(S, storage_row_at(S, start));
+  size_t le = line_end(S, start + added);
+  size_t leold = le - added + removed;
+
+  struct occur_lines L;
+  occur_lines_init(&L);
+  occur_scan(S, V->query, V->querylen, ls, le, &L);
+
+  // lines [i, j) of the view are replaced by the L.count lines found
+  size_t i = occur_find(V, ls);
+  size_t j = occur_find(V, leold);
+  size_t count = V->count - (j - i) + L.count;
+  occur_reserve(V, count);
+  size_t base = V->viewstarts[i];
+  size_t oldlen = V->viewstarts[j] - base;
+  memmove(&V->starts[i + L.count], &V->starts[j], (V->count - j) * sizeof(size_t));
+  memmove(&V->viewstarts[i + L.count + 1], &V->viewstarts[j + 1],
+          (V->count - j) * sizeof(size_t));
+  size_t at = base;
+  for (size_t k = 0; k < L.count; k++) {
+    V->starts[i + k] = L.starts[k];
+    at += L.lens[k];
+    V->viewstarts[i + k + 1] = at;
+  }
+  size_t newlen = at - base;
+  for (size_t k = i + L.count; k < count; k++) {
+    V->starts[k] = V->starts[k] + added - removed;
+    V->viewstarts[k + 1] = V->viewstarts[k + 1] + newlen - oldlen;
+  }
+  V->count = count;
+  if (V->cursor > V->viewstarts[count]) V->cursor = V->viewstarts[count];
+
+  free(L.starts);
+  free(L.lens);
+  ENSURES(is_occur(V));
+}
+
+storage* occur_new(storage* source, const char* query, size_t n) {
+  REQUIRES(is_storage(source));
+  REQUIRES(query != NULL && n > 0 && memchr(query, '\n', n) == NULL);
+  storage* S = storage_new(&occur_storage);
+  occur* V = S->text;
+  V->source = source;
+  free(V->query);
+  V->query = xmalloc(n + 1);
+  memcpy(V->query, query, n);
+  V->query[n] = '\0';
+  V->querylen = n;
+
+  // one streaming scan of the whole source
+  struct occur_lines L;
+  occur_lines_init(&L);
+  occur_scan(source, query, n, 0, storage_len(source), &L);
+  free(V->starts);
+  free(V->viewstarts);
+  V->starts = L.starts;
+  V->limit = L.limit;
+  V->count = L.count;
+  V->viewstarts = xmalloc((V->limit + 1) * sizeof(size_t));
+  V->viewstarts[0] = 0;
+  for (size_t k = 0; k < L.count; k++) V->viewstarts[k + 1] = V->viewstarts[k] + L.lens[k];
+  free(L.lens);
+
+  storage_watch(source, occur_watch, V);
+  ENSURES(is_storage(S));
+  return S;
+}
+
+size_t occur_source(storage* S, size_t offset) {
+  REQUIRES(is_storage(S) && S->ops == &occur_storage);
+  REQUIRES(offset <= storage_len(S));
+  occur* V = S->text;
+  if (V->count == 0) return 0;
+  if (offset == V->viewstarts[V->count]) {
+    size_t last = V->count - 1;
+    return V->starts[last] + (V->viewstarts[V->count] - V->viewstarts[last]);
+  }
+  size_t i = occur_line(V, offset);
+  return V->starts[i] + (offset - V->viewstarts[i]);
+}
+
+/* backend */
+
+// the last line shown ends with a newline, so the view has an empty
+// row after it
+static bool occur_full(occur* V) {
+  if (V->count == 0) return true;
+  size_t end = V->starts[V->count - 1] + (V->viewstarts[V->count] - V->viewstarts[V->count - 1]);
+  return storage_char_at(V->source, end - 1) == '\n';
+}
+
+static void* oc_new(void) {
+  occur* V = xmalloc(sizeof(occur));
+  V->source = NULL;
+  V->query = xcalloc(1, sizeof(char));
+  V->querylen = 0;
+  V->limit = 16;
+  V->count = 0;
+  V->starts = xmalloc(V->limit * sizeof(size_t));
+  V->viewstarts = xmalloc((V->limit + 1) * sizeof(size_t));
+  V->viewstarts[0] = 0;
+  V->cursor = 0;
+  return V;
+}
+
+static bool oc_load(void* T, int fd) {
+  (void)T;
+  (void)fd;
+  return false;
+}
+
+static void oc_free(void* T) {
+  occur* V = T;
+  if (V->source != NULL && V->source->watchdata == V) storage_watch(V->source, NULL, NULL);
+  free(V->query);
+  free(V->starts);
+  free(V->viewstarts);
+  free(V);
+}
+
+static bool oc_valid(void* T) {
+  return is_occur(T);
+}
+
+static size_t oc_len(void* T) {
+  occur* V = T;
+  return V->viewstarts[V->count];
+}
+
+static size_t oc_cursor(void* T) {
+  occur* V = T;
+  return V->cursor;
+}
+
+static void oc_move_to(void* T, size_t offset) {
+  occur* V = T;
+  V->cursor = offset;
+}
+
+// a view is read-only: edits are refused by whoever shows it
+static void oc_insert(void* T, const char* s, size_t n) {
+  (void)T;
+  (void)s;
+  (void)n;
+}
+
+static void oc_delete_range(void* T, size_t start, size_t end) {
+  occur* V = T;
+  (void)end;
+  V->cursor = start;
+}
+
+static const char* oc_span(void* T, size_t offset, size_t* n) {
+  occur* V = T;
+  if (offset == V->viewstarts[V->count]) {
+    *n = 0;
+    return "";
+  }
+  size_t i = occur_line(V, offset);
+  const char* span = storage_span(V->source, V->starts[i] + (offset - V->viewstarts[i]), n);
+  if (*n > V->viewstarts[i + 1] - offset) *n = V->viewstarts[i + 1] - offset;
+  return span;
+}
+
+static size_t oc_numrows(void* T) {
+  occur* V = T;
+  return occur_full(V) ? V->count + 1 : V->count;
+}
+
+static size_t oc_row_at(void* T, size_t offset) {
+  occur* V = T;
+  if (offset == V->viewstarts[V->count]) return oc_numrows(V);
+  return occur_line(V, offset) + 1;
+}
+
+static size_t oc_line_start(void* T, size_t row) {
+  occur* V = T;
+  return V->viewstarts[row - 1];
+}
+
+const storage_ops occur_storage = {
+  .name = "occur",
+  .mapped = false,
+  .new = oc_new,
+  .load = oc_load,
+  .free = oc_free,
+  .valid = oc_valid,
+  .len = oc_len,
+  .cursor = oc_cursor,
+  .move_to = oc_move_to,
+  .insert = oc_insert,
+  .reserve = NULL,
+  .delete_range = oc_delete_range,
+  .span = oc_span,
+  .numrows = oc_numrows,
+  .row_at = oc_row_at,
+  .line_start = oc_line_start,
+};
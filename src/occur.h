@@ -0,0 +1,43 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "storage.h"
+
+#ifndef OCCUR_H
+#define OCCUR_H
+
+#define OCCUR_BATCH (4096)     // matches collected by one search_range
+
+/* A read-only storage backend that shows the lines of another storage,
+ * the source, that contain a query. It keeps only where those lines
+ * start, and reads their text from the source in place, so a view of
+ * many lines costs two offsets per line.
+ *
+ * The view watches its source: an edit rescans only the lines it
+ * touched and shifts the rest. Once the source is freed the view is
+ * empty. Inserting into or deleting from the view changes nothing.
+ */
+struct occur_header {
+  storage* source;       // storage whose lines are shown, NULL if none
+  char* query;           // text the lines contain, without newlines
+  size_t querylen;       // length of query, > 0 if source != NULL
+  size_t* starts;        // offsets in source of the lines shown, increasing
+  size_t* viewstarts;    // their offsets in the view, with one more entry
+                         // for the end, viewstarts[0] = 0
+  size_t count;          // number of lines shown
+  size_t limit;          // \length(starts) = limit, \length(viewstarts) = limit + 1
+  size_t cursor;         // offset of the cursor in the view
+};
+typedef struct occur_header occur;
+
+extern const storage_ops occur_storage;
+
+bool is_occur(occur* V);                         // representation invariant
+
+storage* occur_new(storage* source, const char* query, size_t n);
+                                                 // view of the lines of source
+                                                 // containing query[0, n), n > 0,
+                                                 // watching source
+size_t occur_source(storage* V, size_t offset);  // offset in the source of offset
+                                                 // in the view V
+
+#endif
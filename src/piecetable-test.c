@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "piecetable.h"
+
+// the text of pt as a string
+static char* piecetable_str(piecetable* pt) {
+  char* s = xmalloc(pt->len + 1);
+  size_t offset = 0;
+  while (offset < pt->len) {
+    size_t n;
+    const char* span = piecetable_span(pt, offset, &n);
+    memcpy(s + offset, span, n);
+    offset += n;
+  }
+  s[pt->len] = '\0';
+  return s;
+}
+
+int main(void) {
+  printf("Testing piece table library...\n");
+
+  // basics tests
+  piecetable* A = piecetable_new();
+  assert(is_piecetable(A));
+  assert(A->len == 0);
+  assert(piecetable_numrows(A) == 1);
+
+  piecetable_insert_n(A, "pie", 3);
+  piecetable_move_to(A, 0);
+  piecetable_insert_n(A, "app", 3);
+  piecetable_insert_n(A, "le\n", 3); // apple\n[]pie
+  assert(is_piecetable(A));
+  assert(A->cursor == 6);
+  assert(A->numpieces == 2);
+  assert(piecetable_numrows(A) == 2);
+  assert(piecetable_row_at(A, 5) == 1);
+  assert(piecetable_row_at(A, 6) == 2);
+  assert(piecetable_line_start(A, 2) == 6);
+
+  char* s1 = piecetable_str(A);
+  assert(strcmp(s1, "apple\npie") == 0);
+  free(s1);
+
+  piecetable_delete_range(A, 3, 7); // app[]ie
+  assert(is_piecetable(A));
+  assert(A->cursor == 3);
+  assert(piecetable_numrows(A) == 1);
+  char* s2 = piecetable_str(A);
+  assert(strcmp(s2, "appie") == 0);
+  free(s2);
+
+  piecetable_free(A);
+  printf("Basics tests passed!\n");
+
+  // loading maps the file, edits go to the add buffer
+  printf("Testing file mapping...\n");
+  piecetable* B = piecetable_new();
+  int fd = open("test/hi.txt", O_RDONLY);
+  assert(fd != -1);
+  assert(piecetable_load(B, fd));
+  close(fd);
+  assert(is_piecetable(B));
+  assert(B->cursor == 0);
+  assert(B->add.len == 0);
+  char* s3 = piecetable_str(B);
+  assert(strncmp(s3, "hello", 5) == 0);
+  size_t len = B->len;
+  piecetable_move_to(B, 5);
+  piecetable_insert_n(B, ",", 1);
+  piecetable_delete_range(B, 0, 1);
+  assert(is_piecetable(B));
+  assert(B->len == len);
+  assert(B->add.len == 1);
+  char* s4 = piecetable_str(B);
+  assert(strncmp(s4, "ello,", 5) == 0);
+  assert(strcmp(s4 + 5, s3 + 5) == 0);
+  free(s3);
+  free(s4);
+  piecetable_free(B);
+
+  // a pipe can't be mapped, so it is read into the add buffer
+  int fds[2];
+  assert(pipe(fds) == 0);
+  assert(write(fds[1], "a\nb\nc", 5) == 5);
+  close(fds[1]);
+  piecetable* P = piecetable_new();
+  assert(piecetable_load(P, fds[0]));
+  close(fds[0]);
+  assert(is_piecetable(P));
+  assert(P->len == 5 && P->orig.len == 0 && P->add.len == 5);
+  assert(piecetable_numrows(P) == 3);
+  assert(piecetable_line_start(P, 3) == 4);
+  piecetable_free(P);
+
+  // random operations against a plain string
+  printf("Testing random edits...\n");
+  piecetable* C = piecetable_new();
+  char* model = xcalloc(1, 1);
+  size_t modellen = 0;
+  srand(15122);
+  for (int i = 0; i < 2000; i++) {
+    size_t offset = rand() % (modellen + 1);
+    if (rand() % 3 != 0) {
+      const char* s = rand() % 4 == 0 ? "\nab\n" : "xyz";
+      size_t n = strlen(s);
+      piecetable_move_to(C, offset);
+      piecetable_insert_n(C, s, n);
+      model = xrealloc(model, modellen + n + 1);
+      memmove(model + offset + n, model + offset, modellen - offset + 1);
+      memcpy(model + offset, s, n);
+      modellen += n;
+    }
+    else {
+      size_t end = offset + rand() % (modellen - offset + 1) / 4;
+      piecetable_delete_range(C, offset, end);
+      memmove(model + offset, model + end, modellen - end + 1);
+      modellen -= end - offset;
+    }
+    assert(is_piecetable(C));
+    assert(C->len == modellen);
+
+    size_t row = 1;
+    for (size_t j = 0; j < modellen; j++) {
+      if (j == C->cursor) assert(piecetable_row_at(C, j) == row);
+      if (model[j] == '\n') {
+        row += 1;
+        assert(piecetable_line_start(C, row) == j + 1);
+      }
+    }
+    assert(piecetable_numrows(C) == row);
+  }
+  char* s5 = piecetable_str(C);
+  assert(strcmp(s5, model) == 0);
+  free(s5);
+  free(model);
+  piecetable_free(C);
+
+  printf("All test cases passed!\n");
+  return 0;
+}
@@ -0,0 +1,411 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "piecetable.h"
+
+/* sources */
+
+// number of newlines in s[0, n)
+static size_t count_newlines(const char* s, size_t n) {
+  size_t count = 0;
+  const char* end = s + n;
+  while ((s = memchr(s, '\n', end - s)) != NULL) {
+    count += 1;
+    s += 1;
+  }
+  return count;
+}
+
+static void source_init(struct piecetable_source* src) {
+  src->text = NULL;
+  src->len = 0;
+  src->limit = 0;
+  src->blocks = xmalloc(sizeof(size_t));
+  src->blocks[0] = 0;
+  src->numblocks = 1;
+  src->blocklimit = 1;
+}
+
+// extend blocks to cover every complete block of text
+static void source_index(struct piecetable_source* src) {
+  while (src->numblocks * PIECETABLE_BLOCK <= src->len) {
+    if (src->numblocks == src->blocklimit) {
+      src->blocklimit *= 2;
+      src->blocks = xrealloc(src->blocks, src->blocklimit * sizeof(size_t));
+    }
+    size_t k = src->numblocks;
+    src->blocks[k] = src->blocks[k - 1]
+      + count_newlines(src->text + (k - 1) * PIECETABLE_BLOCK, PIECETABLE_BLOCK);
+    src->numblocks += 1;
+  }
+  ENSURES(src->numblocks == src->len / PIECETABLE_BLOCK + 1);
+}
+
+// room for n more chars in an add buffer, growing it by exactly that
+static void source_reserve(struct piecetable_source* src, size_t n) {
+  if (src->len + n <= src->limit) return;
+  src->text = xrealloc(src->text, (src->len + n) * sizeof(char));
+  src->limit = src->len + n;
+}
+
+// append n chars of s to an add buffer
+static void source_append(struct piecetable_source* src, const char* s, size_t n) {
+  if (src->len + n > src->limit) {
+    size_t new_limit = src->limit < 64 ? 64 : 2 * src->limit;
+    if (new_limit < src->len + n) new_limit = src->len + n;
+    source_reserve(src, new_limit - src->len);
+  }
+  memcpy(src->text + src->len, s, n);
+  src->len += n;
+  source_index(src);
+}
+
+// number of newlines in text[0, x)
+static size_t source_newlines_before(struct piecetable_source* src, size_t x) {
+  REQUIRES(x <= src->len);
+  size_t k = x / PIECETABLE_BLOCK;
+  return src->blocks[k]
+    + count_newlines(src->text + k * PIECETABLE_BLOCK, x - k * PIECETABLE_BLOCK);
+}
+
+// number of newlines in text[a, b)
+static size_t source_newlines(struct piecetable_source* src, size_t a, size_t b) {
+  REQUIRES(a <= b && b <= src->len);
+  if (b - a < PIECETABLE_BLOCK) return count_newlines(src->text + a, b - a);
+  return source_newlines_before(src, b) - source_newlines_before(src, a);
+}
+
+// offset of newline number k (from 0) at or after a
+static size_t source_nth_newline(struct piecetable_source* src, size_t a, size_t k) {
+  size_t target = source_newlines_before(src, a) + k;
+
+  // last block whose checkpoint is <= target
+  size_t lo = 0;
+  size_t hi = src->numblocks;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (src->blocks[mid] <= target) lo = mid;
+    else hi = mid;
+  }
+  size_t i = lo * PIECETABLE_BLOCK;
+  size_t seen = src->blocks[lo];
+  if (i < a) {
+    seen = source_newlines_before(src, a);
+    i = a;
+  }
+
+  const char* p = src->text + i;
+  const char* end = src->text + src->len;
+  while ((p = memchr(p, '\n', end - p)) != NULL) {
+    if (seen == target) return p - src->text;
+    seen += 1;
+    p += 1;
+  }
+  ASSERT(false);
+  return src->len;
+}
+
+/* pieces */
+
+static struct piecetable_source* piece_source(piecetable* pt, struct piece* p) {
+  return p->add ? &pt->add : &pt->orig;
+}
+
+bool is_piecetable(piecetable* pt) {
+  if (pt == NULL) return false;
+  if (pt->pieces == NULL) return false;
+  if (pt->numpieces > pt->piecelimit) return false;
+  if (pt->cursor > pt->len) return false;
+  if (pt->curpiece > pt->numpieces) return false;
+
+  size_t len = 0;
+  size_t newlines = 0;
+  for (size_t i = 0; i < pt->numpieces; i++) {
+    struct piece* p = &pt->pieces[i];
+    struct piecetable_source* src = piece_source(pt, p);
+    if (i == pt->curpiece) {
+      if (len != pt->curstart || newlines != pt->curnewlines) return false;
+    }
+    if (p->len == 0) return false;
+    if (p->start + p->len > src->len) return false;
+    if (p->newlines != source_newlines(src, p->start, p->start + p->len)) {
+      return false;
+    }
+    len += p->len;
+    newlines += p->newlines;
+  }
+  if (pt->curpiece == pt->numpieces) {
+    if (len != pt->curstart || newlines != pt->curnewlines) return false;
+  }
+  if (len != pt->len) return false;
+  if (newlines != pt->newlines) return false;
+  return true;
+}
+
+piecetable* piecetable_new(void) {
+  piecetable* pt = xmalloc(sizeof(piecetable));
+  source_init(&pt->orig);
+  source_init(&pt->add);
+  pt->pieces = xmalloc(sizeof(struct piece));
+  pt->numpieces = 0;
+  pt->piecelimit = 1;
+  pt->len = 0;
+  pt->newlines = 0;
+  pt->cursor = 0;
+  pt->curpiece = 0;
+  pt->curstart = 0;
+  pt->curnewlines = 0;
+
+  ENSURES(is_piecetable(pt));
+  return pt;
+}
+
+bool piecetable_load(piecetable* pt, int fd) {
+  REQUIRES(is_piecetable(pt));
+  REQUIRES(pt->len == 0 && pt->orig.len == 0);
+
+  struct stat st;
+  if (fstat(fd, &st) == -1) return false;
+  struct piecetable_source* src = &pt->orig;
+  if (S_ISREG(st.st_mode)) {
+    if (st.st_size == 0) return true;
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) return false;
+    pt->orig.text = map;
+    pt->orig.len = st.st_size;
+    source_index(&pt->orig);
+  }
+  else {
+    // pipes and the like can't be mapped and have no size, read them
+    // into the add buffer
+    src = &pt->add;
+    char buf[BUFSIZ];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) source_append(src, buf, n);
+    if (n < 0) return false;
+    if (src->len == 0) return true;
+  }
+
+  pt->pieces[0].add = src == &pt->add;
+  pt->pieces[0].start = 0;
+  pt->pieces[0].len = src->len;
+  pt->pieces[0].newlines = source_newlines(src, 0, src->len);
+  pt->numpieces = 1;
+  pt->len = src->len;
+  pt->newlines = pt->pieces[0].newlines;
+  pt->cursor = 0;
+  pt->curpiece = 0;
+  pt->curstart = 0;
+  pt->curnewlines = 0;
+
+  ENSURES(is_piecetable(pt));
+  return true;
+}
+
+// piece containing offset, or numpieces if offset = len,
+// with its start offset and newlines before it; walks from the cursor
+static size_t piecetable_find(piecetable* pt, size_t offset,
+                              size_t* start, size_t* before) {
+  REQUIRES(offset <= pt->len);
+  size_t i = pt->curpiece;
+  size_t s = pt->curstart;
+  size_t nl = pt->curnewlines;
+  while (i > 0 && s > offset) {
+    i -= 1;
+    s -= pt->pieces[i].len;
+    nl -= pt->pieces[i].newlines;
+  }
+  while (i < pt->numpieces && s + pt->pieces[i].len <= offset) {
+    s += pt->pieces[i].len;
+    nl += pt->pieces[i].newlines;
+    i += 1;
+  }
+  *start = s;
+  *before = nl;
+  return i;
+}
+
+static void piecetable_insert_piece(piecetable* pt, size_t i, struct piece p) {
+  if (pt->numpieces == pt->piecelimit) {
+    pt->piecelimit *= 2;
+    pt->pieces = xrealloc(pt->pieces, pt->piecelimit * sizeof(struct piece));
+  }
+  memmove(pt->pieces + i + 1, pt->pieces + i,
+          (pt->numpieces - i) * sizeof(struct piece));
+  pt->pieces[i] = p;
+  pt->numpieces += 1;
+}
+
+// make a piece boundary at offset and return the index of the piece
+// starting there; the cursor cache is moved to that boundary
+static size_t piecetable_split(piecetable* pt, size_t offset) {
+  size_t start, before;
+  size_t i = piecetable_find(pt, offset, &start, &before);
+  if (i < pt->numpieces && start < offset) {
+    struct piece* p = &pt->pieces[i];
+    size_t leftlen = offset - start;
+    size_t leftnl = source_newlines(piece_source(pt, p),
+                                    p->start, p->start + leftlen);
+    struct piece right = {
+      .add = p->add,
+      .start = p->start + leftlen,
+      .len = p->len - leftlen,
+      .newlines = p->newlines - leftnl,
+    };
+    p->len = leftlen;
+    p->newlines = leftnl;
+    piecetable_insert_piece(pt, i + 1, right);
+    i += 1;
+    before += leftnl;
+  }
+  pt->curpiece = i;
+  pt->curstart = offset;
+  pt->curnewlines = before;
+  return i;
+}
+
+void piecetable_move_to(piecetable* pt, size_t offset) {
+  REQUIRES(is_piecetable(pt));
+  REQUIRES(offset <= pt->len);
+
+  pt->curpiece = piecetable_find(pt, offset, &pt->curstart, &pt->curnewlines);
+  pt->cursor = offset;
+
+  ENSURES(is_piecetable(pt));
+}
+
+void piecetable_insert_n(piecetable* pt, const char* s, size_t n) {
+  REQUIRES(is_piecetable(pt));
+  REQUIRES(s != NULL || n == 0);
+  if (n == 0) return;
+
+  size_t a = pt->add.len;
+  source_append(&pt->add, s, n);
+  size_t nl = source_newlines(&pt->add, a, a + n);
+
+  size_t i = piecetable_split(pt, pt->cursor);
+  struct piece* prev = i > 0 ? &pt->pieces[i - 1] : NULL;
+  if (prev != NULL && prev->add && prev->start + prev->len == a) {
+    // typing continues the last insertion, extend its piece
+    prev->len += n;
+    prev->newlines += nl;
+  }
+  else {
+    struct piece p = { .add = true, .start = a, .len = n, .newlines = nl };
+    piecetable_insert_piece(pt, i, p);
+    i += 1;
+  }
+  pt->len += n;
+  pt->newlines += nl;
+  pt->cursor += n;
+  pt->curpiece = i;
+  pt->curstart = pt->cursor;
+  pt->curnewlines += nl;
+
+  ENSURES(is_piecetable(pt));
+}
+
+void piecetable_reserve(piecetable* pt, size_t n) {
+  REQUIRES(is_piecetable(pt));
+  source_reserve(&pt->add, n);
+  ENSURES(is_piecetable(pt));
+}
+
+void piecetable_delete_range(piecetable* pt, size_t start, size_t end) {
+  REQUIRES(is_piecetable(pt));
+  REQUIRES(start <= end && end <= pt->len);
+
+  size_t i = piecetable_split(pt, start);
+  size_t before = pt->curnewlines;
+  size_t j = piecetable_split(pt, end);
+  size_t nl = 0;
+  for (size_t k = i; k < j; k++) nl += pt->pieces[k].newlines;
+  memmove(pt->pieces + i, pt->pieces + j,
+          (pt->numpieces - j) * sizeof(struct piece));
+  pt->numpieces -= j - i;
+  pt->len -= end - start;
+  pt->newlines -= nl;
+  pt->cursor = start;
+  pt->curpiece = i;
+  pt->curstart = start;
+  pt->curnewlines = before;
+
+  ENSURES(is_piecetable(pt));
+  ENSURES(pt->cursor == start);
+}
+
+const char* piecetable_span(piecetable* pt, size_t offset, size_t* n) {
+  REQUIRES(is_piecetable(pt));
+  REQUIRES(offset <= pt->len);
+
+  size_t start, before;
+  size_t i = piecetable_find(pt, offset, &start, &before);
+  if (i == pt->numpieces) {
+    *n = 0;
+    return NULL;
+  }
+  struct piece* p = &pt->pieces[i];
+  *n = p->len - (offset - start);
+  return piece_source(pt, p)->text + p->start + (offset - start);
+}
+
+size_t piecetable_row_at(piecetable* pt, size_t offset) {
+  REQUIRES(is_piecetable(pt));
+  REQUIRES(offset <= pt->len);
+
+  size_t start, before;
+  size_t i = piecetable_find(pt, offset, &start, &before);
+  if (i == pt->numpieces) return before + 1;
+  struct piece* p = &pt->pieces[i];
+  return before + 1 + source_newlines(piece_source(pt, p),
+                                      p->start, p->start + (offset - start));
+}
+
+size_t piecetable_line_start(piecetable* pt, size_t row) {
+  REQUIRES(is_piecetable(pt));
+  REQUIRES(row >= 1 && row <= pt->newlines + 1);
+  if (row == 1) return 0;
+
+  // row starts right after newline number row - 2 (from 0), in the
+  // piece found by walking from the cursor like piecetable_find
+  size_t k = row - 2;
+  size_t i = pt->curpiece;
+  size_t start = pt->curstart;
+  size_t before = pt->curnewlines;
+  while (i > 0 && before > k) {
+    i -= 1;
+    start -= pt->pieces[i].len;
+    before -= pt->pieces[i].newlines;
+  }
+  while (before + pt->pieces[i].newlines <= k) {
+    start += pt->pieces[i].len;
+    before += pt->pieces[i].newlines;
+    i += 1;
+  }
+  struct piece* p = &pt->pieces[i];
+  size_t nl = source_nth_newline(piece_source(pt, p), p->start, k - before);
+  return start + (nl - p->start) + 1;
+}
+
+size_t piecetable_numrows(piecetable* pt) {
+  REQUIRES(is_piecetable(pt));
+  return pt->newlines + 1;
+}
+
+void piecetable_free(piecetable* pt) {
+  REQUIRES(is_piecetable(pt));
+  if (pt->orig.len > 0) munmap(pt->orig.text, pt->orig.len);
+  free(pt->orig.blocks);
+  free(pt->add.text);
+  free(pt->add.blocks);
+  free(pt->pieces);
+  free(pt);
+}
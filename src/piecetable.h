@@ -0,0 +1,67 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef PIECETABLE_H
+#define PIECETABLE_H
+
+#define PIECETABLE_BLOCK (1 << 16)  // bytes between newline checkpoints
+
+struct piece {
+  bool add;           // true if text is in add buffer, false if in original
+  size_t start;       // offset of the first char in its buffer
+  size_t len;         // number of chars, len > 0
+  size_t newlines;    // number of newlines in the piece
+};
+
+struct piecetable_source {
+  char* text;         // original file (read-only mapping) or add buffer
+  size_t len;         // number of chars in text
+  size_t limit;       // bytes allocated for an add buffer, 0 for a mapping
+  size_t* blocks;     // blocks[k] = number of newlines in
+                      // text[0, k * PIECETABLE_BLOCK)
+  size_t numblocks;   // numblocks = len / PIECETABLE_BLOCK + 1
+  size_t blocklimit;  // \length(blocks) = blocklimit
+};
+
+struct piecetable_header {
+  struct piecetable_source orig;  // mmap of the original file, never written
+  struct piecetable_source add;   // append-only buffer of inserted text
+  struct piece* pieces;           // pieces in document order
+  size_t numpieces;
+  size_t piecelimit;              // \length(pieces) = piecelimit
+  size_t len;                     // total number of chars
+  size_t newlines;                // total number of newlines
+  size_t cursor;                  // offset of the cursor, cursor <= len
+
+  // piece containing the cursor, numpieces if cursor = len
+  size_t curpiece;
+  size_t curstart;                // offset of the first char of curpiece
+  size_t curnewlines;             // newlines before curpiece
+};
+typedef struct piecetable_header piecetable;
+
+bool is_piecetable(piecetable* pt);           // representation invariant
+
+piecetable* piecetable_new(void);             // create new empty piece table
+bool piecetable_load(piecetable* pt, int fd); // map file into empty table, or read it if
+                                              // it can't be mapped, false on error
+void piecetable_move_to(piecetable* pt, size_t offset);
+                                              // move the cursor to offset
+void piecetable_insert_n(piecetable* pt, const char* s, size_t n);
+                                              // insert n chars of s before cursor
+void piecetable_reserve(piecetable* pt, size_t n);
+                                              // room for n more chars in the add buffer
+void piecetable_delete_range(piecetable* pt, size_t start, size_t end);
+                                              // delete chars in [start, end), cursor moves to start
+const char* piecetable_span(piecetable* pt, size_t offset, size_t* n);
+                                              // contiguous chars at offset, *n of them
+
+size_t piecetable_row_at(piecetable* pt, size_t offset);
+                                              // row of offset
+size_t piecetable_line_start(piecetable* pt, size_t row);
+                                              // offset of first char of row
+size_t piecetable_numrows(piecetable* pt);    // number of rows
+
+void piecetable_free(piecetable* pt);         // free piece table and unmap original
+
+#endif
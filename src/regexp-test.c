@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <regex.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "regexp.h"
+
+// leftmost match of pattern in S at or after from, or false
+static bool find(storage* S, const char* pattern, size_t from, size_t* start, size_t* end) {
+  const char* error = NULL;
+  regexp* X = regexp_new(pattern, strlen(pattern), &error);
+  assert(X != NULL && error == NULL);
+  bool found = regexp_forward(X, S, from, start, end);
+  regexp_free(X);
+  return found;
+}
+
+static bool invalid(const char* pattern) {
+  const char* error = NULL;
+  regexp* X = regexp_new(pattern, strlen(pattern), &error);
+  if (X != NULL) regexp_free(X);
+  return X == NULL && error != NULL;
+}
+
+// random pattern over a and b that POSIX extended syntax reads the same way
+static void random_pattern(char* p, size_t* n, int depth) {
+  int parts = 1 + rand() % 3;
+  for (int i = 0; i < parts; i++) {
+    int r = rand() % 10;
+    if (r == 0 && *n == 0) {
+      p[(*n)++] = '^';
+      continue;
+    }
+    else if (r == 1 && depth < 2) {
+      p[(*n)++] = '(';
+      random_pattern(p, n, depth + 1);
+      p[(*n)++] = '|';
+      random_pattern(p, n, depth + 1);
+      p[(*n)++] = ')';
+    }
+    else if (r == 2) p[(*n)++] = '.';
+    else if (r == 3) {
+      memcpy(p + *n, "[ab]", 4);
+      *n += 4;
+    }
+    else p[(*n)++] = "ab"[rand() % 2];
+
+    int q = rand() % 8;
+    if (q == 0) p[(*n)++] = '*';
+    else if (q == 1) p[(*n)++] = '+';
+    else if (q == 2) p[(*n)++] = '?';
+    else if (q == 3) {
+      memcpy(p + *n, "{1,2}", 5);
+      *n += 5;
+    }
+  }
+  if (depth == 0 && rand() % 8 == 0) p[(*n)++] = '$';
+  p[*n] = '\0';
+}
+
+int main(void) {
+  printf("Testing regexp library...\n");
+  size_t start, end;
+
+  // patterns that do not compile
+  assert(invalid("("));
+  assert(invalid("a)"));
+  assert(invalid("[ab"));
+  assert(invalid("*a"));
+  assert(invalid("a{2,1}"));
+  assert(invalid("a{1001}"));
+  assert(invalid("a\\"));
+  assert(invalid("[b-a]"));
+  assert(invalid("(a{1000}){1000}"));
+
+  // matches across the gap of a gap buffer
+  storage* A = storage_new(&gapbuf_storage);
+  const char* log = "GET /a req_id=00ff00ff00ff00ff ok\nGET /b req_id=xyz\nPUT req_id=0123456789abcdef\n";
+  storage_insert(A, log, strlen(log));
+  storage_move_to(A, 20); // ...req_id=00ff0[]0ff...
+  assert(find(A, "req_id=[0-9a-f]{16}", 0, &start, &end));
+  assert(start == 7 && end == 30);
+  assert(find(A, "req_id=[0-9a-f]{16}", 8, &start, &end));
+  assert(start == 56 && end == 79);
+  assert(!find(A, "req_id=[0-9a-f]{16}", 57, &start, &end));
+  assert(find(A, "^GET", 1, &start, &end));
+  assert(start == 34);
+  assert(find(A, "ok$", 0, &start, &end));
+  assert(start == 31 && end == 33);
+  assert(find(A, "\\w+$", 34, &start, &end));
+  assert(start == 48 && end == 51);
+  assert(find(A, "[xyz]+|b", 0, &start, &end));  // leftmost, not first alternative
+  assert(start == 39 && end == 40);
+  assert(find(A, "/b re|req_id=xyz", 0, &start, &end));
+  assert(start == 38);
+  assert(find(A, "x*", 5, &start, &end));  // empty match
+  assert(start == 5 && end == 5);
+  assert(find(A, "\\d\\D", 0, &start, &end));
+  assert(start == 15);
+  assert(!find(A, "q.*z\\n.*z", 0, &start, &end));
+  assert(find(A, "f\\s", 0, &start, &end));
+  assert(start == 29);
+  assert(find(A, "$", storage_len(A), &start, &end));
+  assert(start == storage_len(A));
+  storage_free(A);
+
+  // random patterns on random texts of many spans against POSIX
+  const storage_ops* backends[] = {&gapbuf_storage, &piecetable_storage, &rope_storage};
+  srand(15122);
+  for (size_t b = 0; b < 3; b++) {
+    storage* S = storage_new(backends[b]);
+    size_t len = 0;
+    char* model = xmalloc(1);
+    for (int i = 0; i < 40; i++) {
+      char s[40];
+      size_t n = 1 + rand() % sizeof(s);
+      for (size_t j = 0; j < n; j++) s[j] = "aab\n"[rand() % 4];
+      size_t offset = rand() % (len + 1);
+      storage_move_to(S, offset);
+      storage_insert(S, s, n);
+      model = xrealloc(model, len + n + 1);
+      memmove(model + offset + n, model + offset, len - offset);
+      memcpy(model + offset, s, n);
+      len += n;
+    }
+    model[len] = '\0';
+
+    for (int i = 0; i < 300; i++) {
+      char pattern[256];
+      size_t n = 0;
+      random_pattern(pattern, &n, 0);
+      regex_t posix;
+      assert(regcomp(&posix, pattern, REG_EXTENDED | REG_NEWLINE) == 0);
+      const char* error = NULL;
+      regexp* X = regexp_new(pattern, n, &error);
+      assert(X != NULL);
+
+      for (int k = 0; k < 5; k++) {
+        size_t from = rand() % (len + 1);
+        regmatch_t m;
+        int eflags = from > 0 && model[from - 1] != '\n' ? REG_NOTBOL : 0;
+        bool found = regexec(&posix, model + from, 1, &m, eflags) == 0;
+        assert(regexp_forward(X, S, from, &start, &end) == found);
+        if (found) {
+          assert(start == from + m.rm_so);
+          assert(storage_len(S) >= end);
+        }
+      }
+      regexp_free(X);
+      regfree(&posix);
+    }
+    free(model);
+    storage_free(S);
+  }
+
+  // a DFA cache that fills up starts over
+  storage* L = storage_new(&rope_storage);
+  for (int i = 0; i < 2000; i++) {
+    char s[16];
+    for (int j = 0; j < 16; j++) s[j] = "ab"[rand() % 2];
+    storage_insert(L, s, 16);
+  }
+  storage_insert(L, "c", 1);
+  assert(find(L, "[ab]{13}c", 0, &start, &end));
+  assert(end == storage_len(L) && start == end - 14);
+  storage_free(L);
+
+  printf("All test cases passed!\n");
+  return 0;
+}
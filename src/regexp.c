@@ -0,0 +1,688 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "regexp.h"
+
+#define REGEXP_MATCH (1u << 0)      // a match ends before the byte just read
+#define REGEXP_FIRST (1u << 1)      // that match is the leftmost one left
+#define REGEXP_LOOP (1u << 2)       // a match may still start at any later byte
+#define REGEXP_LINESTART (1u << 3)  // the byte before is a newline or there is none
+
+#define REGEXP_END (256)            // "byte" read at the end of the text
+#define REGEXP_BLOCK (4096)         // bytes read at a time when scanning backwards
+
+/* parsing */
+
+enum ast_op { AST_SET, AST_BOL, AST_EOL, AST_EMPTY, AST_CAT, AST_ALT, AST_REPEAT };
+
+struct ast {
+  enum ast_op op;
+  int left;                  // operands of AST_CAT and AST_ALT, AST_REPEAT uses left
+  int right;
+  int min;                   // AST_REPEAT of left min to max times, max -1 if unbounded
+  int max;
+  unsigned char set[32];     // bytes of AST_SET
+};
+
+struct parser {
+  const char* s;             // pattern
+  size_t n;                  // its length
+  size_t i;                  // next char to parse
+  struct ast* ast;           // nodes parsed, \length(ast) = limit
+  int numast;
+  int limit;
+  const char* error;         // why the pattern is not valid, NULL if it is
+};
+
+static void set_add(unsigned char* set, int c) {
+  set[c >> 3] |= 1 << (c & 7);
+}
+
+static bool set_has(const unsigned char* set, int c) {
+  return (set[c >> 3] & (1 << (c & 7))) != 0;
+}
+
+static void set_range(unsigned char* set, int lo, int hi) {
+  for (int c = lo; c <= hi; c++) set_add(set, c);
+}
+
+static void set_negate(unsigned char* set) {
+  for (int i = 0; i < 32; i++) set[i] = ~set[i];
+}
+
+static int ast_new(struct parser* P, enum ast_op op) {
+  if (P->numast == P->limit) {
+    P->limit *= 2;
+    P->ast = xrealloc(P->ast, P->limit * sizeof(struct ast));
+  }
+  struct ast* a = &P->ast[P->numast];
+  memset(a, 0, sizeof(struct ast));
+  a->op = op;
+  a->left = -1;
+  a->right = -1;
+  P->numast += 1;
+  return P->numast - 1;
+}
+
+static int ast_pair(struct parser* P, enum ast_op op, int left, int right) {
+  int a = ast_new(P, op);
+  P->ast[a].left = left;
+  P->ast[a].right = right;
+  return a;
+}
+
+// adds the class or char of the escape at P->s[P->i], after the backslash
+static bool parse_escape(struct parser* P, unsigned char* set) {
+  if (P->i == P->n) {
+    P->error = "trailing \\";
+    return false;
+  }
+  char c = P->s[P->i];
+  P->i += 1;
+  unsigned char class[32] = {0};
+  switch (c) {
+    case 'd': case 'D':
+      set_range(class, '0', '9');
+      break;
+    case 'w': case 'W':
+      set_range(class, '0', '9');
+      set_range(class, 'a', 'z');
+      set_range(class, 'A', 'Z');
+      set_add(class, '_');
+      break;
+    case 's': case 'S':
+      set_add(class, ' ');
+      set_range(class, '\t', '\r');
+      break;
+    case 'n':
+      set_add(set, '\n');
+      return true;
+    case 't':
+      set_add(set, '\t');
+      return true;
+    default:
+      set_add(set, (unsigned char)c);
+      return true;
+  }
+  if (c == 'D' || c == 'W' || c == 'S') set_negate(class);
+  for (int i = 0; i < 32; i++) set[i] |= class[i];
+  return true;
+}
+
+// one char of a class, -1 if it was an escaped class such as \d
+static int parse_class_char(struct parser* P, unsigned char* set) {
+  char c = P->s[P->i];
+  P->i += 1;
+  if (c != '\\') return (unsigned char)c;
+  if (P->i == P->n) {
+    P->error = "trailing \\";
+    return -1;
+  }
+  char e = P->s[P->i];
+  if (e == 'n') c = '\n';
+  else if (e == 't') c = '\t';
+  else if (strchr("dDwWsS", e) != NULL) {
+    parse_escape(P, set);
+    return -1;
+  }
+  else c = e;
+  P->i += 1;
+  return (unsigned char)c;
+}
+
+// [...] after the opening bracket
+static int parse_class(struct parser* P) {
+  int a = ast_new(P, AST_SET);
+  unsigned char set[32] = {0};
+  bool negate = P->i < P->n && P->s[P->i] == '^';
+  if (negate) P->i += 1;
+
+  bool first = true;
+  while (P->i < P->n && (P->s[P->i] != ']' || first)) {
+    first = false;
+    int lo = parse_class_char(P, set);
+    if (P->error != NULL) return -1;
+    if (lo >= 0 && P->i + 1 < P->n && P->s[P->i] == '-' && P->s[P->i + 1] != ']') {
+      P->i += 1;
+      int hi = parse_class_char(P, set);
+      if (P->error != NULL) return -1;
+      if (hi < lo) {
+        P->error = "bad range in [ ]";
+        return -1;
+      }
+      set_range(set, lo, hi);
+    }
+    else if (lo >= 0) {
+      set_add(set, lo);
+    }
+  }
+  if (P->i == P->n) {
+    P->error = "missing ]";
+    return -1;
+  }
+  P->i += 1;
+
+  if (negate) set_negate(set);
+  memcpy(P->ast[a].set, set, 32);
+  return a;
+}
+
+static int parse_alt(struct parser* P);
+
+static int parse_atom(struct parser* P) {
+  char c = P->s[P->i];
+  P->i += 1;
+  switch (c) {
+    case '(': {
+      int a = parse_alt(P);
+      if (a < 0) return -1;
+      if (P->i == P->n || P->s[P->i] != ')') {
+        P->error = "missing )";
+        return -1;
+      }
+      P->i += 1;
+      return a;
+    }
+    case '[':
+      return parse_class(P);
+    case '^':
+      return ast_new(P, AST_BOL);
+    case '$':
+      return ast_new(P, AST_EOL);
+    case '*': case '+': case '?': case '{':
+      P->error = "nothing to repeat";
+      return -1;
+    case '.': {
+      int a = ast_new(P, AST_SET);
+      set_range(P->ast[a].set, 0, 255);
+      P->ast[a].set['\n' >> 3] &= ~(1 << ('\n' & 7));
+      return a;
+    }
+    case '\\': {
+      int a = ast_new(P, AST_SET);
+      unsigned char set[32] = {0};
+      if (!parse_escape(P, set)) return -1;
+      memcpy(P->ast[a].set, set, 32);
+      return a;
+    }
+    default: {
+      int a = ast_new(P, AST_SET);
+      set_add(P->ast[a].set, (unsigned char)c);
+      return a;
+    }
+  }
+}
+
+// a count of {m,n}, -1 if there is none
+static int parse_count(struct parser* P) {
+  int count = -1;
+  while (P->i < P->n && P->s[P->i] >= '0' && P->s[P->i] <= '9') {
+    if (count < 0) count = 0;
+    count = count * 10 + (P->s[P->i] - '0');
+    if (count > REGEXP_REPEAT) count = REGEXP_REPEAT + 1;
+    P->i += 1;
+  }
+  return count;
+}
+
+static int parse_repeat(struct parser* P) {
+  int a = parse_atom(P);
+  while (a >= 0 && P->i < P->n) {
+    char c = P->s[P->i];
+    int min, max;
+    if (c == '*') { min = 0; max = -1; }
+    else if (c == '+') { min = 1; max = -1; }
+    else if (c == '?') { min = 0; max = 1; }
+    else if (c == '{') {
+      P->i += 1;
+      min = parse_count(P);
+      max = min;
+      if (P->i < P->n && P->s[P->i] == ',') {
+        P->i += 1;
+        max = parse_count(P);
+      }
+      if (min < 0 || P->i == P->n || P->s[P->i] != '}'
+          || min > REGEXP_REPEAT || max > REGEXP_REPEAT || (max >= 0 && max < min)) {
+        P->error = "bad repetition";
+        return -1;
+      }
+    }
+    else break;
+    P->i += 1;
+    int r = ast_new(P, AST_REPEAT);
+    P->ast[r].left = a;
+    P->ast[r].min = min;
+    P->ast[r].max = max;
+    a = r;
+  }
+  return a;
+}
+
+static int parse_cat(struct parser* P) {
+  int a = -1;
+  while (P->i < P->n && P->s[P->i] != '|' && P->s[P->i] != ')') {
+    int b = parse_repeat(P);
+    if (b < 0) return -1;
+    a = a < 0 ? b : ast_pair(P, AST_CAT, a, b);
+  }
+  return a < 0 ? ast_new(P, AST_EMPTY) : a;
+}
+
+static int parse_alt(struct parser* P) {
+  int a = parse_cat(P);
+  while (a >= 0 && P->i < P->n && P->s[P->i] == '|') {
+    P->i += 1;
+    int b = parse_cat(P);
+    if (b < 0) return -1;
+    a = ast_pair(P, AST_ALT, a, b);
+  }
+  return a;
+}
+
+/* compiling to an automaton */
+
+static int node_new(struct regexp_dfa* D, enum regexp_op op, int next, int alt) {
+  if (D->numnodes == REGEXP_NODES) return -1;
+  if (D->numnodes == D->nodelimit) {
+    D->nodelimit *= 2;
+    D->nodes = xrealloc(D->nodes, D->nodelimit * sizeof(struct regexp_node));
+  }
+  struct regexp_node* x = &D->nodes[D->numnodes];
+  memset(x, 0, sizeof(struct regexp_node));
+  x->op = op;
+  x->next = next;
+  x->alt = alt;
+  D->numnodes += 1;
+  return D->numnodes - 1;
+}
+
+/* Compiles ast[a] to nodes that continue at next and returns the node
+ * to start at, -1 if the automaton grows too large. Reversed, it
+ * matches the text backwards, so concatenation runs right to left and
+ * the line anchors swap.
+ */
+static int compile(struct regexp_dfa* D, struct ast* ast, int a, int next, bool reversed) {
+  if (next < 0) return -1;
+  struct ast* x = &ast[a];
+  switch (x->op) {
+    case AST_SET: {
+      int i = node_new(D, RX_SET, next, -1);
+      if (i >= 0) memcpy(D->nodes[i].set, x->set, 32);
+      return i;
+    }
+    case AST_BOL:
+      return node_new(D, reversed ? RX_EOL : RX_BOL, next, -1);
+    case AST_EOL:
+      return node_new(D, reversed ? RX_BOL : RX_EOL, next, -1);
+    case AST_EMPTY:
+      return next;
+    case AST_CAT:
+      if (reversed) return compile(D, ast, x->right, compile(D, ast, x->left, next, reversed), reversed);
+      return compile(D, ast, x->left, compile(D, ast, x->right, next, reversed), reversed);
+    case AST_ALT: {
+      int left = compile(D, ast, x->left, next, reversed);
+      int right = compile(D, ast, x->right, next, reversed);
+      if (left < 0 || right < 0) return -1;
+      return node_new(D, RX_SPLIT, left, right);
+    }
+    case AST_REPEAT: {
+      int entry;
+      if (x->max < 0) {
+        // loop back to a split that prefers another round
+        int loop = node_new(D, RX_SPLIT, -1, next);
+        if (loop < 0) return -1;
+        int body = compile(D, ast, x->left, loop, reversed);
+        if (body < 0) return -1;
+        D->nodes[loop].next = body;
+        entry = loop;
+      }
+      else {
+        // optional rounds, each skipping straight to next
+        entry = next;
+        for (int i = x->min; i < x->max && entry >= 0; i++) {
+          int body = compile(D, ast, x->left, entry, reversed);
+          entry = body < 0 ? -1 : node_new(D, RX_SPLIT, body, next);
+        }
+      }
+      for (int i = 0; i < x->min && entry >= 0; i++) {
+        entry = compile(D, ast, x->left, entry, reversed);
+      }
+      return entry;
+    }
+  }
+  return -1;
+}
+
+/* lazy DFA */
+
+static void dfa_flush(struct regexp_dfa* D) {
+  D->numstates = 0;
+  D->poolused = 0;
+  for (int i = 0; i < 2 * REGEXP_STATES; i++) D->table[i] = -1;
+}
+
+static bool dfa_init(struct regexp_dfa* D, struct ast* ast, int root, bool reversed) {
+  D->nodelimit = 16;
+  D->nodes = xmalloc(D->nodelimit * sizeof(struct regexp_node));
+  D->numnodes = 0;
+  int match = node_new(D, RX_MATCH, -1, -1);
+  D->start = compile(D, ast, root, match, reversed);
+  D->leftmost = !reversed;
+  D->statelimit = 16;
+  D->states = xmalloc(D->statelimit * sizeof(struct regexp_state));
+  D->table = xmalloc(2 * REGEXP_STATES * sizeof(int));
+  D->pool = xmalloc(REGEXP_POOL * sizeof(int));
+  D->list = xmalloc(D->numnodes * sizeof(int));
+  D->resolved = xmalloc(D->numnodes * sizeof(int));
+  D->stack = xmalloc((2 * D->numnodes + 1) * sizeof(int));
+  D->mark = xcalloc(D->numnodes, sizeof(unsigned));
+  D->generation = 0;
+  dfa_flush(D);
+  return D->start >= 0;
+}
+
+static void dfa_free(struct regexp_dfa* D) {
+  free(D->nodes);
+  free(D->states);
+  free(D->table);
+  free(D->pool);
+  free(D->list);
+  free(D->resolved);
+  free(D->stack);
+  free(D->mark);
+}
+
+static bool is_dfa(struct regexp_dfa* D) {
+  if (D->nodes == NULL) return false;
+  if (D->numnodes < 1 || D->numnodes > D->nodelimit || D->numnodes > REGEXP_NODES) return false;
+  if (D->start < 0 || D->start >= D->numnodes) return false;
+  if (D->states == NULL || D->table == NULL || D->pool == NULL) return false;
+  if (D->statelimit > REGEXP_STATES) return false;
+  if (D->numstates < 0 || D->numstates > D->statelimit) return false;
+  if (D->poolused > REGEXP_POOL) return false;
+  return true;
+}
+
+// appends node and the nodes it leads to without reading a byte to
+// D->list, in order of preference, skipping those already marked
+static void dfa_follow(struct regexp_dfa* D, int node, bool linestart, size_t* count) {
+  int top = 0;
+  D->stack[top++] = node;
+  while (top > 0) {
+    int i = D->stack[--top];
+    if (D->mark[i] == D->generation) continue;
+    D->mark[i] = D->generation;
+    struct regexp_node* x = &D->nodes[i];
+    if (x->op == RX_SPLIT) {
+      D->stack[top++] = x->alt;
+      D->stack[top++] = x->next;
+    }
+    else if (x->op == RX_BOL) {
+      if (linestart) D->stack[top++] = x->next;
+    }
+    else {
+      // RX_EOL waits for the next byte to tell
+      D->list[*count] = i;
+      *count += 1;
+    }
+  }
+}
+
+static void dfa_mark(struct regexp_dfa* D) {
+  D->generation += 1;
+  if (D->generation == 0) {
+    memset(D->mark, 0, D->numnodes * sizeof(unsigned));
+    D->generation = 1;
+  }
+}
+
+static size_t dfa_hash(const int* list, size_t count, unsigned flags) {
+  size_t h = 2166136261u ^ flags;
+  for (size_t i = 0; i < count; i++) h = (h ^ (unsigned)list[i]) * 16777619u;
+  return h;
+}
+
+// the state of D->list[0, count) with flags, starting over if the cache is full
+static int dfa_intern(struct regexp_dfa* D, size_t count, unsigned flags, bool* flushed) {
+  size_t h = dfa_hash(D->list, count, flags) % (2 * REGEXP_STATES);
+  while (D->table[h] >= 0) {
+    struct regexp_state* s = &D->states[D->table[h]];
+    if (s->flags == flags && s->count == count
+        && memcmp(D->pool + s->first, D->list, count * sizeof(int)) == 0) {
+      return D->table[h];
+    }
+    h = (h + 1) % (2 * REGEXP_STATES);
+  }
+
+  if (D->numstates == REGEXP_STATES || D->poolused + count > REGEXP_POOL) {
+    dfa_flush(D);
+    *flushed = true;
+    h = dfa_hash(D->list, count, flags) % (2 * REGEXP_STATES);
+  }
+  if (D->numstates == D->statelimit) {
+    D->statelimit *= 2;
+    D->states = xrealloc(D->states, D->statelimit * sizeof(struct regexp_state));
+  }
+
+  int i = D->numstates;
+  struct regexp_state* s = &D->states[i];
+  s->first = D->poolused;
+  s->count = count;
+  s->flags = flags;
+  for (int c = 0; c <= REGEXP_END; c++) s->next[c] = -1;
+  memcpy(D->pool + s->first, D->list, count * sizeof(int));
+  D->poolused += count;
+  D->numstates += 1;
+  D->table[h] = i;
+  return i;
+}
+
+static int dfa_start(struct regexp_dfa* D, bool linestart) {
+  dfa_mark(D);
+  size_t count = 0;
+  dfa_follow(D, D->start, linestart, &count);
+  unsigned flags = (linestart ? REGEXP_LINESTART : 0) | (D->leftmost ? REGEXP_LOOP : 0);
+  bool flushed = false;
+  return dfa_intern(D, count, flags, &flushed);
+}
+
+/* The state after state i reads byte c, or REGEXP_END. The nodes of
+ * state i are taken in order; the first of them to reach RX_MATCH is
+ * the preferred match, so when searching leftmost the nodes after it
+ * are dropped and no new match starts.
+ */
+static int dfa_step(struct regexp_dfa* D, int i, int c) {
+  struct regexp_state* s = &D->states[i];
+  unsigned flags = s->flags;
+  bool linestart = (flags & REGEXP_LINESTART) != 0;
+  bool eol = c == '\n' || c == REGEXP_END;
+
+  // resolve the RX_EOL nodes, now that the next byte is known
+  dfa_mark(D);
+  size_t count = 0;
+  for (size_t k = 0; k < s->count; k++) {
+    int node = D->pool[s->first + k];
+    if (D->nodes[node].op == RX_EOL) {
+      if (eol) dfa_follow(D, D->nodes[node].next, linestart, &count);
+    }
+    else if (D->mark[node] != D->generation) {
+      D->mark[node] = D->generation;
+      D->list[count] = node;
+      count += 1;
+    }
+  }
+
+  // read c
+  int* resolved = D->resolved;
+  memcpy(resolved, D->list, count * sizeof(int));
+  bool nextstart = c == '\n';
+  unsigned next = nextstart ? REGEXP_LINESTART : 0;
+  dfa_mark(D);
+  size_t n = 0;
+  bool cut = false;
+  for (size_t k = 0; k < count; k++) {
+    struct regexp_node* x = &D->nodes[resolved[k]];
+    if (x->op == RX_MATCH) {
+      next |= REGEXP_MATCH;
+      if (k == 0) next |= REGEXP_FIRST;
+      if (D->leftmost) {
+        cut = true;
+        break;
+      }
+    }
+    else if (x->op == RX_SET && c != REGEXP_END && set_has(x->set, c)) {
+      dfa_follow(D, x->next, nextstart, &n);
+    }
+  }
+  if ((flags & REGEXP_LOOP) != 0 && !cut && c != REGEXP_END) {
+    dfa_follow(D, D->start, nextstart, &n);
+    next |= REGEXP_LOOP;
+  }
+
+  bool flushed = false;
+  int j = dfa_intern(D, n, next, &flushed);
+  if (!flushed) D->states[i].next[c] = j;
+  return j;
+}
+
+static inline int dfa_next(struct regexp_dfa* D, int i, int c) {
+  int j = D->states[i].next[c];
+  return j >= 0 ? j : dfa_step(D, i, c);
+}
+
+static inline bool dfa_dead(struct regexp_dfa* D, int i) {
+  return D->states[i].count == 0 && (D->states[i].flags & REGEXP_LOOP) == 0;
+}
+
+/* regexp */
+
+bool is_regexp(regexp* X) {
+  if (X == NULL) return false;
+  if (!is_dfa(&X->forward) || !is_dfa(&X->reverse)) return false;
+  if (!X->forward.leftmost || X->reverse.leftmost) return false;
+  return true;
+}
+
+regexp* regexp_new(const char* pattern, size_t n, const char** error) {
+  REQUIRES(pattern != NULL || n == 0);
+  REQUIRES(error != NULL);
+
+  struct parser P;
+  P.s = pattern;
+  P.n = n;
+  P.i = 0;
+  P.limit = 16;
+  P.ast = xmalloc(P.limit * sizeof(struct ast));
+  P.numast = 0;
+  P.error = NULL;
+  int root = parse_alt(&P);
+  if (root >= 0 && P.i < P.n) {
+    P.error = "unmatched )";
+  }
+  if (P.error != NULL) {
+    free(P.ast);
+    *error = P.error;
+    return NULL;
+  }
+
+  regexp* X = xmalloc(sizeof(regexp));
+  bool ok = dfa_init(&X->forward, P.ast, root, false);
+  ok = dfa_init(&X->reverse, P.ast, root, true) && ok;
+  free(P.ast);
+  if (!ok) {
+    dfa_free(&X->forward);
+    dfa_free(&X->reverse);
+    free(X);
+    *error = "pattern too large";
+    return NULL;
+  }
+
+  ENSURES(is_regexp(X));
+  return X;
+}
+
+bool regexp_forward(regexp* X, storage* S, size_t from, size_t* start, size_t* end) {
+  REQUIRES(is_regexp(X));
+  REQUIRES(is_storage(S));
+  REQUIRES(from <= storage_len(S));
+  REQUIRES(start != NULL && end != NULL);
+  size_t len = storage_len(S);
+
+  // find where the leftmost match ends, reading the spans in place
+  struct regexp_dfa* D = &X->forward;
+  int i = dfa_start(D, from == 0 || storage_char_at(S, from - 1) == '\n');
+  bool found = false;
+  bool done = false;
+  size_t offset = from;
+  size_t n;
+  const char* span;
+  while (!done && (span = storage_next_span(S, &offset, len, &n)) != NULL) {
+    size_t base = offset - n;
+    for (size_t k = 0; k < n; k++) {
+      i = dfa_next(D, i, (unsigned char)span[k]);
+      unsigned flags = D->states[i].flags;
+      if ((flags & REGEXP_MATCH) != 0) {
+        found = true;
+        *end = base + k;
+        if ((flags & REGEXP_FIRST) != 0) done = true;
+      }
+      if (done || dfa_dead(D, i)) {
+        done = true;
+        break;
+      }
+    }
+  }
+  if (!done) {
+    i = dfa_next(D, i, REGEXP_END);
+    if ((D->states[i].flags & REGEXP_MATCH) != 0) {
+      found = true;
+      *end = len;
+    }
+  }
+  if (!found) return false;
+
+  // the reversed pattern read back from there finds where the match starts
+  struct regexp_dfa* R = &X->reverse;
+  i = dfa_start(R, *end == len || storage_char_at(S, *end) == '\n');
+  *start = *end;
+  done = false;
+  offset = *end;
+  while (!done && offset > from) {
+    size_t block = offset - from < REGEXP_BLOCK ? from : offset - REGEXP_BLOCK;
+    char buf[REGEXP_BLOCK];
+    span = storage_span(S, block, &n);
+    if (n < offset - block) {
+      storage_copy(S, block, offset, buf);
+      span = buf;
+    }
+    for (size_t k = offset - block; k > 0; k--) {
+      i = dfa_next(R, i, (unsigned char)span[k - 1]);
+      if ((R->states[i].flags & REGEXP_MATCH) != 0) *start = block + k;
+      if (dfa_dead(R, i)) {
+        done = true;
+        break;
+      }
+    }
+    offset = block;
+  }
+  if (!done) {
+    // the byte before from only tells whether a match starts at from
+    int c = from == 0 ? REGEXP_END : (unsigned char)storage_char_at(S, from - 1);
+    i = dfa_next(R, i, c);
+    if ((R->states[i].flags & REGEXP_MATCH) != 0) *start = from;
+  }
+
+  ENSURES(from <= *start && *start <= *end && *end <= len);
+  return true;
+}
+
+void regexp_free(regexp* X) {
+  REQUIRES(is_regexp(X));
+  dfa_free(&X->forward);
+  dfa_free(&X->reverse);
+  free(X);
+}
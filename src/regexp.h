@@ -0,0 +1,80 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "storage.h"
+
+#ifndef REGEXP_H
+#define REGEXP_H
+
+#define REGEXP_NODES (1 << 14)  // most automaton nodes a pattern compiles to
+#define REGEXP_REPEAT (1000)    // largest count in a{m,n}
+#define REGEXP_STATES (1024)    // most DFA states cached before starting over
+#define REGEXP_POOL (1 << 18)   // most automaton nodes in all cached states
+
+/* Regular expressions searched with a lazily built DFA.
+ *
+ * Syntax: literals, . (any byte but newline), [...] and [^...] with
+ * ranges, \d \w \s and their negations \D \W \S, \n \t and escaped
+ * metacharacters, ( ) grouping, | alternation, * + ? {m} {m,} {m,n}
+ * repetition, and the line anchors ^ $.
+ *
+ * The pattern compiles to an automaton of nodes, once forwards and
+ * once backwards. A DFA state is an ordered list of automaton nodes;
+ * states and their transitions are only built as the text needs them
+ * and cached, so matching is linear in the text scanned.
+ */
+
+enum regexp_op { RX_SET, RX_SPLIT, RX_BOL, RX_EOL, RX_MATCH };
+
+struct regexp_node {
+  enum regexp_op op;
+  int next;                  // node that follows, RX_MATCH has none
+  int alt;                   // second choice of RX_SPLIT
+  unsigned char set[32];     // bytes RX_SET accepts, one bit each
+};
+
+struct regexp_state {
+  size_t first;              // its nodes are pool[first, first + count)
+  size_t count;
+  unsigned flags;            // REGEXP_* flags of regexp.c
+  int next[257];             // state after each byte and the end of the
+                             // text, -1 if not built yet
+};
+
+struct regexp_dfa {
+  struct regexp_node* nodes;  // automaton, \length(nodes) = nodelimit
+  int numnodes;
+  int nodelimit;
+  int start;                 // node the automaton starts at
+  bool leftmost;             // searches for a match anywhere and stops at
+                             // the leftmost one, otherwise anchored and longest
+  struct regexp_state* states;  // cached states, \length(states) = statelimit
+  int numstates;
+  int statelimit;
+  int* table;                // hash table of states, 2 * REGEXP_STATES slots
+  int* pool;                 // nodes of all states, \length(pool) = REGEXP_POOL
+  size_t poolused;
+  int* list;                 // scratch for building a state, \length = numnodes
+  int* resolved;             // scratch for the state read from, \length = numnodes
+  int* stack;                // scratch for following SPLITs, \length = 2 * numnodes + 1
+  unsigned* mark;            // nodes already in the list, \length = numnodes
+  unsigned generation;       // current mark
+};
+
+struct regexp_header {
+  struct regexp_dfa forward;  // leftmost search for the end of a match
+  struct regexp_dfa reverse;  // pattern reversed, from that end back to its start
+};
+typedef struct regexp_header regexp;
+
+bool is_regexp(regexp* X);                      // representation invariant
+
+regexp* regexp_new(const char* pattern, size_t n, const char** error);
+                                                // compile pattern[0, n), NULL
+                                                // with a message in *error if
+                                                // it is not valid
+bool regexp_forward(regexp* X, storage* S, size_t from, size_t* start, size_t* end);
+                                                // leftmost match [*start, *end)
+                                                // at or after from, false if none
+void regexp_free(regexp* X);                    // free regexp
+
+#endif
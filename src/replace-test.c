@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "regexp.h"
+#include "replace.h"
+
+static storage* make(const storage_ops* ops, const char* text) {
+  storage* S = storage_new(ops);
+  // several inserts, so that matches straddle spans
+  size_t len = strlen(text);
+  storage_insert(S, text + len / 2, len - len / 2);
+  storage_move_to(S, 0);
+  storage_insert(S, text, len / 2);
+  return S;
+}
+
+// S with every match replaced by with is expected
+static void check(replace* P, storage* S, const char* with, const char* expected) {
+  storage* T = replace_build(P, S, with, strlen(with));
+  char* text = storage_str(T);
+  assert(strcmp(text, expected) == 0);
+  assert(storage_cursor(T) == storage_len(T));
+  size_t rows = 1;
+  for (size_t i = 0; expected[i] != '\0'; i++) rows += expected[i] == '\n';
+  assert(storage_numrows(T) == rows);
+  free(text);
+  storage_free(T);
+}
+
+static void literal(const storage_ops* ops, const char* text, const char* needle,
+                    const char* with, const char* expected, size_t count) {
+  storage* S = make(ops, text);
+  replace* P = replace_new();
+  replace_literal(P, S, needle, strlen(needle));
+  assert(P->count == count);
+  check(P, S, with, expected);
+  replace_free(P);
+  storage_free(S);
+}
+
+static void pattern(const storage_ops* ops, const char* text, const char* regexp_pattern,
+                    const char* with, const char* expected, size_t count) {
+  storage* S = make(ops, text);
+  const char* error = NULL;
+  regexp* X = regexp_new(regexp_pattern, strlen(regexp_pattern), &error);
+  assert(X != NULL);
+  replace* P = replace_new();
+  replace_regexp(P, S, X);
+  assert(P->count == count);
+  check(P, S, with, expected);
+  replace_free(P);
+  regexp_free(X);
+  storage_free(S);
+}
+
+int main(void) {
+  printf("Testing replace library...\n");
+  const storage_ops* backends[] = {&gapbuf_storage, &piecetable_storage, &rope_storage};
+
+  for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+    const storage_ops* ops = backends[b];
+
+    // literal, growing, shrinking, and overlapping occurrences
+    literal(ops, "foo bar foo\nfoo", "foo", "quux", "quux bar quux\nquux", 3);
+    literal(ops, "foo bar foo\nfoo", "foo", "", " bar \n", 3);
+    literal(ops, "aaaaa", "aa", "b", "bba", 2);
+    literal(ops, "a\nb\nc\n", "\n", " ", "a b c ", 3);
+    literal(ops, "x y", "a\n", "b", "x y", 0);
+    literal(ops, "", "a", "b", "", 0);
+
+    // patterns, with empty matches at most once per offset
+    pattern(ops, "id=12 id=345", "[0-9]+", "N", "id=N id=N", 2);
+    pattern(ops, "ab", "x*", "-", "-a-b-", 3);
+    pattern(ops, "xa", "x*", "-", "--a-", 3);
+    pattern(ops, "one\ntwo\n", "^", "> ", "> one\n> two\n> ", 3);
+    pattern(ops, "a  b   c", " +", "\n", "a\nb\nc", 2);
+  }
+
+  // where offsets move to
+  storage* S = make(&gapbuf_storage, "0123456789");
+  replace* P = replace_new();
+  replace_literal(P, S, "34", 2);
+  assert(replace_offset(P, 0, 5) == 0);
+  assert(replace_offset(P, 3, 5) == 3);
+  assert(replace_offset(P, 4, 5) == 3);
+  assert(replace_offset(P, 5, 5) == 8);
+  assert(replace_offset(P, 10, 0) == 8);
+  replace_free(P);
+  storage_free(S);
+
+  // many matches, more than one batch
+  size_t len = 3 * REPLACE_BATCH + 7;
+  char* text = xmalloc(len + 1);
+  char* expected = xmalloc(2 * len + 1);
+  size_t k = 0;
+  for (size_t i = 0; i < len; i++) {
+    text[i] = i % 3 == 0 ? 'a' : 'b';
+    if (text[i] == 'a') {
+      expected[k++] = 'c';
+      expected[k++] = 'c';
+    }
+    else expected[k++] = 'b';
+  }
+  text[len] = '\0';
+  expected[k] = '\0';
+  literal(&piecetable_storage, text, "a", "cc", expected, REPLACE_BATCH + 3);
+  free(text);
+  free(expected);
+
+  printf("All test cases passed!\n");
+  return 0;
+}
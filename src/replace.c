@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "search.h"
+#include "regexp.h"
+#include "replace.h"
+
+bool is_replace(replace* P) {
+  if (P == NULL) return false;
+  if (P->starts == NULL || P->ends == NULL) return false;
+  if (P->count > P->limit) return false;
+  for (size_t i = 0; i < P->count; i++) {
+    if (P->starts[i] > P->ends[i]) return false;
+    if (i > 0 && P->starts[i] < P->ends[i-1]) return false;
+    if (i > 0 && P->starts[i] == P->starts[i-1]) return false;
+  }
+  return true;
+}
+
+replace* replace_new(void) {
+  replace* P = xmalloc(sizeof(replace));
+  P->limit = REPLACE_BATCH;
+  P->starts = xmalloc(P->limit * sizeof(size_t));
+  P->ends = xmalloc(P->limit * sizeof(size_t));
+  P->count = 0;
+  ENSURES(is_replace(P));
+  return P;
+}
+
+static void replace_add(replace* P, size_t start, size_t end) {
+  if (P->count == P->limit) {
+    P->limit *= 2;
+    P->starts = xrealloc(P->starts, P->limit * sizeof(size_t));
+    P->ends = xrealloc(P->ends, P->limit * sizeof(size_t));
+  }
+  P->starts[P->count] = start;
+  P->ends[P->count] = end;
+  P->count += 1;
+}
+
+void replace_literal(replace* P, storage* S, const char* needle, size_t n) {
+  REQUIRES(is_replace(P));
+  REQUIRES(is_storage(S));
+  REQUIRES(needle != NULL && n > 0);
+
+  // one scan in batches, skipping occurrences that overlap a kept one
+  P->count = 0;
+  size_t len = storage_len(S);
+  size_t from = 0;
+  while (true) {
+    size_t batch[REPLACE_BATCH];
+    size_t k = search_range(S, needle, n, from, len, batch, REPLACE_BATCH);
+    for (size_t i = 0; i < k; i++) {
+      if (P->count > 0 && batch[i] < P->ends[P->count - 1]) continue;
+      replace_add(P, batch[i], batch[i] + n);
+    }
+    if (k < REPLACE_BATCH) break;
+    from = batch[k - 1] + 1;
+  }
+
+  ENSURES(is_replace(P));
+}
+
+void replace_regexp(replace* P, storage* S, regexp* X) {
+  REQUIRES(is_replace(P));
+  REQUIRES(is_storage(S));
+  REQUIRES(is_regexp(X));
+
+  P->count = 0;
+  size_t len = storage_len(S);
+  size_t from = 0;
+  size_t start, end;
+  while (from <= len && regexp_forward(X, S, from, &start, &end)) {
+    replace_add(P, start, end);
+    // after an empty match the next one starts past the next byte
+    from = end > start ? end : start + 1;
+  }
+
+  ENSURES(is_replace(P));
+}
+
+// append s[0, n) to T, gathering short pieces in buf, which holds
+// *used bytes
+static void replace_append(storage* T, char* buf, size_t* used, const char* s, size_t n) {
+  if (*used + n > REPLACE_CHUNK && *used > 0) {
+    storage_insert(T, buf, *used);
+    *used = 0;
+  }
+  if (n >= REPLACE_CHUNK) {
+    storage_insert(T, s, n);
+    return;
+  }
+  if (n > 0) memcpy(buf + *used, s, n);
+  *used += n;
+}
+
+storage* replace_build(replace* P, storage* S, const char* s, size_t n) {
+  REQUIRES(is_replace(P));
+  REQUIRES(is_storage(S));
+  REQUIRES(s != NULL || n == 0);
+  REQUIRES(P->count == 0 || P->ends[P->count - 1] <= storage_len(S));
+
+  // the final length first, so the text is built without growing
+  size_t len = storage_len(S);
+  size_t newlen = len;
+  for (size_t i = 0; i < P->count; i++) {
+    newlen = newlen - (P->ends[i] - P->starts[i]) + n;
+  }
+
+  // the text between matches appended straight from the spans, so
+  // only the old and the new text are ever live
+  storage* T = storage_new(S->ops);
+  storage_reserve(T, newlen);
+  char* buf = xmalloc(REPLACE_CHUNK);
+  size_t used = 0;
+  size_t offset = 0;
+  for (size_t i = 0; i <= P->count; i++) {
+    size_t end = i < P->count ? P->starts[i] : len;
+    size_t k;
+    const char* span;
+    while ((span = storage_next_span(S, &offset, end, &k)) != NULL) {
+      replace_append(T, buf, &used, span, k);
+    }
+    if (i < P->count) {
+      replace_append(T, buf, &used, s, n);
+      offset = P->ends[i];
+    }
+  }
+  if (used > 0) storage_insert(T, buf, used);
+  free(buf);
+
+  ENSURES(is_storage(T) && storage_len(T) == newlen);
+  return T;
+}
+
+size_t replace_offset(replace* P, size_t offset, size_t n) {
+  REQUIRES(is_replace(P));
+  size_t moved = offset;
+  for (size_t i = 0; i < P->count && P->starts[i] < offset; i++) {
+    if (offset < P->ends[i]) {
+      // inside this match: to the start of its replacement
+      return moved - (offset - P->starts[i]);
+    }
+    moved = moved - (P->ends[i] - P->starts[i]) + n;
+  }
+  return moved;
+}
+
+void replace_free(replace* P) {
+  REQUIRES(is_replace(P));
+  free(P->starts);
+  free(P->ends);
+  free(P);
+}
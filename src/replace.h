@@ -0,0 +1,46 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "storage.h"
+#include "regexp.h"
+
+#ifndef REPLACE_H
+#define REPLACE_H
+
+#define REPLACE_BATCH (4096)      // matches collected by one search_range
+#define REPLACE_CHUNK (1 << 16)   // bytes gathered for one insert into the new text
+
+/* Replacing every match at once. The matches are collected in one
+ * scan of the text, then the new text is appended in one pass to a
+ * fresh storage reserved at its final size, so lines are counted once
+ * instead of once per replacement. Short pieces are gathered into
+ * REPLACE_CHUNK bytes first, so a match every few bytes does not cost
+ * an insert each.
+ */
+struct replace_header {
+  size_t* starts;   // the matches are [starts[i], ends[i]),
+  size_t* ends;     // increasing and not overlapping
+  size_t count;     // number of matches
+  size_t limit;     // \length(starts) = \length(ends) = limit
+};
+typedef struct replace_header replace;
+
+bool is_replace(replace* P);                  // representation invariant
+
+replace* replace_new(void);                   // create with no matches
+void replace_literal(replace* P, storage* S, const char* needle, size_t n);
+                                              // the occurrences of needle[0, n) in S,
+                                              // leftmost first, n > 0
+void replace_regexp(replace* P, storage* S, regexp* X);
+                                              // the matches of X in S, leftmost first,
+                                              // at most one empty match per offset
+storage* replace_build(replace* P, storage* S, const char* s, size_t n);
+                                              // new storage with the backend of S,
+                                              // its text with every match replaced
+                                              // by s[0, n), cursor at the end
+size_t replace_offset(replace* P, size_t offset, size_t n);
+                                              // where offset moves to when every match
+                                              // is replaced by n bytes, the start of
+                                              // the replacement if inside a match
+void replace_free(replace* P);                // free
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "rope.h"
+
+// the text of R as a string
+static char* rope_str(rope* R) {
+  size_t len = rope_len(R);
+  char* s = xmalloc(len + 1);
+  size_t offset = 0;
+  while (offset < len) {
+    size_t n;
+    const char* span = rope_span(R, offset, &n);
+    memcpy(s + offset, span, n);
+    offset += n;
+  }
+  s[len] = '\0';
+  return s;
+}
+
+int main(void) {
+  printf("Testing rope library...\n");
+
+  // basics tests
+  rope* A = rope_new();
+  assert(is_rope(A));
+  assert(rope_len(A) == 0);
+  assert(rope_numrows(A) == 1);
+
+  rope_insert_n(A, "pie", 3);
+  rope_move_to(A, 0);
+  rope_insert_n(A, "app", 3);
+  rope_insert_n(A, "le\n", 3); // apple\n[]pie
+  assert(is_rope(A));
+  assert(A->cursor == 6);
+  assert(rope_numrows(A) == 2);
+  assert(rope_row_at(A, 5) == 1);
+  assert(rope_row_at(A, 6) == 2);
+  assert(rope_line_start(A, 2) == 6);
+
+  char* s1 = rope_str(A);
+  assert(strcmp(s1, "apple\npie") == 0);
+  free(s1);
+
+  rope_delete_range(A, 3, 7); // app[]ie
+  assert(is_rope(A));
+  assert(A->cursor == 3);
+  assert(rope_numrows(A) == 1);
+  char* s2 = rope_str(A);
+  assert(strcmp(s2, "appie") == 0);
+  free(s2);
+
+  rope_free(A);
+  printf("Basics tests passed!\n");
+
+  // loading
+  printf("Testing file loading...\n");
+  rope* B = rope_new();
+  int fd = open("test/hi.txt", O_RDONLY);
+  assert(fd != -1);
+  assert(rope_load(B, fd));
+  close(fd);
+  assert(is_rope(B));
+  assert(B->cursor == 0);
+  assert(rope_numrows(B) == 3);
+  char* s3 = rope_str(B);
+  assert(strncmp(s3, "hello", 5) == 0);
+  free(s3);
+  rope_free(B);
+
+  // large insertions split leaves and grow the tree
+  printf("Testing tree growth...\n");
+  rope* C = rope_new();
+  size_t biglen = 40 * ROPE_LEAF * ROPE_BRANCH;
+  char* big = xmalloc(biglen);
+  for (size_t i = 0; i < biglen; i++) big[i] = i % 64 == 63 ? '\n' : 'a';
+  rope_insert_n(C, big, biglen);
+  assert(is_rope(C));
+  assert(!C->root->leaf);
+  assert(rope_len(C) == biglen);
+  assert(rope_numrows(C) == biglen / 64 + 1);
+  assert(rope_line_start(C, 1000) == 999 * 64);
+  assert(rope_row_at(C, 999 * 64) == 1000);
+  rope_delete_range(C, 10, biglen - 10);
+  assert(is_rope(C));
+  assert(rope_len(C) == 20);
+  free(big);
+
+  // random operations against a plain string
+  printf("Testing random edits...\n");
+  char* model = rope_str(C);
+  size_t modellen = rope_len(C);
+  srand(15122);
+  for (int i = 0; i < 3000; i++) {
+    size_t offset = rand() % (modellen + 1);
+    if (rand() % 3 != 0) {
+      char s[3000];
+      size_t n = rand() % 4 == 0 ? sizeof(s) : (size_t)(1 + rand() % 8);
+      for (size_t j = 0; j < n; j++) s[j] = rand() % 5 == 0 ? '\n' : 'a' + j % 26;
+      rope_move_to(C, offset);
+      rope_insert_n(C, s, n);
+      model = xrealloc(model, modellen + n + 1);
+      memmove(model + offset + n, model + offset, modellen - offset + 1);
+      memcpy(model + offset, s, n);
+      modellen += n;
+    }
+    else {
+      size_t end = offset + rand() % (modellen - offset + 1) / 4;
+      rope_delete_range(C, offset, end);
+      memmove(model + offset, model + end, modellen - end + 1);
+      modellen -= end - offset;
+    }
+    assert(is_rope(C));
+    assert(rope_len(C) == modellen);
+
+    if (i % 50 == 0) {
+      size_t row = 1;
+      for (size_t j = 0; j < modellen; j++) {
+        if (j % 97 == 0) assert(rope_row_at(C, j) == row);
+        if (model[j] == '\n') {
+          row += 1;
+          assert(rope_line_start(C, row) == j + 1);
+        }
+      }
+      assert(rope_numrows(C) == row);
+      char* s4 = rope_str(C);
+      assert(strcmp(s4, model) == 0);
+      free(s4);
+    }
+  }
+  free(model);
+  rope_free(C);
+
+  printf("All test cases passed!\n");
+  return 0;
+}
@@ -0,0 +1,413 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "rope.h"
+
+// chars put in each leaf when loading, leaves room for typing
+#define ROPE_FILL (ROPE_LEAF / 4 * 3)
+
+// number of newlines in s[0, n)
+static size_t count_newlines(const char* s, size_t n) {
+  size_t count = 0;
+  const char* end = s + n;
+  while ((s = memchr(s, '\n', end - s)) != NULL) {
+    count += 1;
+    s += 1;
+  }
+  return count;
+}
+
+/* nodes */
+
+static struct rope_node* node_new(bool leaf) {
+  struct rope_node* node = xmalloc(sizeof(struct rope_node));
+  node->leaf = leaf;
+  node->len = 0;
+  node->newlines = 0;
+  node->text = leaf ? xmalloc(ROPE_LEAF * sizeof(char)) : NULL;
+  node->numchildren = 0;
+  return node;
+}
+
+static void node_free(struct rope_node* node) {
+  if (node->leaf) {
+    free(node->text);
+  }
+  else {
+    for (size_t i = 0; i < node->numchildren; i++) {
+      node_free(node->children[i]);
+    }
+  }
+  free(node);
+}
+
+// recompute len and newlines of an inner node from its children
+static void node_update(struct rope_node* node) {
+  REQUIRES(!node->leaf);
+  node->len = 0;
+  node->newlines = 0;
+  for (size_t i = 0; i < node->numchildren; i++) {
+    node->len += node->children[i]->len;
+    node->newlines += node->children[i]->newlines;
+  }
+}
+
+// subtree is well formed and all its leaves are at depth,
+// returns the depth of the leaves or -1 if not well formed
+static int node_depth(struct rope_node* node) {
+  if (node == NULL) return -1;
+  if (node->leaf) {
+    if (node->text == NULL) return -1;
+    if (node->len > ROPE_LEAF) return -1;
+    if (node->newlines != count_newlines(node->text, node->len)) return -1;
+    return 0;
+  }
+  if (node->numchildren == 0 || node->numchildren > ROPE_BRANCH) return -1;
+  size_t len = 0;
+  size_t newlines = 0;
+  int depth = -1;
+  for (size_t i = 0; i < node->numchildren; i++) {
+    struct rope_node* child = node->children[i];
+    int d = node_depth(child);
+    if (d == -1) return -1;
+    if (i > 0 && d != depth) return -1;
+    if (child->len == 0) return -1;
+    depth = d;
+    len += child->len;
+    newlines += child->newlines;
+  }
+  if (len != node->len || newlines != node->newlines) return -1;
+  return depth + 1;
+}
+
+// insert n <= ROPE_LEAF / 2 chars of s with nl newlines at offset,
+// returns the new right sibling if the node had to split
+static struct rope_node* node_insert(struct rope_node* node, size_t offset,
+                                     const char* s, size_t n, size_t nl) {
+  REQUIRES(offset <= node->len);
+  REQUIRES(n <= ROPE_LEAF / 2);
+
+  if (node->leaf) {
+    if (node->len + n <= ROPE_LEAF) {
+      memmove(node->text + offset + n, node->text + offset, node->len - offset);
+      memcpy(node->text + offset, s, n);
+      node->len += n;
+      node->newlines += nl;
+      return NULL;
+    }
+    // split the leaf in half
+    char tmp[ROPE_LEAF + ROPE_LEAF / 2];
+    size_t total = node->len + n;
+    memcpy(tmp, node->text, offset);
+    memcpy(tmp + offset, s, n);
+    memcpy(tmp + offset + n, node->text + offset, node->len - offset);
+    struct rope_node* right = node_new(true);
+    node->len = total / 2;
+    memcpy(node->text, tmp, node->len);
+    node->newlines = count_newlines(node->text, node->len);
+    right->len = total - node->len;
+    memcpy(right->text, tmp + node->len, right->len);
+    right->newlines = count_newlines(right->text, right->len);
+    return right;
+  }
+
+  // child containing offset, at a boundary the left one
+  size_t i = 0;
+  while (i < node->numchildren - 1 && offset > node->children[i]->len) {
+    offset -= node->children[i]->len;
+    i += 1;
+  }
+  struct rope_node* right = node_insert(node->children[i], offset, s, n, nl);
+  node->len += n;
+  node->newlines += nl;
+  if (right == NULL) return NULL;
+
+  memmove(node->children + i + 2, node->children + i + 1,
+          (node->numchildren - i - 1) * sizeof(struct rope_node*));
+  node->children[i + 1] = right;
+  node->numchildren += 1;
+  if (node->numchildren <= ROPE_BRANCH) return NULL;
+
+  // split the inner node in half
+  struct rope_node* sibling = node_new(false);
+  size_t half = node->numchildren / 2;
+  sibling->numchildren = node->numchildren - half;
+  memcpy(sibling->children, node->children + half,
+         sibling->numchildren * sizeof(struct rope_node*));
+  node->numchildren = half;
+  node_update(node);
+  node_update(sibling);
+  return sibling;
+}
+
+// delete [start, end) of subtree, children left empty are removed
+static void node_delete(struct rope_node* node, size_t start, size_t end) {
+  REQUIRES(start <= end && end <= node->len);
+
+  if (node->leaf) {
+    node->newlines -= count_newlines(node->text + start, end - start);
+    memmove(node->text + start, node->text + end, node->len - end);
+    node->len -= end - start;
+    return;
+  }
+
+  // start and end stay in the coordinates before deletion
+  size_t offset = 0;
+  size_t i = 0;
+  while (i < node->numchildren && offset < end) {
+    struct rope_node* child = node->children[i];
+    size_t childlen = child->len;
+    if (start < offset + childlen) {
+      size_t s = start > offset ? start - offset : 0;
+      size_t e = end < offset + childlen ? end - offset : childlen;
+      node_delete(child, s, e);
+    }
+    offset += childlen;
+    if (child->len == 0) {
+      node_free(child);
+      memmove(node->children + i, node->children + i + 1,
+              (node->numchildren - i - 1) * sizeof(struct rope_node*));
+      node->numchildren -= 1;
+    }
+    else {
+      i += 1;
+    }
+  }
+
+  // merge neighbouring leaves that fit in half a leaf
+  i = 0;
+  while (i + 1 < node->numchildren) {
+    struct rope_node* left = node->children[i];
+    struct rope_node* right = node->children[i + 1];
+    if (left->leaf && left->len + right->len <= ROPE_LEAF / 2) {
+      memcpy(left->text + left->len, right->text, right->len);
+      left->len += right->len;
+      left->newlines += right->newlines;
+      node_free(right);
+      memmove(node->children + i + 1, node->children + i + 2,
+              (node->numchildren - i - 2) * sizeof(struct rope_node*));
+      node->numchildren -= 1;
+    }
+    else {
+      i += 1;
+    }
+  }
+  node_update(node);
+}
+
+/* rope */
+
+bool is_rope(rope* R) {
+  if (R == NULL) return false;
+  if (node_depth(R->root) == -1) return false;
+  if (R->cursor > R->root->len) return false;
+  return true;
+}
+
+rope* rope_new(void) {
+  rope* R = xmalloc(sizeof(rope));
+  R->root = node_new(true);
+  R->cursor = 0;
+
+  ENSURES(is_rope(R));
+  return R;
+}
+
+bool rope_load(rope* R, int fd) {
+  REQUIRES(is_rope(R));
+  REQUIRES(R->root->len == 0);
+
+  // read the file straight into leaves
+  size_t numleaves = 0;
+  size_t leaflimit = 16;
+  struct rope_node** leaves = xmalloc(leaflimit * sizeof(struct rope_node*));
+  struct rope_node* leaf = R->root;
+  ssize_t n = 0;
+  do {
+    if (leaf->len == ROPE_FILL) {
+      leaf->newlines = count_newlines(leaf->text, leaf->len);
+      if (numleaves == leaflimit) {
+        leaflimit *= 2;
+        leaves = xrealloc(leaves, leaflimit * sizeof(struct rope_node*));
+      }
+      leaves[numleaves] = leaf;
+      numleaves += 1;
+      leaf = node_new(true);
+    }
+    n = read(fd, leaf->text + leaf->len, ROPE_FILL - leaf->len);
+    if (n > 0) leaf->len += n;
+  } while (n > 0);
+  leaf->newlines = count_newlines(leaf->text, leaf->len);
+
+  if (leaf->len > 0 || numleaves == 0) {
+    if (numleaves == leaflimit) {
+      leaflimit += 1;
+      leaves = xrealloc(leaves, leaflimit * sizeof(struct rope_node*));
+    }
+    leaves[numleaves] = leaf;
+    numleaves += 1;
+  }
+  else {
+    node_free(leaf);
+  }
+
+  // build inner levels bottom up, ROPE_BRANCH children each
+  while (numleaves > 1) {
+    size_t numnodes = 0;
+    for (size_t i = 0; i < numleaves; i += ROPE_BRANCH) {
+      struct rope_node* node = node_new(false);
+      node->numchildren = numleaves - i < ROPE_BRANCH ? numleaves - i : ROPE_BRANCH;
+      memcpy(node->children, leaves + i,
+             node->numchildren * sizeof(struct rope_node*));
+      node_update(node);
+      leaves[numnodes] = node;
+      numnodes += 1;
+    }
+    numleaves = numnodes;
+  }
+  R->root = leaves[0];
+  R->cursor = 0;
+  free(leaves);
+
+  ENSURES(is_rope(R));
+  return n == 0;
+}
+
+size_t rope_len(rope* R) {
+  REQUIRES(is_rope(R));
+  return R->root->len;
+}
+
+void rope_move_to(rope* R, size_t offset) {
+  REQUIRES(is_rope(R));
+  REQUIRES(offset <= R->root->len);
+  R->cursor = offset;
+}
+
+void rope_insert_n(rope* R, const char* s, size_t n) {
+  REQUIRES(is_rope(R));
+  REQUIRES(s != NULL || n == 0);
+
+  // large insertions go in pieces of at most half a leaf
+  while (n > 0) {
+    size_t k = n < ROPE_LEAF / 2 ? n : ROPE_LEAF / 2;
+    size_t nl = count_newlines(s, k);
+    struct rope_node* right = node_insert(R->root, R->cursor, s, k, nl);
+    if (right != NULL) {
+      struct rope_node* root = node_new(false);
+      root->children[0] = R->root;
+      root->children[1] = right;
+      root->numchildren = 2;
+      node_update(root);
+      R->root = root;
+    }
+    R->cursor += k;
+    s += k;
+    n -= k;
+  }
+
+  ENSURES(is_rope(R));
+}
+
+void rope_delete_range(rope* R, size_t start, size_t end) {
+  REQUIRES(is_rope(R));
+  REQUIRES(start <= end && end <= R->root->len);
+
+  node_delete(R->root, start, end);
+  // collapse a root left with one child, or none
+  while (!R->root->leaf && R->root->numchildren <= 1) {
+    struct rope_node* root = R->root;
+    R->root = root->numchildren == 1 ? root->children[0] : node_new(true);
+    root->numchildren = 0;
+    node_free(root);
+  }
+  R->cursor = start;
+
+  ENSURES(is_rope(R));
+  ENSURES(R->cursor == start);
+}
+
+const char* rope_span(rope* R, size_t offset, size_t* n) {
+  REQUIRES(is_rope(R));
+  REQUIRES(offset <= R->root->len);
+
+  if (offset == R->root->len) {
+    *n = 0;
+    return NULL;
+  }
+  struct rope_node* node = R->root;
+  while (!node->leaf) {
+    size_t i = 0;
+    while (offset >= node->children[i]->len) {
+      offset -= node->children[i]->len;
+      i += 1;
+    }
+    node = node->children[i];
+  }
+  *n = node->len - offset;
+  return node->text + offset;
+}
+
+size_t rope_row_at(rope* R, size_t offset) {
+  REQUIRES(is_rope(R));
+  REQUIRES(offset <= R->root->len);
+
+  if (offset == R->root->len) return R->root->newlines + 1;
+  size_t row = 1;
+  struct rope_node* node = R->root;
+  while (!node->leaf) {
+    size_t i = 0;
+    while (offset >= node->children[i]->len) {
+      offset -= node->children[i]->len;
+      row += node->children[i]->newlines;
+      i += 1;
+    }
+    node = node->children[i];
+  }
+  return row + count_newlines(node->text, offset);
+}
+
+size_t rope_line_start(rope* R, size_t row) {
+  REQUIRES(is_rope(R));
+  REQUIRES(row >= 1 && row <= R->root->newlines + 1);
+  if (row == 1) return 0;
+
+  // row starts right after newline number row - 2 (from 0)
+  size_t k = row - 2;
+  size_t start = 0;
+  struct rope_node* node = R->root;
+  while (!node->leaf) {
+    size_t i = 0;
+    while (node->children[i]->newlines <= k) {
+      k -= node->children[i]->newlines;
+      start += node->children[i]->len;
+      i += 1;
+    }
+    node = node->children[i];
+  }
+  const char* p = node->text;
+  while (true) {
+    p = memchr(p, '\n', node->text + node->len - p);
+    ASSERT(p != NULL);
+    if (k == 0) break;
+    k -= 1;
+    p += 1;
+  }
+  return start + (p - node->text) + 1;
+}
+
+size_t rope_numrows(rope* R) {
+  REQUIRES(is_rope(R));
+  return R->root->newlines + 1;
+}
+
+void rope_free(rope* R) {
+  REQUIRES(is_rope(R));
+  node_free(R->root);
+  free(R);
+}
@@ -0,0 +1,46 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef ROPE_H
+#define ROPE_H
+
+#define ROPE_LEAF 4096      // max chars in a leaf
+#define ROPE_BRANCH 16      // max children of an inner node
+
+struct rope_node {
+  bool leaf;
+  size_t len;             // number of chars in subtree
+  size_t newlines;        // number of newlines in subtree
+  char* text;             // leaf only, \length(text) = ROPE_LEAF
+  size_t numchildren;     // inner only, 0 < numchildren <= ROPE_BRANCH
+  struct rope_node* children[ROPE_BRANCH + 1];
+                          // inner only, one extra slot before a split
+};
+
+struct rope_header {
+  struct rope_node* root;   // B-tree of chunks, all leaves at the same depth
+  size_t cursor;            // offset of the cursor, cursor <= root->len
+};
+typedef struct rope_header rope;
+
+bool is_rope(rope* R);                      // representation invariant
+
+rope* rope_new(void);                       // create new empty rope
+bool rope_load(rope* R, int fd);            // read file into empty rope, false on error
+size_t rope_len(rope* R);                   // number of chars
+void rope_move_to(rope* R, size_t offset);  // move the cursor to offset
+void rope_insert_n(rope* R, const char* s, size_t n);
+                                            // insert n chars of s before cursor
+void rope_delete_range(rope* R, size_t start, size_t end);
+                                            // delete chars in [start, end), cursor moves to start
+const char* rope_span(rope* R, size_t offset, size_t* n);
+                                            // contiguous chars at offset, *n of them
+
+size_t rope_row_at(rope* R, size_t offset); // row of offset, O(log n)
+size_t rope_line_start(rope* R, size_t row);
+                                            // offset of first char of row, O(log n)
+size_t rope_numrows(rope* R);               // number of rows, O(1)
+
+void rope_free(rope* R);                    // free rope
+
+#endif
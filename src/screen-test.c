@@ -0,0 +1,88 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "frame.h"
+#include "screen.h"
+
+// F holds exactly the string s, then empty F
+static bool sent(frame* F, const char* s) {
+  bool same = F->len == strlen(s) && strncmp(F->buf, s, F->len) == 0;
+  frame_truncate(F, 0);
+  return same;
+}
+
+int main(void) {
+  printf("Testing screen library...\n");
+
+  screen* S = screen_new(3, 10);
+  frame* F = frame_new(16);
+  assert(is_screen(S));
+
+  // unknown rows are sent whole, and cleared after the text
+  screen_put_row(S, F, 1, "hello", 5, 5);
+  assert(sent(F, "\x1b[1;1Hhello\x1b[K"));
+  screen_put_row(S, F, 2, "", 0, 0);
+  assert(sent(F, "\x1b[2;1H\x1b[K"));
+
+  // unchanged rows send nothing
+  screen_put_row(S, F, 1, "hello", 5, 5);
+  assert(sent(F, ""));
+
+  // only the changed middle of a row of the same length
+  screen_put_row(S, F, 1, "heLlo", 5, 5);
+  assert(sent(F, "\x1b[1;3HL"));
+
+  // a longer row sends the part after the common prefix
+  screen_put_row(S, F, 1, "heLlo!", 6, 6);
+  assert(sent(F, "\x1b[1;6H!"));
+
+  // a shorter row clears its end
+  screen_put_row(S, F, 1, "he", 2, 2);
+  assert(sent(F, "\x1b[1;3H\x1b[K"));
+
+  // full rows are never cleared
+  screen_put_row(S, F, 3, "0123456789", 10, 10);
+  assert(sent(F, "\x1b[3;1H0123456789"));
+
+  // rows with escape sequences are sent whole
+  screen_put_row(S, F, 2, "\x1b[7mab\x1b[m", 9, 2);
+  assert(sent(F, "\x1b[2;1H\x1b[7mab\x1b[m\x1b[K"));
+  screen_put_row(S, F, 2, "\x1b[7mac\x1b[m", 9, 2);
+  assert(sent(F, "\x1b[2;1H\x1b[7mac\x1b[m\x1b[K"));
+
+  // rows with UTF-8 are sent whole, as bytes are not columns, and
+  // cleared by their width in columns
+  screen_put_row(S, F, 2, "h\xc3\xa9llo", 6, 5);
+  assert(sent(F, "\x1b[2;1Hh\xc3\xa9llo\x1b[K"));
+  screen_put_row(S, F, 2, "h\xc3\xa9lLo", 6, 5);
+  assert(sent(F, "\x1b[2;1Hh\xc3\xa9lLo\x1b[K"));
+  screen_put_row(S, F, 2, "ab", 2, 2);
+  assert(sent(F, "\x1b[2;1Hab\x1b[K"));
+  assert(screen_width("h\xc3\xa9llo", 6) == 5);
+  assert(screen_width("\xe2\x82\xac\xe2\x82\xac", 6) == 2);
+  const char* euros = "\xe2\x82\xac" "123456789";
+  screen_put_row(S, F, 2, euros, 12, screen_width(euros, 12));
+  assert(sent(F, "\x1b[2;1H\xe2\x82\xac" "123456789"));
+
+  // the cursor only moves when needed
+  screen_put_cursor(S, F, 1, 3);
+  assert(sent(F, "\x1b[1;3H"));
+  screen_put_cursor(S, F, 1, 3);
+  assert(sent(F, ""));
+  screen_put_row(S, F, 1, "hi", 2, 2);
+  screen_put_cursor(S, F, 1, 3);
+  assert(sent(F, "\x1b[1;2Hi\x1b[1;3H"));
+
+  // everything is sent again after invalidating
+  screen_invalidate(S);
+  screen_put_row(S, F, 1, "hi", 2, 2);
+  assert(sent(F, "\x1b[1;1Hhi\x1b[K"));
+  assert(is_screen(S));
+
+  screen_free(S);
+  frame_free(F);
+  printf("All test cases passed!\n");
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "frame.h"
+#include "screen.h"
+
+bool is_screen(screen* S) {
+  if (S == NULL) return false;
+  if (S->rows == NULL) return false;
+  // \length(S->rows) = S->numrows
+  for (size_t i = 0; i < S->numrows; i++) {
+    struct screen_row* r = &S->rows[i];
+    if (r->text == NULL) return false;
+    if (r->limit <= 0) return false;
+    if (r->len > r->limit) return false;
+  }
+  if (S->cursorrow > S->numrows) return false;
+  return true;
+}
+
+screen* screen_new(size_t numrows, size_t numcols) {
+  screen* S = xmalloc(sizeof(screen));
+  S->numrows = numrows;
+  S->numcols = numcols;
+  S->rows = xcalloc(numrows > 0 ? numrows : 1, sizeof(struct screen_row));
+  for (size_t i = 0; i < numrows; i++) {
+    S->rows[i].limit = numcols > 0 ? numcols : 1;
+    S->rows[i].text = xmalloc(S->rows[i].limit * sizeof(char));
+    S->rows[i].len = 0;
+    S->rows[i].valid = false;
+  }
+  S->cursorrow = 0;
+  S->cursorcol = 0;
+
+  ENSURES(is_screen(S));
+  return S;
+}
+
+void screen_invalidate(screen* S) {
+  REQUIRES(is_screen(S));
+  for (size_t i = 0; i < S->numrows; i++) {
+    S->rows[i].valid = false;
+  }
+  S->cursorrow = 0;
+  S->cursorcol = 0;
+}
+
+// s[0, n) is printable ASCII, one column per byte
+static bool screen_plain(const char* s, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (s[i] < 0x20 || s[i] > 0x7e) return false;
+  }
+  return true;
+}
+
+size_t screen_width(const char* s, size_t n) {
+  REQUIRES(s != NULL || n == 0);
+  // every byte but UTF-8 continuation bytes starts a character
+  size_t cols = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (((unsigned char)s[i] & 0xc0) != 0x80) cols += 1;
+  }
+  return cols;
+}
+
+void screen_put_row(screen* S, frame* F, size_t row, const char* s, size_t n, size_t cols) {
+  REQUIRES(is_screen(S));
+  REQUIRES(is_frame(F));
+  REQUIRES(row >= 1 && row <= S->numrows);
+  REQUIRES(s != NULL || n == 0);
+
+  struct screen_row* r = &S->rows[row - 1];
+  if (r->valid && r->len == n && memcmp(r->text, s, n) == 0) return;
+
+  // in a row of printable ASCII each byte is one column, so only the
+  // part after the common prefix has to be sent; rows with escape
+  // sequences or UTF-8 are sent whole
+  size_t start = 0;
+  bool plain = r->valid && screen_plain(s, n) && screen_plain(r->text, r->len);
+  if (plain) {
+    while (start < n && start < r->len && s[start] == r->text[start]) {
+      start += 1;
+    }
+  }
+  // unchanged end of a row whose length did not change
+  size_t end = n;
+  if (plain && start > 0 && r->len == n) {
+    while (end > start && s[end - 1] == r->text[end - 1]) end -= 1;
+  }
+
+  frame_printf(F, "\x1b[%zu;%zuH", row, start + 1);
+  frame_append(F, s + start, end - start);
+  // clear what is left of the old row; never on a full row, where
+  // the cursor waits on the last column and would clear it
+  if (cols < S->numcols && (start == 0 || n < r->len)) {
+    frame_appends(F, "\x1b[K");
+  }
+  S->cursorrow = 0;
+  S->cursorcol = 0;
+
+  if (n > r->limit) {
+    free(r->text);
+    r->limit = n;
+    r->text = xmalloc(r->limit * sizeof(char));
+  }
+  memcpy(r->text, s, n);
+  r->len = n;
+  r->valid = true;
+
+  ENSURES(is_screen(S));
+}
+
+void screen_put_cursor(screen* S, frame* F, size_t row, size_t col) {
+  REQUIRES(is_screen(S));
+  REQUIRES(is_frame(F));
+  REQUIRES(row >= 1 && row <= S->numrows);
+  REQUIRES(col >= 1);
+
+  if (S->cursorrow == row && S->cursorcol == col) return;
+  frame_printf(F, "\x1b[%zu;%zuH", row, col);
+  S->cursorrow = row;
+  S->cursorcol = col;
+
+  ENSURES(is_screen(S));
+}
+
+void screen_free(screen* S) {
+  REQUIRES(is_screen(S));
+  for (size_t i = 0; i < S->numrows; i++) {
+    free(S->rows[i].text);
+  }
+  free(S->rows);
+  free(S);
+}
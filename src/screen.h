@@ -0,0 +1,43 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "frame.h"
+
+#ifndef SCREEN_H
+#define SCREEN_H
+
+/* What the terminal currently shows, row by row, as the bytes last
+ * sent for each row. A new frame is drawn by handing every row to
+ * screen_put_row, which appends to the output frame only what differs
+ * from the retained row.
+ */
+struct screen_row {
+  char* text;         // bytes last sent for the row
+  size_t len;         // length of text
+  size_t limit;       // bytes allocated for text, len <= limit, limit > 0
+  bool valid;         // false if what the terminal shows is unknown
+};
+
+struct screen_header {
+  size_t numrows;             // rows of the terminal
+  size_t numcols;             // cols of the terminal
+  struct screen_row* rows;    // rows[i] = row i+1 of the terminal
+  size_t cursorrow;           // where the terminal cursor is,
+  size_t cursorcol;           // 0 if unknown
+};
+typedef struct screen_header screen;
+
+bool is_screen(screen* S);                           // representation invariant
+
+screen* screen_new(size_t numrows, size_t numcols);  // create screen of unknown content
+void screen_invalidate(screen* S);                   // forget the content, redraw all
+void screen_put_row(screen* S, frame* F, size_t row, const char* s, size_t n, size_t cols);
+                                                     // row should show n bytes of s, cols
+                                                     // wide, append the update to F
+size_t screen_width(const char* s, size_t n);        // columns that n bytes of text without
+                                                     // escape sequences take, one per
+                                                     // UTF-8 character
+void screen_put_cursor(screen* S, frame* F, size_t row, size_t col);
+                                                     // move the cursor, append to F
+void screen_free(screen* S);                         // free screen
+
+#endif
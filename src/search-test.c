@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "search.h"
+
+// first occurrence of needle at or after from in s, by brute force
+static bool naive(const char* s, size_t len, const char* needle, size_t n,
+                  size_t from, size_t* match) {
+  for (size_t i = from; i + n <= len; i++) {
+    if (memcmp(s + i, needle, n) == 0) {
+      *match = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(void) {
+  printf("Testing search library...\n");
+
+  // a match across the gap of a gap buffer
+  storage* A = storage_new(&gapbuf_storage);
+  storage_insert(A, "say hello world, hello", 22);
+  storage_move_to(A, 7); // say hel[]lo world, hello
+  size_t match;
+  assert(search_match_at(A, 4, "hello", 5));
+  assert(!search_match_at(A, 5, "hello", 5));
+  assert(!search_match_at(A, 20, "hello", 5));
+  assert(search_forward(A, "hello", 5, 0, &match));
+  assert(match == 4);
+  assert(search_forward(A, "hello", 5, 5, &match));
+  assert(match == 17);
+  assert(!search_forward(A, "hello", 5, 18, &match));
+  assert(!search_forward(A, "help", 4, 0, &match));
+  assert(search_forward(A, "l", 1, 7, &match));
+  assert(match == 7);
+  assert(!search_forward(A, "say hello world, hello!", 23, 0, &match));
+  storage_free(A);
+
+  // long spans go through the vectorized filter, candidates at span ends too
+  storage* L = storage_new(&gapbuf_storage);
+  for (int i = 0; i < 40; i++) storage_insert(L, "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", 38);
+  storage_move_to(L, 100);
+  storage_insert(L, "needle", 6);
+  storage_move_to(L, 800);
+  storage_insert(L, "need", 4);  // nee[]dle is cut by the gap
+  storage_move_to(L, 803);
+  assert(search_forward(L, "needle", 6, 0, &match));
+  assert(match == 100);
+  assert(!search_forward(L, "needle", 6, 101, &match));
+  storage_move_to(L, 804);
+  storage_insert(L, "le", 2);
+  storage_move_to(L, 803);  // need[]le
+  assert(search_forward(L, "needle", 6, 101, &match));
+  assert(match == 800);
+  assert(search_forward(L, "xn", 2, 0, &match));
+  assert(match == 99);
+  storage_free(L);
+
+  // random texts of many spans against brute force
+  const storage_ops* backends[] = {&gapbuf_storage, &piecetable_storage, &rope_storage};
+  srand(15122);
+  for (size_t b = 0; b < 3; b++) {
+    storage* S = storage_new(backends[b]);
+    size_t len = 0;
+    char* model = xmalloc(1);
+    for (int i = 0; i < 60; i++) {
+      char s[50];
+      size_t n = 1 + rand() % sizeof(s);
+      for (size_t j = 0; j < n; j++) s[j] = "ab\n"[rand() % 3];
+      size_t offset = rand() % (len + 1);
+      storage_move_to(S, offset);
+      storage_insert(S, s, n);
+      model = xrealloc(model, len + n);
+      memmove(model + offset + n, model + offset, len - offset);
+      memcpy(model + offset, s, n);
+      len += n;
+    }
+    for (int i = 0; i < 500; i++) {
+      char needle[8];
+      size_t n = 1 + rand() % sizeof(needle);
+      for (size_t j = 0; j < n; j++) needle[j] = "ab\n"[rand() % 3];
+      size_t from = rand() % (len + 1);
+      size_t expect;
+      bool found = naive(model, len, needle, n, from, &expect);
+      assert(search_forward(S, needle, n, from, &match) == found);
+      if (found) assert(match == expect);
+    }
+    free(model);
+    storage_free(S);
+  }
+
+  printf("All test cases passed!\n");
+  return 0;
+}
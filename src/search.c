@@ -0,0 +1,185 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "trigram.h"
+#include "search.h"
+
+bool search_match_at(storage* S, size_t offset, const char* needle, size_t n) {
+  REQUIRES(is_storage(S));
+  REQUIRES(needle != NULL || n == 0);
+  size_t len = storage_len(S);
+  if (offset > len || n > len - offset) return false;
+
+  // compare span by span
+  size_t end = offset + n;
+  size_t spanlen;
+  const char* span;
+  while ((span = storage_next_span(S, &offset, end, &spanlen)) != NULL) {
+    if (memcmp(span, needle, spanlen) != 0) return false;
+    needle += spanlen;
+  }
+  return true;
+}
+
+/* Matches of needle[0, n) starting at hay[0, count), where hay holds
+ * count + n - 1 bytes. Stores at most max of them in out, as offsets
+ * plus base, and returns how many it stored.
+ *
+ * Candidates must have the first and the last byte of the needle in
+ * place, which is tested 16 positions at a time with SSE2 where it is
+ * available. Only candidates that pass are compared in full.
+ */
+static size_t search_span(const char* hay, size_t count, const char* needle, size_t n,
+                          size_t base, size_t* out, size_t max) {
+  size_t found = 0;
+  size_t i = 0;
+  if (max == 0) return 0;
+
+#ifdef __SSE2__
+  __m128i first = _mm_set1_epi8(needle[0]);
+  __m128i last = _mm_set1_epi8(needle[n - 1]);
+  for (; i + 16 <= count; i += 16) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(hay + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(hay + i + n - 1));
+    unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+                                                    _mm_cmpeq_epi8(b, last)));
+    while (mask != 0) {
+      size_t at = i + __builtin_ctz(mask);
+      if (n <= 2 || memcmp(hay + at + 1, needle + 1, n - 2) == 0) {
+        out[found] = base + at;
+        found += 1;
+        if (found == max) return found;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  // the rest, or all of it without SSE2
+  while (i < count) {
+    const char* p = memchr(hay + i, needle[0], count - i);
+    if (p == NULL) break;
+    i = p - hay;
+    if (hay[i + n - 1] == needle[n - 1] && memcmp(hay + i, needle, n) == 0) {
+      out[found] = base + i;
+      found += 1;
+      if (found == max) return found;
+    }
+    i += 1;
+  }
+  return found;
+}
+
+/* Matches starting in [from, to), at most max of them into out.
+ */
+static size_t search_spans(storage* S, const char* needle, size_t n, size_t from, size_t to,
+                           size_t* out, size_t max) {
+  size_t len = storage_len(S);
+  if (n > len || from > len - n || from >= to || max == 0) return 0;
+  size_t last = len - n;  // last offset where a match can start
+  if (last > to - 1) last = to - 1;
+
+  size_t found = 0;
+  size_t offset = from;
+  while (offset <= last) {
+    size_t spanlen;
+    const char* span = storage_span(S, offset, &spanlen);
+
+    // matches that lie inside the span
+    size_t inside = spanlen >= n ? spanlen - n + 1 : 0;
+    if (inside > last - offset + 1) inside = last - offset + 1;
+    found += search_span(span, inside, needle, n, offset, out + found, max - found);
+    if (found == max) return found;
+
+    // matches that start near its end and straddle into the next spans
+    for (size_t at = offset + inside; at < offset + spanlen && at <= last; at++) {
+      if (span[at - offset] == needle[0] && search_match_at(S, at, needle, n)) {
+        out[found] = at;
+        found += 1;
+        if (found == max) return found;
+      }
+    }
+    offset += spanlen;
+  }
+  return found;
+}
+
+/* Like search_spans, but with a trigram index only the blocks that
+ * may hold a match are scanned.
+ */
+static size_t search_scan(storage* S, const char* needle, size_t n, size_t from, size_t to,
+                          size_t* out, size_t max) {
+  if (S->index == NULL) return search_spans(S, needle, n, from, to, out, max);
+
+  size_t found = 0;
+  size_t start, end;
+  while (found < max && trigram_candidates(S->index, needle, n, from, to, &start, &end)) {
+    found += search_spans(S, needle, n, start, end, out + found, max - found);
+    if (found == max) return found;
+    from = end;
+  }
+  return found;
+}
+
+bool search_forward(storage* S, const char* needle, size_t n, size_t from, size_t* match) {
+  REQUIRES(is_storage(S));
+  REQUIRES(needle != NULL && n > 0);
+  REQUIRES(match != NULL);
+
+  if (search_scan(S, needle, n, from, SIZE_MAX, match, 1) == 0) return false;
+
+  ENSURES(*match >= from);
+  ENSURES(search_match_at(S, *match, needle, n));
+  return true;
+}
+
+size_t search_range(storage* S, const char* needle, size_t n, size_t from, size_t to,
+                    size_t* out, size_t max) {
+  REQUIRES(is_storage(S));
+  REQUIRES(needle != NULL && n > 0);
+  REQUIRES(from <= to && to <= storage_len(S));
+  REQUIRES(out != NULL || max == 0);
+
+  size_t found = search_scan(S, needle, n, from, to, out, max);
+
+  ENSURES(found <= max);
+  ENSURES(found == 0 || (from <= out[0] && out[found - 1] < to));
+  return found;
+}
+
+size_t search_filter(storage* S, const size_t* offsets, size_t count, size_t skip,
+                     const char* needle, size_t n, size_t* out) {
+  REQUIRES(is_storage(S));
+  REQUIRES(needle != NULL || n == 0);
+  REQUIRES(offsets != NULL || count == 0);
+  size_t len = storage_len(S);
+
+  // offsets are increasing, so most of them are in the span of the previous one
+  const char* span = NULL;
+  size_t spanstart = 0;
+  size_t spanlen = 0;
+  size_t kept = 0;
+  for (size_t i = 0; i < count; i++) {
+    size_t at = offsets[i] + skip;
+    if (at > len || n > len - at) break;
+    if (span == NULL || at < spanstart || at >= spanstart + spanlen) {
+      span = storage_span(S, at, &spanlen);
+      spanstart = at;
+    }
+    bool same = at + n <= spanstart + spanlen
+      ? memcmp(span + (at - spanstart), needle, n) == 0
+      : search_match_at(S, at, needle, n);
+    if (same) {
+      out[kept] = offsets[i];
+      kept += 1;
+    }
+  }
+  return kept;
+}
@@ -0,0 +1,27 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include "storage.h"
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+/* Searching the text of a storage in place, span by span, without
+ * copying it. Matches may straddle spans, e.g. the gap of a gap buffer.
+ */
+
+bool search_match_at(storage* S, size_t offset, const char* needle, size_t n);
+                                        // needle[0, n) occurs at offset
+bool search_forward(storage* S, const char* needle, size_t n, size_t from, size_t* match);
+                                        // first occurrence at or after from in *match,
+                                        // false if none
+size_t search_range(storage* S, const char* needle, size_t n, size_t from, size_t to,
+                    size_t* out, size_t max);
+                                        // occurrences starting in [from, to), at most
+                                        // max of them in out, returns how many
+size_t search_filter(storage* S, const size_t* offsets, size_t count, size_t skip,
+                     const char* needle, size_t n, size_t* out);
+                                        // of increasing offsets[0, count), those with
+                                        // needle at offset + skip into out, which may
+                                        // be offsets, returns how many
+
+#endif
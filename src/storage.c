@@ -0,0 +1,468 @@
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "gapbuf.h"
+#include "piecetable.h"
+#include "rope.h"
+#include "storage.h"
+#include "trigram.h"
+
+/* gap buffer backend */
+
+static void* gb_new(void) {
+  return gapbuf_new(16);
+}
+
+static bool gb_load(void* T, int fd) {
+  return gapbuf_load(T, fd);
+}
+
+static void gb_free(void* T) {
+  gapbuf_free(T);
+}
+
+static bool gb_valid(void* T) {
+  return is_gapbuf(T);
+}
+
+static size_t gb_len(void* T) {
+  gapbuf* gb = T;
+  return gb->frontlen + gb->backlen;
+}
+
+static size_t gb_cursor(void* T) {
+  gapbuf* gb = T;
+  return gb->frontlen;
+}
+
+static void gb_move_to(void* T, size_t offset) {
+  gapbuf_move_to(T, offset);
+}
+
+static void gb_insert(void* T, const char* s, size_t n) {
+  gapbuf_insert_n(T, s, n);
+}
+
+static void gb_reserve(void* T, size_t n) {
+  gapbuf_reserve(T, n);
+}
+
+static void gb_delete_range(void* T, size_t start, size_t end) {
+  gapbuf_delete_range(T, start, end);
+}
+
+static const char* gb_span(void* T, size_t offset, size_t* n) {
+  gapbuf* gb = T;
+  if (offset < gb->frontlen) {
+    *n = gb->frontlen - offset;
+    return gb->front + offset;
+  }
+  *n = gb->frontlen + gb->backlen - offset;
+  return gb->back + (offset - gb->frontlen);
+}
+
+static size_t gb_numrows(void* T) {
+  return gapbuf_numrows(T);
+}
+
+static size_t gb_row_at(void* T, size_t offset) {
+  return gapbuf_row_at(T, offset);
+}
+
+static size_t gb_line_start(void* T, size_t row) {
+  return gapbuf_line_start(T, row);
+}
+
+const storage_ops gapbuf_storage = {
+  .name = "gapbuf",
+  .mapped = false,
+  .new = gb_new,
+  .load = gb_load,
+  .free = gb_free,
+  .valid = gb_valid,
+  .len = gb_len,
+  .cursor = gb_cursor,
+  .move_to = gb_move_to,
+  .insert = gb_insert,
+  .reserve = gb_reserve,
+  .delete_range = gb_delete_range,
+  .span = gb_span,
+  .numrows = gb_numrows,
+  .row_at = gb_row_at,
+  .line_start = gb_line_start,
+};
+
+/* piece table backend */
+
+static void* pt_new(void) {
+  return piecetable_new();
+}
+
+static bool pt_load(void* T, int fd) {
+  return piecetable_load(T, fd);
+}
+
+static void pt_free(void* T) {
+  piecetable_free(T);
+}
+
+static bool pt_valid(void* T) {
+  return is_piecetable(T);
+}
+
+static size_t pt_len(void* T) {
+  piecetable* pt = T;
+  return pt->len;
+}
+
+static size_t pt_cursor(void* T) {
+  piecetable* pt = T;
+  return pt->cursor;
+}
+
+static void pt_move_to(void* T, size_t offset) {
+  piecetable_move_to(T, offset);
+}
+
+static void pt_insert(void* T, const char* s, size_t n) {
+  piecetable_insert_n(T, s, n);
+}
+
+static void pt_reserve(void* T, size_t n) {
+  piecetable_reserve(T, n);
+}
+
+static void pt_delete_range(void* T, size_t start, size_t end) {
+  piecetable_delete_range(T, start, end);
+}
+
+static const char* pt_span(void* T, size_t offset, size_t* n) {
+  return piecetable_span(T, offset, n);
+}
+
+static size_t pt_numrows(void* T) {
+  return piecetable_numrows(T);
+}
+
+static size_t pt_row_at(void* T, size_t offset) {
+  return piecetable_row_at(T, offset);
+}
+
+static size_t pt_line_start(void* T, size_t row) {
+  return piecetable_line_start(T, row);
+}
+
+const storage_ops piecetable_storage = {
+  .name = "piecetable",
+  .mapped = true,
+  .new = pt_new,
+  .load = pt_load,
+  .free = pt_free,
+  .valid = pt_valid,
+  .len = pt_len,
+  .cursor = pt_cursor,
+  .move_to = pt_move_to,
+  .insert = pt_insert,
+  .reserve = pt_reserve,
+  .delete_range = pt_delete_range,
+  .span = pt_span,
+  .numrows = pt_numrows,
+  .row_at = pt_row_at,
+  .line_start = pt_line_start,
+};
+
+/* rope backend */
+
+static void* rp_new(void) {
+  return rope_new();
+}
+
+static bool rp_load(void* T, int fd) {
+  return rope_load(T, fd);
+}
+
+static void rp_free(void* T) {
+  rope_free(T);
+}
+
+static bool rp_valid(void* T) {
+  return is_rope(T);
+}
+
+static size_t rp_len(void* T) {
+  return rope_len(T);
+}
+
+static size_t rp_cursor(void* T) {
+  rope* R = T;
+  return R->cursor;
+}
+
+static void rp_move_to(void* T, size_t offset) {
+  rope_move_to(T, offset);
+}
+
+static void rp_insert(void* T, const char* s, size_t n) {
+  rope_insert_n(T, s, n);
+}
+
+static void rp_delete_range(void* T, size_t start, size_t end) {
+  rope_delete_range(T, start, end);
+}
+
+static const char* rp_span(void* T, size_t offset, size_t* n) {
+  return rope_span(T, offset, n);
+}
+
+static size_t rp_numrows(void* T) {
+  return rope_numrows(T);
+}
+
+static size_t rp_row_at(void* T, size_t offset) {
+  return rope_row_at(T, offset);
+}
+
+static size_t rp_line_start(void* T, size_t row) {
+  return rope_line_start(T, row);
+}
+
+const storage_ops rope_storage = {
+  .name = "rope",
+  .mapped = false,
+  .new = rp_new,
+  .load = rp_load,
+  .free = rp_free,
+  .valid = rp_valid,
+  .len = rp_len,
+  .cursor = rp_cursor,
+  .move_to = rp_move_to,
+  .insert = rp_insert,
+  .reserve = NULL,
+  .delete_range = rp_delete_range,
+  .span = rp_span,
+  .numrows = rp_numrows,
+  .row_at = rp_row_at,
+  .line_start = rp_line_start,
+};
+
+/* storage */
+
+static const storage_ops* const storage_backends[] = {
+  &gapbuf_storage,
+  &piecetable_storage,
+  &rope_storage,
+};
+
+const storage_ops* storage_backend(const char* name) {
+  REQUIRES(name != NULL);
+  size_t count = sizeof(storage_backends) / sizeof(storage_backends[0]);
+  for (size_t i = 0; i < count; i++) {
+    if (strcmp(storage_backends[i]->name, name) == 0) return storage_backends[i];
+  }
+  return NULL;
+}
+
+bool is_storage(storage* S) {
+  if (S == NULL) return false;
+  if (S->ops == NULL) return false;
+  if (!(*S->ops->valid)(S->text)) return false;
+  if (S->index != NULL && !is_trigram(S->index, (*S->ops->len)(S->text))) return false;
+  return true;
+}
+
+storage* storage_new(const storage_ops* ops) {
+  REQUIRES(ops != NULL);
+  storage* S = xmalloc(sizeof(storage));
+  S->ops = ops;
+  S->text = (*ops->new)();
+  S->index = NULL;
+  S->watch = NULL;
+  S->watchdata = NULL;
+
+  ENSURES(is_storage(S));
+  return S;
+}
+
+bool storage_load(storage* S, int fd) {
+  REQUIRES(is_storage(S));
+  REQUIRES(storage_len(S) == 0);
+  bool ok = (*S->ops->load)(S->text, fd);
+  ENSURES(is_storage(S));
+  ENSURES(storage_cursor(S) == 0);
+  return ok;
+}
+
+void storage_free(storage* S) {
+  REQUIRES(is_storage(S));
+  if (S->watch != NULL) (*S->watch)(S->watchdata, NULL, 0, 0, 0);
+  (*S->ops->free)(S->text);
+  if (S->index != NULL) trigram_free(S->index);
+  free(S);
+}
+
+void storage_watch(storage* S, storage_watch_fn* watch, void* data) {
+  REQUIRES(is_storage(S));
+  S->watch = watch;
+  S->watchdata = watch != NULL ? data : NULL;
+}
+
+size_t storage_len(storage* S) {
+  REQUIRES(is_storage(S));
+  return (*S->ops->len)(S->text);
+}
+
+size_t storage_cursor(storage* S) {
+  REQUIRES(is_storage(S));
+  return (*S->ops->cursor)(S->text);
+}
+
+void storage_move_to(storage* S, size_t offset) {
+  REQUIRES(is_storage(S));
+  REQUIRES(offset <= storage_len(S));
+  (*S->ops->move_to)(S->text, offset);
+  ENSURES(storage_cursor(S) == offset);
+}
+
+void storage_insert(storage* S, const char* s, size_t n) {
+  REQUIRES(is_storage(S));
+  REQUIRES(s != NULL || n == 0);
+  // the index catches up once the text has changed
+  trigram* T = S->index;
+  S->index = NULL;
+  size_t offset = (*S->ops->cursor)(S->text);
+  (*S->ops->insert)(S->text, s, n);
+  if (T != NULL) trigram_insert(T, S, offset, n);
+  S->index = T;
+  if (S->watch != NULL && n > 0) (*S->watch)(S->watchdata, S, offset, 0, n);
+  ENSURES(is_storage(S));
+}
+
+void storage_reserve(storage* S, size_t n) {
+  REQUIRES(is_storage(S));
+  if (S->ops->reserve != NULL) (*S->ops->reserve)(S->text, n);
+  ENSURES(is_storage(S));
+}
+
+void storage_delete_range(storage* S, size_t start, size_t end) {
+  REQUIRES(is_storage(S));
+  REQUIRES(start <= end && end <= storage_len(S));
+  trigram* T = S->index;
+  S->index = NULL;
+  (*S->ops->delete_range)(S->text, start, end);
+  if (T != NULL) trigram_delete(T, S, start, end);
+  S->index = T;
+  if (S->watch != NULL && end > start) (*S->watch)(S->watchdata, S, start, end - start, 0);
+  ENSURES(is_storage(S));
+  ENSURES(storage_cursor(S) == start);
+}
+
+const char* storage_span(storage* S, size_t offset, size_t* n) {
+  REQUIRES(is_storage(S));
+  REQUIRES(offset <= storage_len(S));
+  const char* s = (*S->ops->span)(S->text, offset, n);
+  ENSURES(*n > 0 || offset == storage_len(S));
+  return s;
+}
+
+const char* storage_next_span(storage* S, size_t* offset, size_t end, size_t* n) {
+  REQUIRES(is_storage(S));
+  REQUIRES(offset != NULL && *offset <= end && end <= storage_len(S));
+  if (*offset == end) {
+    *n = 0;
+    return NULL;
+  }
+  const char* span = storage_span(S, *offset, n);
+  if (*n > end - *offset) *n = end - *offset;
+  *offset += *n;
+  ENSURES(*n > 0);
+  return span;
+}
+
+char storage_char_at(storage* S, size_t offset) {
+  REQUIRES(is_storage(S));
+  REQUIRES(offset < storage_len(S));
+  size_t n;
+  return storage_span(S, offset, &n)[0];
+}
+
+size_t storage_row(storage* S) {
+  REQUIRES(is_storage(S));
+  return (*S->ops->row_at)(S->text, storage_cursor(S));
+}
+
+size_t storage_numrows(storage* S) {
+  REQUIRES(is_storage(S));
+  return (*S->ops->numrows)(S->text);
+}
+
+size_t storage_row_at(storage* S, size_t offset) {
+  REQUIRES(is_storage(S));
+  REQUIRES(offset <= storage_len(S));
+  return (*S->ops->row_at)(S->text, offset);
+}
+
+size_t storage_line_start(storage* S, size_t row) {
+  REQUIRES(is_storage(S));
+  REQUIRES(row >= 1 && row <= storage_numrows(S));
+  return (*S->ops->line_start)(S->text, row);
+}
+
+void storage_copy(storage* S, size_t start, size_t end, char* dst) {
+  REQUIRES(is_storage(S));
+  REQUIRES(start <= end && end <= storage_len(S));
+  REQUIRES(dst != NULL || start == end);
+  size_t n;
+  const char* span;
+  while ((span = storage_next_span(S, &start, end, &n)) != NULL) {
+    memcpy(dst, span, n);
+    dst += n;
+  }
+}
+
+char* storage_substr(storage* S, size_t start, size_t end) {
+  REQUIRES(is_storage(S));
+  REQUIRES(start <= end && end <= storage_len(S));
+  char* s = xmalloc((end-start+1) * sizeof(char));
+  storage_copy(S, start, end, s);
+  s[end-start] = '\0';
+  return s;
+}
+
+char* storage_str(storage* S) {
+  REQUIRES(is_storage(S));
+  return storage_substr(S, 0, storage_len(S));
+}
+
+bool storage_write(storage* S, int fd) {
+  REQUIRES(is_storage(S));
+  size_t len = storage_len(S);
+  size_t offset = 0;
+  while (offset < len) {
+    // gather the next spans straight from the backend
+    struct iovec iov[STORAGE_IOV];
+    int count = 0;
+    size_t next = offset;
+    size_t n;
+    const char* span;
+    while (count < STORAGE_IOV
+           && (span = storage_next_span(S, &next, len, &n)) != NULL) {
+      iov[count].iov_base = (void*)span;
+      iov[count].iov_len = n;
+      count += 1;
+    }
+
+    // a short write continues right after the last byte written
+    ssize_t written = writev(fd, iov, count);
+    if (written == -1 && errno == EINTR) continue;
+    if (written <= 0) return false;
+    offset += written;
+  }
+  return true;
+}
@@ -0,0 +1,102 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#define STORAGE_IOV 64      // spans handed to one writev by storage_write
+
+/* Interface every text storage backend implements. All offsets are
+ * byte offsets into the text, rows start from 1. A backend keeps its
+ * own cursor, and insertion happens at the cursor.
+ */
+struct storage_ops {
+  const char* name;                                    // name of the backend
+  bool mapped;                                         // text may still be read from
+                                                       // the loaded file
+  void* (*new)(void);                                  // create empty text
+  bool (*load)(void* T, int fd);                       // read file into empty text,
+                                                       // cursor at start, false on error
+  void (*free)(void* T);                               // free text
+  bool (*valid)(void* T);                              // representation invariant
+  size_t (*len)(void* T);                              // number of chars
+  size_t (*cursor)(void* T);                           // offset of cursor
+  void (*move_to)(void* T, size_t offset);             // move cursor to offset
+  void (*insert)(void* T, const char* s, size_t n);    // insert n chars of s before cursor
+  void (*reserve)(void* T, size_t n);                  // room to insert n more chars without
+                                                       // growing, NULL if it never copies
+  void (*delete_range)(void* T, size_t start, size_t end);
+                                                       // delete [start, end), cursor to start
+  const char* (*span)(void* T, size_t offset, size_t* n);
+                                                       // *n contiguous chars at offset
+  size_t (*numrows)(void* T);                          // number of rows
+  size_t (*row_at)(void* T, size_t offset);            // row of offset
+  size_t (*line_start)(void* T, size_t row);           // offset of first char of row
+};
+typedef struct storage_ops storage_ops;
+
+extern const storage_ops gapbuf_storage;               // gapbuf.h
+extern const storage_ops piecetable_storage;           // piecetable.h
+extern const storage_ops rope_storage;                 // rope.h
+
+const storage_ops* storage_backend(const char* name);  // backend called name, NULL if none
+
+struct storage_header;
+
+/* Told about every change of a storage's text: [start, start + removed)
+ * became [start, start + added). S is the storage after the change,
+ * or NULL when it is freed.
+ */
+typedef void storage_watch_fn(void* data, struct storage_header* S,
+                              size_t start, size_t removed, size_t added);
+
+struct storage_header {
+  const storage_ops* ops;     // backend
+  void* text;                 // backend specific text
+  struct trigram_header* index;
+                              // trigram index of the text, NULL if none,
+                              // kept up to date by every edit (trigram.h)
+  storage_watch_fn* watch;    // told about every change, NULL if none
+  void* watchdata;            // passed to watch
+};
+typedef struct storage_header storage;
+
+bool is_storage(storage* S);                           // representation invariant
+
+storage* storage_new(const storage_ops* ops);          // create empty storage with backend ops
+bool storage_load(storage* S, int fd);                 // read file into empty storage
+void storage_free(storage* S);                         // free storage and its text
+void storage_watch(storage* S, storage_watch_fn* watch, void* data);
+                                                       // tell watch about every change
+                                                       // from now on, NULL for none
+
+size_t storage_len(storage* S);                        // number of chars
+size_t storage_cursor(storage* S);                     // offset of cursor
+void storage_move_to(storage* S, size_t offset);       // move cursor to offset
+void storage_insert(storage* S, const char* s, size_t n);
+                                                       // insert n chars of s before cursor
+void storage_delete_range(storage* S, size_t start, size_t end);
+                                                       // delete [start, end), cursor to start
+void storage_reserve(storage* S, size_t n);            // room to insert n more chars without
+                                                       // growing, if the backend grows
+const char* storage_span(storage* S, size_t offset, size_t* n);
+                                                       // *n contiguous chars at offset
+const char* storage_next_span(storage* S, size_t* offset, size_t end, size_t* n);
+                                                       // next span of [*offset, end) and advance
+                                                       // *offset past it, NULL once *offset == end
+char storage_char_at(storage* S, size_t offset);       // char at offset < len
+
+size_t storage_row(storage* S);                        // row of cursor
+size_t storage_numrows(storage* S);                    // number of rows
+size_t storage_row_at(storage* S, size_t offset);      // row of offset
+size_t storage_line_start(storage* S, size_t row);     // offset of first char of row
+
+void storage_copy(storage* S, size_t start, size_t end, char* dst);
+                                                       // copy chars [start, end) into dst
+char* storage_substr(storage* S, size_t start, size_t end);
+                                                       // chars [start, end) as a new string
+char* storage_str(storage* S);                         // the string contained in the storage
+bool storage_write(storage* S, int fd);                // write the text to fd without copying it,
+                                                       // false on error
+
+#endif
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "search.h"
+#include "trigram.h"
+
+// search_range with the index finds what brute force finds in text
+static void check_search(storage* S, const char* text, size_t len, const char* needle) {
+  size_t n = strlen(needle);
+  size_t out[4096];
+  size_t from = 0;
+  size_t k;
+  size_t i = 0;
+  do {
+    k = search_range(S, needle, n, from, len, out, 4096);
+    for (size_t j = 0; j < k; j++) {
+      while (i + n <= len && memcmp(text + i, needle, n) != 0) i++;
+      assert(out[j] == i);
+      i++;
+    }
+    if (k > 0) from = out[k - 1] + 1;
+  } while (k == 4096);
+  while (i + n <= len && memcmp(text + i, needle, n) != 0) i++;
+  assert(i + n > len);
+}
+
+// number of candidate ranges of needle
+static size_t ranges(storage* S, const char* needle, size_t len) {
+  size_t count = 0;
+  size_t from = 0;
+  size_t start, end;
+  while (trigram_candidates(S->index, needle, strlen(needle), from, len, &start, &end)) {
+    assert(from <= start && start < end && end <= len);
+    count += 1;
+    from = end;
+  }
+  return count;
+}
+
+int main(void) {
+  printf("Testing trigram library...\n");
+  const storage_ops* backends[] = {&gapbuf_storage, &piecetable_storage, &rope_storage};
+  const char* needles[] = {"abcabcab", "xyz", "b\nq", "zzzz", "ab"};
+  size_t numneedles = sizeof(needles) / sizeof(needles[0]);
+  srand(17);
+
+  // small texts with every backend, a single block
+  for (size_t k = 0; k < 3; k++) {
+    char text[64] = "the quick brown fox";
+    size_t len = strlen(text);
+    storage* S = storage_new(backends[k]);
+    storage_insert(S, text, len);
+    S->index = trigram_new(S);
+    assert(trigram_build(S->index, S, 1));
+    check_search(S, text, len, "fox");
+    assert(ranges(S, "cat", len) == 0);
+    storage_move_to(S, 4);
+    storage_insert(S, "cat ", 4);       // the cat quick brown fox
+    memmove(text + 8, text + 4, len - 4);
+    memcpy(text + 4, "cat ", 4);
+    len += 4;
+    check_search(S, text, len, "cat");
+    check_search(S, text, len, "e c");
+    storage_delete_range(S, 7, 14);     // the catck brown fox
+    memmove(text + 7, text + 14, len - 14);
+    len -= 7;
+    check_search(S, text, len, "tck");
+    storage_free(S);
+  }
+
+  // a text of a few blocks with one rare word, in a gap buffer whose
+  // contracts cost the least
+  size_t len = 3 * TRIGRAM_BLOCK + 100;
+  size_t limit = 8 * TRIGRAM_BLOCK;
+  char* text = xmalloc(limit);
+  for (size_t i = 0; i < len; i++) text[i] = "abcab\n"[i % 6];
+  memcpy(text + TRIGRAM_BLOCK + 10, "xyz", 3);
+  storage* S = storage_new(&gapbuf_storage);
+  storage_insert(S, text, len);
+  S->index = trigram_new(S);
+  assert(is_storage(S));
+
+  // before anything is built every block is a candidate
+  for (size_t i = 0; i < numneedles; i++) check_search(S, text, len, needles[i]);
+  assert(ranges(S, "xyz", len) == 1);
+
+  // once built, only the block with the rare word is
+  while (!trigram_build(S->index, S, 1)) continue;
+  for (size_t i = 0; i < numneedles; i++) check_search(S, text, len, needles[i]);
+  assert(ranges(S, "xyz", len) == 1);
+  size_t start, end;
+  assert(trigram_candidates(S->index, "xyz", 3, 0, len, &start, &end));
+  assert(start == TRIGRAM_BLOCK && end == 2 * TRIGRAM_BLOCK);
+  assert(ranges(S, "zzzz", len) == 0);
+
+  // edits keep it sound, building as they go
+  for (int e = 0; e < 100; e++) {
+    size_t at = rand() % (len + 1);
+    if (rand() % 2 == 0 && len + 600 < limit) {
+      size_t n = rand() % 4 == 0 ? 500 : 1 + rand() % 5;
+      char s[600];
+      for (size_t i = 0; i < n; i++) s[i] = "abcxyzq\n"[rand() % 8];
+      storage_move_to(S, at);
+      storage_insert(S, s, n);
+      memmove(text + at + n, text + at, len - at);
+      memcpy(text + at, s, n);
+      len += n;
+    }
+    else {
+      size_t to = at + rand() % 50;
+      if (to > len) to = len;
+      storage_delete_range(S, at, to);
+      memmove(text + at, text + to, len - to);
+      len -= to - at;
+    }
+    if (e % 10 == 0) trigram_build(S->index, S, 1);
+    if (e % 25 == 0) {
+      check_search(S, text, len, "xyz");
+      check_search(S, text, len, "b\nq");
+    }
+  }
+
+  // a large insertion makes a block that is cut up when built again
+  char* big = xmalloc(3 * TRIGRAM_BLOCK);
+  for (size_t i = 0; i < 3 * TRIGRAM_BLOCK; i++) big[i] = "qbc\n"[i % 4];
+  storage_move_to(S, 7);
+  storage_insert(S, big, 3 * TRIGRAM_BLOCK);
+  text = xrealloc(text, len + 3 * TRIGRAM_BLOCK);
+  memmove(text + 7 + 3 * TRIGRAM_BLOCK, text + 7, len - 7);
+  memcpy(text + 7, big, 3 * TRIGRAM_BLOCK);
+  len += 3 * TRIGRAM_BLOCK;
+  free(big);
+  while (!trigram_build(S->index, S, 2)) continue;
+  for (size_t b = 0; b < S->index->numblocks; b++) {
+    assert(S->index->blocks[b].len <= 2 * TRIGRAM_BLOCK);
+  }
+  for (size_t i = 0; i < numneedles; i++) check_search(S, text, len, needles[i]);
+
+  // deleting everything leaves one empty block
+  storage_delete_range(S, 0, len);
+  assert(S->index->numblocks == 1 && S->index->blocks[0].len == 0);
+  check_search(S, text, 0, "abc");
+  storage_insert(S, "qqqabc", 6);
+  check_search(S, "qqqabc", 6, "abc");
+
+  storage_free(S);
+  free(text);
+
+  printf("All test cases passed!\n");
+  return 0;
+}
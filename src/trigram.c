@@ -0,0 +1,294 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "lib/contracts.h"
+#include "lib/xalloc.h"
+#include "storage.h"
+#include "trigram.h"
+
+#define TRIGRAM_QUERY (64)         // most trigrams of a query looked up
+
+bool is_trigram(trigram* T, size_t len) {
+  if (T == NULL) return false;
+  if (T->blocks == NULL) return false;
+  if (T->numblocks == 0 || T->numblocks > T->blocklimit) return false;
+  size_t total = 0;
+  size_t unbuilt = 0;
+  for (size_t b = 0; b < T->numblocks; b++) {
+    struct trigram_block* B = &T->blocks[b];
+    if (B->len == 0 && T->numblocks > 1) return false;
+    if (B->built != (B->filter != NULL)) return false;
+    if (!B->built) unbuilt += 1;
+    total += B->len;
+  }
+  if (total != len) return false;
+  if (unbuilt != T->unbuilt) return false;
+  return true;
+}
+
+/* Bloom filters */
+
+// two bits of the filter for trigram t, from one multiplicative hash
+static void trigram_bits(uint32_t t, size_t* i, size_t* j) {
+  uint64_t h = (uint64_t)t * 0x9E3779B97F4A7C15ull;
+  *i = (size_t)(h >> 40) & (TRIGRAM_BITS - 1);
+  *j = (size_t)(h >> 20) & (TRIGRAM_BITS - 1);
+}
+
+static void block_add(struct trigram_block* B, uint32_t t) {
+  size_t i, j;
+  trigram_bits(t, &i, &j);
+  B->filter[i / 64] |= (uint64_t)1 << (i % 64);
+  B->filter[j / 64] |= (uint64_t)1 << (j % 64);
+}
+
+static bool block_has(struct trigram_block* B, uint32_t t) {
+  size_t i, j;
+  trigram_bits(t, &i, &j);
+  return (B->filter[i / 64] >> (i % 64) & 1) && (B->filter[j / 64] >> (j % 64) & 1);
+}
+
+/* blocks */
+
+// block holding offset, and its start in *start; the last block for
+// the end of the text
+static size_t trigram_find(trigram* T, size_t offset, size_t* start) {
+  size_t at = 0;
+  for (size_t b = 0; b + 1 < T->numblocks; b++) {
+    if (offset < at + T->blocks[b].len) {
+      *start = at;
+      return b;
+    }
+    at += T->blocks[b].len;
+  }
+  *start = at;
+  return T->numblocks - 1;
+}
+
+// room for count more blocks after block b
+static void trigram_open(trigram* T, size_t b, size_t count) {
+  if (T->numblocks + count > T->blocklimit) {
+    while (T->numblocks + count > T->blocklimit) T->blocklimit *= 2;
+    T->blocks = xrealloc(T->blocks, T->blocklimit * sizeof(struct trigram_block));
+  }
+  memmove(&T->blocks[b + 1 + count], &T->blocks[b + 1],
+          (T->numblocks - b - 1) * sizeof(struct trigram_block));
+  T->numblocks += count;
+}
+
+static void trigram_remove(trigram* T, size_t b) {
+  if (!T->blocks[b].built) T->unbuilt -= 1;
+  free(T->blocks[b].filter);
+  memmove(&T->blocks[b], &T->blocks[b + 1],
+          (T->numblocks - b - 1) * sizeof(struct trigram_block));
+  T->numblocks -= 1;
+}
+
+// add the trigrams starting in [from, to) to the filters of built blocks
+static void trigram_add(trigram* T, storage* S, size_t from, size_t to) {
+  // the backend is read directly: this runs inside storage_insert and
+  // storage_delete_range, and once per byte of every block built
+  size_t len = (*S->ops->len)(S->text);
+  if (len < 3) return;
+  if (to > len - 2) to = len - 2;
+  if (from >= to) return;
+
+  size_t blockstart;
+  size_t b = trigram_find(T, from, &blockstart);
+  size_t blockend = blockstart + T->blocks[b].len;
+
+  // a rolling trigram over the spans, pos is where it starts
+  uint32_t t = 0;
+  size_t seen = 0;
+  size_t offset = from;
+  size_t pos = from;
+  while (offset < to + 2) {
+    size_t n;
+    const char* span = (*S->ops->span)(S->text, offset, &n);
+    if (n > to + 2 - offset) n = to + 2 - offset;
+    offset += n;
+    for (size_t k = 0; k < n; k++) {
+      t = ((t << 8) | (unsigned char)span[k]) & 0xFFFFFF;
+      seen += 1;
+      if (seen < 3) continue;
+      while (pos >= blockend) {
+        b += 1;
+        blockstart = blockend;
+        blockend += T->blocks[b].len;
+      }
+      if (T->blocks[b].built) block_add(&T->blocks[b], t);
+      pos += 1;
+    }
+  }
+}
+
+trigram* trigram_new(storage* S) {
+  REQUIRES(is_storage(S));
+  size_t len = storage_len(S);
+  trigram* T = xmalloc(sizeof(trigram));
+  T->numblocks = len > 0 ? (len + TRIGRAM_BLOCK - 1) / TRIGRAM_BLOCK : 1;
+  T->blocklimit = T->numblocks;
+  T->blocks = xmalloc(T->blocklimit * sizeof(struct trigram_block));
+  for (size_t b = 0; b < T->numblocks; b++) {
+    size_t rest = len - b * TRIGRAM_BLOCK;
+    T->blocks[b].len = rest < TRIGRAM_BLOCK ? rest : TRIGRAM_BLOCK;
+    T->blocks[b].built = false;
+    T->blocks[b].filter = NULL;
+  }
+  T->unbuilt = T->numblocks;
+  ENSURES(is_trigram(T, len));
+  return T;
+}
+
+bool trigram_build(trigram* T, storage* S, size_t count) {
+  REQUIRES(is_storage(S) && S->index == T);
+  size_t start = 0;
+  for (size_t b = 0; b < T->numblocks && count > 0 && T->unbuilt > 0; b++) {
+    struct trigram_block* B = &T->blocks[b];
+    if (B->built) {
+      start += B->len;
+      continue;
+    }
+
+    // a block that edits made large is cut into blocks of the usual size
+    if (B->len > 2 * TRIGRAM_BLOCK) {
+      size_t len = B->len;
+      size_t pieces = (len + TRIGRAM_BLOCK - 1) / TRIGRAM_BLOCK;
+      trigram_open(T, b, pieces - 1);
+      for (size_t i = 0; i < pieces; i++) {
+        size_t rest = len - i * TRIGRAM_BLOCK;
+        T->blocks[b + i].len = rest < TRIGRAM_BLOCK ? rest : TRIGRAM_BLOCK;
+        T->blocks[b + i].built = false;
+        T->blocks[b + i].filter = NULL;
+      }
+      T->unbuilt += pieces - 1;
+      B = &T->blocks[b];
+    }
+
+    B->filter = xcalloc(TRIGRAM_BITS / 64, sizeof(uint64_t));
+    B->built = true;
+    T->unbuilt -= 1;
+    trigram_add(T, S, start, start + B->len);
+    start += B->len;
+    count -= 1;
+  }
+  ENSURES(is_trigram(T, storage_len(S)));
+  return T->unbuilt == 0;
+}
+
+void trigram_insert(trigram* T, storage* S, size_t offset, size_t n) {
+  REQUIRES(is_trigram(T, storage_len(S) - n));
+  if (n == 0) return;
+
+  size_t start;
+  size_t b = trigram_find(T, offset, &start);
+  struct trigram_block* B = &T->blocks[b];
+  B->len += n;
+  if (B->built && B->len > 2 * TRIGRAM_BLOCK) {
+    // built again later, cut to size
+    free(B->filter);
+    B->filter = NULL;
+    B->built = false;
+    T->unbuilt += 1;
+  }
+
+  // the new trigrams are those that overlap the inserted bytes, which
+  // all start in this block after the first two
+  trigram_add(T, S, offset >= 2 ? offset - 2 : 0, B->built ? offset + n : offset);
+  ENSURES(is_trigram(T, storage_len(S)));
+}
+
+void trigram_delete(trigram* T, storage* S, size_t start, size_t end) {
+  REQUIRES(start <= end && is_trigram(T, storage_len(S) + (end - start)));
+  if (start == end) return;
+
+  // shorten every block the range overlaps, dropping emptied ones
+  size_t at = 0;
+  size_t b = 0;
+  while (b < T->numblocks && at < end) {
+    struct trigram_block* B = &T->blocks[b];
+    size_t from = start > at ? start : at;
+    size_t to = end < at + B->len ? end : at + B->len;
+    at += B->len;
+    if (from < to) B->len -= to - from;
+    if (B->len == 0 && T->numblocks > 1) trigram_remove(T, b);
+    else b += 1;
+  }
+
+  // the only new trigrams are those across the join
+  trigram_add(T, S, start >= 2 ? start - 2 : 0, start);
+  ENSURES(is_trigram(T, storage_len(S)));
+}
+
+/* candidates */
+
+// whether a match of the query may start in block b, which starts at
+// start: every trigram must be in one of the blocks the match can reach
+static bool trigram_candidate(trigram* T, size_t b, size_t start,
+                              const uint32_t* trigrams, size_t count, size_t n) {
+  struct trigram_block* B = &T->blocks[b];
+  if (!B->built) return true;
+  if (!block_has(B, trigrams[0])) return false;
+
+  size_t reach = start + B->len + n - 2;  // trigrams start before this
+  for (size_t i = 1; i < count; i++) {
+    bool found = false;
+    size_t at = start;
+    for (size_t j = b; j < T->numblocks && at < reach && !found; j++) {
+      struct trigram_block* C = &T->blocks[j];
+      found = !C->built || block_has(C, trigrams[i]);
+      at += C->len;
+    }
+    if (!found) return false;
+  }
+  return true;
+}
+
+bool trigram_candidates(trigram* T, const char* needle, size_t n,
+                        size_t from, size_t to, size_t* start, size_t* end) {
+  REQUIRES(T != NULL);
+  REQUIRES(needle != NULL && n > 0);
+  REQUIRES(start != NULL && end != NULL);
+
+  size_t len = 0;
+  for (size_t b = 0; b < T->numblocks; b++) len += T->blocks[b].len;
+  if (to > len) to = len;
+  if (from >= to) return false;
+  if (n < 3) {
+    *start = from;
+    *end = to;
+    return true;
+  }
+
+  // the trigrams of the query, or the first of them for a long one
+  uint32_t trigrams[TRIGRAM_QUERY];
+  size_t count = n - 2 < TRIGRAM_QUERY ? n - 2 : TRIGRAM_QUERY;
+  for (size_t i = 0; i < count; i++) {
+    trigrams[i] = (uint32_t)(unsigned char)needle[i] << 16
+      | (uint32_t)(unsigned char)needle[i + 1] << 8
+      | (uint32_t)(unsigned char)needle[i + 2];
+  }
+
+  // the first candidate block that ends after from, joined with the
+  // candidates right after it
+  bool found = false;
+  size_t at = 0;
+  for (size_t b = 0; b < T->numblocks && at < to; b++) {
+    size_t blockend = at + T->blocks[b].len;
+    if (blockend > from && trigram_candidate(T, b, at, trigrams, count, n)) {
+      if (!found) *start = at > from ? at : from;
+      *end = blockend < to ? blockend : to;
+      found = true;
+    }
+    else if (found) break;
+    at = blockend;
+  }
+  return found;
+}
+
+void trigram_free(trigram* T) {
+  for (size_t b = 0; b < T->numblocks; b++) free(T->blocks[b].filter);
+  free(T->blocks);
+  free(T);
+}
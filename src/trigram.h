@@ -0,0 +1,59 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "storage.h"
+
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+#define TRIGRAM_BLOCK (1 << 18)    // bytes of text in a block when it is built
+#define TRIGRAM_BITS (1 << 18)     // bits of the filter of a block
+#define TRIGRAM_STEP (4)           // blocks built at a time, between keys
+
+/* A trigram index of a storage, for literal searches of three or more
+ * bytes. The text is cut into blocks, and each block has a Bloom
+ * filter of the trigrams (three byte sequences) starting in it. A
+ * block where some trigram of the query is missing cannot hold a
+ * match, so a search only scans the candidate blocks.
+ *
+ * Blocks are built a few at a time, and a block not built yet is
+ * always a candidate. Edits change the lengths of blocks and add the
+ * trigrams they create. Trigrams an edit destroys stay in the filter,
+ * which only costs a false candidate now and then.
+ */
+struct trigram_block {
+  size_t len;                // bytes of text in the block
+  bool built;                // filter has every trigram starting in it
+  uint64_t* filter;          // TRIGRAM_BITS bits, NULL if not built
+};
+
+struct trigram_header {
+  struct trigram_block* blocks;
+  size_t numblocks;          // number of blocks, > 0
+  size_t blocklimit;         // \length(blocks) = blocklimit
+  size_t unbuilt;            // blocks not built yet
+};
+typedef struct trigram_header trigram;
+
+bool is_trigram(trigram* T, size_t len);         // representation invariant,
+                                                 // for a text of len bytes
+
+trigram* trigram_new(storage* S);                // index of S with no block built,
+                                                 // S->index is set by the caller
+bool trigram_build(trigram* T, storage* S, size_t count);
+                                                 // build at most count blocks, true
+                                                 // once all of them are built
+void trigram_insert(trigram* T, storage* S, size_t offset, size_t n);
+                                                 // n bytes were inserted at offset,
+                                                 // T is not S->index meanwhile
+void trigram_delete(trigram* T, storage* S, size_t start, size_t end);
+                                                 // [start, end) was deleted, T is
+                                                 // not S->index meanwhile
+bool trigram_candidates(trigram* T, const char* needle, size_t n,
+                        size_t from, size_t to, size_t* start, size_t* end);
+                                                 // first range [*start, *end) in
+                                                 // [from, to) where needle[0, n)
+                                                 // may start, false if none
+void trigram_free(trigram* T);                   // free
+
+#endif
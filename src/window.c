@@ -13,31 +13,28 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <stdarg.h>
 #include "lib/contracts.h"
 #include "lib/xalloc.h"
-#include "gapbuf.h"
+#include "storage.h"
+#include "frame.h"
+#include "screen.h"
+#include "input.h"
+#include "finder.h"
+#include "fanout.h"
+#include "regexp.h"
+#include "replace.h"
+#include "trigram.h"
+#include "occur.h"
 #include "editor.h"
 #include "window.h"
 
 /* TO-DO: modify save file and quit to support multiple files */
 
-enum key {
-  ENTER_KEY = 13,
-  BACKSPACE = 127,
-  ARROW_LEFT = 1000,
-  ARROW_RIGHT,
-  ARROW_UP,
-  ARROW_DOWN,
-  DEL_KEY,
-  HOME_KEY,
-  END_KEY,
-  PAGE_UP,
-  PAGE_DOWN,
-};
-
 void die(window* W, const char* s) {
+  write(STDOUT_FILENO, "\x1b[?2004l", 8);
   write(STDOUT_FILENO, "\x1b[2J", 4);
   write(STDOUT_FILENO, "\x1b[H", 3);
   (void) W;
@@ -45,10 +42,23 @@ void die(window* W, const char* s) {
   exit(1);
 }
 
-window* window_new(void) {
+window* window_new(const storage_ops* ops) {
+  REQUIRES(ops != NULL);
   window* W = xmalloc(sizeof(window));
+  W->storage = ops;
+  W->syncOnSave = false;
+  W->indexFiles = false;
+  W->frame = frame_new(1 << 14);
+  W->line = frame_new(256);
+  W->input = input_new(STDIN_FILENO);
+  W->finder = finder_new();
+  W->badRegexp = NULL;
+  W->fanout = fanout_new(0);
+  W->hitedits = 0;
+  W->latency = latency_new();
+  W->showLatency = false;
   W->editorList = xmalloc(2 * sizeof(editor*));
-  W->editorList[0] = editor_new();
+  W->editorList[0] = editor_new_storage(W->storage);
   W->editorList[1] = NULL;
   W->editorLim = 2;
   W->editorLen = 1;
@@ -66,6 +76,7 @@ window* window_new(void) {
   W->messageTime = 0;
 
   // status bar / ui offset
+  W->screen = screen_new(W->screenrows, W->screencols);
   W->screenrows -= 3;
 
   return W;
@@ -85,15 +96,19 @@ void enableRawMode(window* W) {
   raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
   raw.c_cflag |= (CS8);
   raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
-  raw.c_cc[VMIN] = 0;
-  raw.c_cc[VTIME] = 1;
+  // input is only read once poll says it is there
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
 
   if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1) {
     die(W, "tcsetattr");
   }
+  // pastes come between markers instead of as typed keys
+  write(STDOUT_FILENO, "\x1b[?2004h", 8);
 }
 
 void disableRawMode(window* W) {
+  write(STDOUT_FILENO, "\x1b[?2004l", 8);
   if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &W->orig_terminal) == -1) {
     die(W, "tcsetattr");
   }
@@ -159,30 +174,53 @@ void scroll(window* W) {
 
 void refresh(window* W) {
   editor* E = W->editor;
+  frame* F = W->frame;
+  latency* T = W->latency;
 
+  uint64_t t = latency_now();
   scroll(W);
+  latency_since(T, LATENCY_SCROLL, t);
 
-  write(STDOUT_FILENO, "\x1b[?25l", 6);
-  write(STDOUT_FILENO, "\x1b[H", 3);
+  // hide the cursor while rows are redrawn, if any
+  frame_appends(F, "\x1b[?25l");
+  size_t hidden = F->len;
 
   render(W);
 
   size_t cursorrow = E->row - E->rowoff + 2;
   size_t cursorcol = E->rendercol - E->coloff + 1;
 
-  // Move cursor to correct position
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%zu;%zuH", cursorrow, cursorcol);
-  write(STDOUT_FILENO, buf, strlen(buf));
+  if (F->len == hidden) {
+    // nothing changed on screen
+    frame_truncate(F, 0);
+    screen_put_cursor(W->screen, F, cursorrow, cursorcol);
+  }
+  else {
+    screen_put_cursor(W->screen, F, cursorrow, cursorcol);
+    frame_appends(F, "\x1b[?25h");
+  }
+
+  // whole frame in one write
+  t = latency_now();
+  frame_flush(F, STDOUT_FILENO);
+  t = latency_since(T, LATENCY_WRITE, t);
+
+  // the keys handled since the last frame are on screen now
+  if (T->keystart != 0) {
+    latency_record(T, LATENCY_KEY, t - T->keystart);
+    T->keystart = 0;
+  }
+}
 
-  write(STDOUT_FILENO, "\x1b[?25h", 6);
+// hand the row composed in W->line to the screen, cols wide
+static void putRow(window* W, size_t row, size_t cols) {
+  frame* L = W->line;
+  screen_put_row(W->screen, W->frame, row, L->buf, L->len, cols);
+  frame_truncate(L, 0);
 }
 
 void renderFileBar(window* W) {
-  // move cursor to first row
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%zu;1H", (size_t)1);
-  write(STDOUT_FILENO, buf, strlen(buf));
+  frame* L = W->line;
 
   // first row to display file names
   char filenames[80];
@@ -194,212 +232,150 @@ void renderFileBar(window* W) {
                   E->filename != NULL ? E->filename: "[Untitled]");
     if (len > W->screencols - totalLen) len = W->screencols - totalLen;
     if (i == W->activeIndex) {
-      write(STDOUT_FILENO, "\x1b[7m", 4); // reverse color
+      frame_appends(L, "\x1b[7m"); // reverse color
     }
     else {
-      write(STDOUT_FILENO, "\x1b[;100m", 7); // grey background
+      frame_appends(L, "\x1b[;100m"); // grey background
     }
-    write(STDOUT_FILENO, filenames, len);
-    write(STDOUT_FILENO, "\x1b[m", 3); // reset color
+    frame_append(L, filenames, len);
+    frame_appends(L, "\x1b[m"); // reset color
     totalLen += len;
   }
-  write(STDOUT_FILENO, "\x1b[;100m", 7);
-  while (totalLen < W->screencols + 1) {
-    write(STDOUT_FILENO, " ", 1);
-    totalLen += 1;
-  }
-  write(STDOUT_FILENO, "\x1b[m", 3); // reset color
-  // write(STDOUT_FILENO, "\x1b[K", 3);
-  write(STDOUT_FILENO, "\n", 1);
+  frame_appends(L, "\x1b[;100m");
+  frame_fill(L, ' ', W->screencols - totalLen);
+  frame_appends(L, "\x1b[m"); // reset color
+  putRow(W, 1, W->screencols);
 }
 
 void renderText(window* W) {
-  // move cursor to second row
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%zu;1H", (size_t)2);
-  write(STDOUT_FILENO, buf, strlen(buf));
-
   editor* E = W->editor;
-  gapbuf* gb = E->buffer;
-  char* front = gb->front;
-  char* back = gb->back;
-  size_t frontlen = gb->frontlen;
-  size_t backlen = gb->backlen;
+  storage* S = E->buffer;
+  frame* L = W->line;
+  size_t len = storage_len(S);
+  size_t numrows = storage_numrows(S);
 
   // rowoff = first visible row
   // coloff = first visible col
   // rowoff + screenrows = first invisible row
   // coloff + screencols = first invisible col
-
-  // keep track of current row and col
-  char c;
-  size_t currow = 1;
-  size_t curcol = 0;
-
-  // render text in front of buffer
-  for (size_t i = 0; i < frontlen; i++) {
-    // if go out of bound, stop immediately
-    if (currow >= E->rowoff + W->screenrows) break;
-    // current char to render
-    c = front[i];
-
-    // if current char is newline
-    if (c == '\n') {
-      if (currow >= E->rowoff && currow < E->rowoff + W->screenrows) {
-        // don't clean line if cursor at end of terminal
-        // otherwise last character is cleaned
-        if (curcol < E->coloff + W->screencols - 1) {
-          write(STDOUT_FILENO, "\x1b[K", 3);
-        }
-        write(STDOUT_FILENO, "\n", 1);
-      }
-      currow += 1;
-      curcol = 0;
-      continue;
-    }
-
-    // if current char is tab
-    if (c == '\t') {
-      if (currow >= E->rowoff && currow < E->rowoff + W->screenrows
-        && curcol >= E->coloff && curcol < E->coloff + W->screencols
-      ) {
-        write(STDOUT_FILENO, " ", 1);
-        curcol += 1;
-        while (curcol % TAB_STOP != 0) {
-          if (curcol < E->coloff + W->screencols) write(STDOUT_FILENO, " ", 1);
-          curcol += 1;
-        }
-      }
-      else {
-        curcol += 1;
-        while (curcol % TAB_STOP != 0) {
-          curcol += 1;
-        }
-      }
-      continue;
-    }
-
-    // default case
-    if (currow >= E->rowoff && currow < E->rowoff + W->screenrows
-      && curcol >= E->coloff && curcol < E->coloff + W->screencols
-    ) {
-      write(STDOUT_FILENO, &c, 1);
-    }
-    curcol += 1;
-  }
-
-  // render text in back of buffer
-  for (size_t j = 0; j < backlen; j++) {
-    // if go out of bound, stop immediately
-    if (currow >= E->rowoff + W->screenrows) break;
-    // current char to render
-    c = back[backlen - j - 1];
-    
-    // if current char is newline
-    if (c == '\n') {
-      if (currow >= E->rowoff && currow < E->rowoff + W->screenrows) {
-        // don't clean line if cursor at end of terminal
-        // otherwise last character is cleaned
-        if (curcol < E->coloff + W->screencols) {
-          write(STDOUT_FILENO, "\x1b[K", 3);
-        }
-        write(STDOUT_FILENO, "\n", 1);
-      }
-      currow += 1;
-      curcol = 0;
-      continue;
-    }
-
-    // if current char is tab
-    if (c == '\t') {
-      if (currow >= E->rowoff && currow < E->rowoff + W->screenrows
-        && curcol >= E->coloff && curcol < E->coloff + W->screencols
-      ) {
-        write(STDOUT_FILENO, " ", 1);
-        curcol += 1;
-        while (curcol % TAB_STOP != 0) {
-          if (curcol < E->coloff + W->screencols) write(STDOUT_FILENO, " ", 1);
-          curcol += 1;
+  // text row r is shown on screen row r - rowoff + 2
+
+  // only the visible rows are read, each from its line start
+  size_t currow = E->rowoff;
+  while (currow < E->rowoff + W->screenrows && currow <= numrows) {
+    size_t offset = storage_line_start(S, currow);
+    size_t end = currow < numrows ? storage_line_start(S, currow + 1) - 1 : len;
+    size_t curcol = 0;
+
+    // render the row span by span, up to the first invisible col
+    size_t spanlen;
+    const char* span;
+    while (curcol < E->coloff + W->screencols
+           && (span = storage_next_span(S, &offset, end, &spanlen)) != NULL) {
+      for (size_t i = 0; i < spanlen && curcol < E->coloff + W->screencols; i++) {
+        // a tab is spaces up to the next tab stop
+        char c = span[i];
+        size_t width = 1;
+        if (c == '\t') {
+          width = TAB_STOP - curcol % TAB_STOP;
+          c = ' ';
         }
-      }
-      else {
-        curcol += 1;
-        while (curcol % TAB_STOP != 0) {
+        for (size_t j = 0; j < width; j++) {
+          if (curcol >= E->coloff && curcol < E->coloff + W->screencols) {
+            frame_appendc(L, c);
+          }
           curcol += 1;
         }
       }
-      continue;
     }
-    
-    // default case
-    if (currow >= E->rowoff && currow < E->rowoff + W->screenrows
-      && curcol >= E->coloff && curcol < E->coloff + W->screencols
-    ) {
-      write(STDOUT_FILENO, &c, 1);
-    }
-    curcol += 1;
-  }
-
-  // clear line after render all text
-  // don't clean line if cursor at end of terminal
-  // otherwise last character is cleaned
-  if (curcol < E->coloff + W->screencols - 1) {
-    write(STDOUT_FILENO, "\x1b[K", 3);
+    putRow(W, currow - E->rowoff + 2, screen_width(L->buf, L->len));
+    currow += 1;
   }
 
-  // if more rows empty after rendering, 
+  // if more rows empty after rendering,
   // draw tilde on each empty row
-  while (currow + 1 < E->rowoff + W->screenrows) {
-    write(STDOUT_FILENO, "\x1b[K", 3);
-    write(STDOUT_FILENO, "\n", 1);
-    write(STDOUT_FILENO, "~", 1);
-    write(STDOUT_FILENO, "\x1b[K", 3);
+  while (currow < E->rowoff + W->screenrows) {
+    frame_appendc(L, '~');
+    putRow(W, currow - E->rowoff + 2, 1);
     currow += 1;
   }
 }
 
 void renderStatusBar(window* W) {
   editor* E = W->editor;
-
-  // move cursor to second last row
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%zu;1H", W->screenrows + 2);
-  write(STDOUT_FILENO, buf, strlen(buf));
+  frame* L = W->line;
 
   // second last row to display file status
   char status[80], rstatus[80];
   size_t len, rlen;
-  len = snprintf(status, sizeof(status), 
+  len = snprintf(status, sizeof(status),
                 "%.20s - %zu lines %s",
                 E->filename != NULL ? E->filename: "[Untitled]",
                 E->numrows,
                 E->dirty != 0 ? "(modified)" : "");
   if (len > W->screencols) len = W->screencols;
-  
-  rlen = snprintf(rstatus, sizeof(rstatus),
-                  "Position (%zu,%zu)", E->row, E->col);
 
-  write(STDOUT_FILENO, "\x1b[7m", 4); // reverse color
-  write(STDOUT_FILENO, status, len);
-  for (size_t i = 0; i < W->screencols - len - rlen; i++) {
-    write(STDOUT_FILENO, " ", 1);
+  if (W->showLatency) {
+    char p50[16], p99[16], max[16];
+    latency* T = W->latency;
+    latency_format(latency_percentile(T, LATENCY_KEY, 50), p50, sizeof(p50));
+    latency_format(latency_percentile(T, LATENCY_KEY, 99), p99, sizeof(p99));
+    latency_format(T->stages[LATENCY_KEY].max, max, sizeof(max));
+    rlen = snprintf(rstatus, sizeof(rstatus),
+                    "Key p50 %s p99 %s max %s", p50, p99, max);
   }
-  write(STDOUT_FILENO, rstatus, rlen);
-  write(STDOUT_FILENO, "\x1b[m", 3); // reset color
+  else {
+    rlen = snprintf(rstatus, sizeof(rstatus),
+                    "Position (%zu,%zu)", E->row, E->col);
+  }
+  if (rlen > W->screencols - len) rlen = W->screencols - len;
+
+  frame_appends(L, "\x1b[7m"); // reverse color
+  frame_append(L, status, len);
+  frame_fill(L, ' ', W->screencols - len - rlen);
+  frame_append(L, rstatus, rlen);
+  frame_appends(L, "\x1b[m"); // reset color
+  putRow(W, W->screenrows + 2, W->screencols);
 }
 
 void renderMessageBar(window* W) {
-  // move cursor to last row
-  char buf[32];
-  snprintf(buf, sizeof(buf), "\x1b[%zu;1H", W->screenrows + 3);
-  write(STDOUT_FILENO, buf, strlen(buf));
+  frame* L = W->line;
+
+  // match count of a search, at the right end
+  char count[64];
+  size_t countlen = 0;
+  finder* F = W->finder;
+  if (F->S != NULL) {
+    finder_lock(F);
+    size_t k = finder_index(F, storage_cursor(W->editor->buffer));
+    size_t total = F->total;
+    bool done = F->done;
+    finder_unlock(F);
+    const char* more = done ? "" : "+";
+    if (k > 0) snprintf(count, sizeof(count), "match %zu of %zu%s", k, total, more);
+    else if (total == 0 && done) snprintf(count, sizeof(count), "no matches");
+    else snprintf(count, sizeof(count), "%zu%s matches", total, more);
+    countlen = strlen(count);
+    if (countlen + 1 > W->screencols) countlen = 0;
+  }
+  else if (W->badRegexp != NULL) {
+    snprintf(count, sizeof(count), "Bad regexp: %s", W->badRegexp);
+    countlen = strlen(count);
+    if (countlen + 1 > W->screencols) countlen = 0;
+  }
 
+  // last row to display the message
   size_t msglen = strlen(W->message);
-  if (msglen > W->screencols) msglen = W->screencols;
+  size_t room = countlen > 0 ? W->screencols - countlen - 1 : W->screencols;
+  if (msglen > room) msglen = room;
   if (msglen != 0 && time(NULL) - W->messageTime < MESSAGE_TIME) {
-    write(STDOUT_FILENO, W->message, msglen);
+    frame_append(L, W->message, msglen);
+  }
+  if (countlen > 0) {
+    frame_fill(L, ' ', W->screencols - countlen - L->len);
+    frame_append(L, count, countlen);
   }
-  write(STDOUT_FILENO, "\x1b[K", 3);
+  putRow(W, W->screenrows + 3, screen_width(L->buf, L->len));
 }
 
 void setMessage(window* W, const char* fmt, ...) {
@@ -408,74 +384,43 @@ void setMessage(window* W, const char* fmt, ...) {
   vsnprintf(W->message, sizeof(W->message), fmt, ap);
   va_end(ap);
   W->messageTime = time(NULL);
+  // redraw without the message once it expires
+  input_timer(W->input, MESSAGE_TIME * 1000, MESSAGE_TIMER);
 }
 
 void render(window* W) {
+  latency* T = W->latency;
+  uint64_t t = latency_now();
   renderFileBar(W);
+  t = latency_since(T, LATENCY_FILEBAR, t);
   renderText(W);
+  t = latency_since(T, LATENCY_TEXT, t);
   renderStatusBar(W);
+  t = latency_since(T, LATENCY_STATUSBAR, t);
   renderMessageBar(W);
+  latency_since(T, LATENCY_MESSAGEBAR, t);
+}
+
+// keys the editor sends itself, which no one waits for
+static bool isTimer(int c) {
+  return c == MESSAGE_TIMER || c == FIND_TIMER || c == INDEX_TIMER;
 }
 
 int readKey(window* W) {
-  int nread;
-  char c;
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN) die(W, "read");
-  }
-
-  if (c == '\x1b') {
-    // If start with <esc>, read more chars
-    // for arrows keys and page up/down keys
-    char seq[3];
-    if (read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
-    if (read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
-
-    if (seq[0] == '[') {
-      // Page Up and Page Down Key
-      // Page Up <esc>[5~
-      // Page Up <esc>[6~
-      if (seq[1] >= '0' && seq[1] <= '9') {
-        if (read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
-        if (seq[2] == '~') {
-          switch (seq[1]) {
-            case '1': return HOME_KEY;
-            case '3': return DEL_KEY;
-            case '4': return END_KEY;
-            case '5': return PAGE_UP;
-            case '6': return PAGE_DOWN;
-            case '7': return HOME_KEY;
-            case '8': return END_KEY;
-          }
-        }
-      }
-      else {
-        // Arrow Keys
-        // Up <esc>[A
-        // Down <esc>[B
-        // Right <esc>[C
-        // Left <esc>[D
-        switch (seq[1]) {
-          case 'A': return ARROW_UP;
-          case 'B': return ARROW_DOWN;
-          case 'C': return ARROW_RIGHT;
-          case 'D': return ARROW_LEFT;
-          case 'H': return HOME_KEY;
-          case 'F': return END_KEY;
-        }
-      }
-    }
-    else if (seq[0] == 'O') {
-      switch (seq[1]) {
-        case 'H': return HOME_KEY;
-        case 'F': return END_KEY;
-      }
-    }
-    return '\x1b';
-  } 
-  else {
-    return c;
+  // sleeps until a key arrives or a timer fires, then times decoding it
+  int c;
+  uint64_t start;
+  do {
+    while (!input_ready(W->input, -1)) {}
+    start = latency_now();
+    c = input_key(W->input, -1);
+  } while (c == INPUT_NONE);
+  if (c == INPUT_ERROR) die(W, "read");
+  if (!isTimer(c)) {
+    latency_since(W->latency, LATENCY_INPUT, start);
+    if (W->latency->keystart == 0) W->latency->keystart = start;
   }
+  return c;
 }
 
 void moveCursor(window* W, int key) {
@@ -539,9 +484,51 @@ void movePage(window* W, int key) {
   }
 }
 
+// text of a bracketed paste, with terminal line ends as \n
+static char* readPaste(window* W, size_t* n) {
+  char* s = input_paste(W->input, n);
+  size_t len = 0;
+  for (size_t i = 0; i < *n; i++) {
+    if (s[i] == '\r') {
+      s[len] = '\n';
+      if (i + 1 < *n && s[i + 1] == '\n') i += 1;
+    }
+    else {
+      s[len] = s[i];
+    }
+    len += 1;
+  }
+  *n = len;
+  return s;
+}
+
+// whether the key being processed opened a prompt, which then waited
+// for more keys
+static bool prompted = false;
+
+// whether E shows an occur view, which is read-only
+static bool isView(editor* E) {
+  return E->buffer->ops == &occur_storage;
+}
+
+static bool readOnly(window* W) {
+  if (!isView(W->editor)) return false;
+  setMessage(W, "Occur view is read-only, Enter goes to the line");
+  return true;
+}
+
+// views changed with their sources, their editors catch up
+static void syncViews(window* W) {
+  for (size_t i = 0; i < W->editorLen; i++) {
+    if (isView(W->editorList[i])) editor_sync(W->editorList[i]);
+  }
+}
+
 void processKey(window* W, bool* go) {
   editor* E = W->editor;
   int c = readKey(W);
+  uint64_t start = latency_now();
+  prompted = false;
 
   switch (c) {
     case CTRL_KEY('o'): {
@@ -585,6 +572,7 @@ void processKey(window* W, bool* go) {
     }
 
     case CTRL_KEY('s'): {
+      if (readOnly(W)) break;
       saveFile(W);
       break;
     }
@@ -615,32 +603,124 @@ void processKey(window* W, bool* go) {
       break;
     }
 
+    case CTRL_KEY('r'): {
+      findRegexp(W);
+      break;
+    }
+
+    case CTRL_KEY('g'): {
+      searchAll(W);
+      break;
+    }
+
+    case CTRL_KEY('n'):
+    case CTRL_KEY('p'): {
+      moveHit(W, c);
+      break;
+    }
+
+    case CTRL_KEY('t'): {
+      if (readOnly(W)) break;
+      replaceAll(W, false);
+      break;
+    }
+
+    case CTRL_KEY('y'): {
+      if (readOnly(W)) break;
+      replaceAll(W, true);
+      break;
+    }
+
+    case CTRL_KEY('v'): {
+      showOccur(W);
+      break;
+    }
+
     case BACKSPACE:
     case CTRL_KEY('h'):
     case DEL_KEY: {
+      if (readOnly(W)) break;
       if (c == DEL_KEY) moveCursor(W, ARROW_RIGHT);
       editor_delete(E);
       break;
     }
 
     case ENTER_KEY: {
+      if (isView(E)) {
+        gotoSource(W);
+        break;
+      }
       editor_insert(E, '\n');
       break;
     }
 
+    case PASTE_KEY: {
+      // the whole paste is one insertion
+      size_t n;
+      char* text = readPaste(W, &n);
+      if (readOnly(W)) {
+        free(text);
+        break;
+      }
+      editor_insert_n(E, text, n);
+      free(text);
+      // a large paste leaves a block of the index to build again
+      if (E->buffer->index != NULL && E->buffer->index->unbuilt > 0) {
+        input_timer(W->input, INDEX_TIME, INDEX_TIMER);
+      }
+      break;
+    }
+
+    case MESSAGE_TIMER: {
+      W->message[0] = '\0';
+      break;
+    }
+
+    case INDEX_TIMER: {
+      buildIndexes(W);
+      break;
+    }
+
+    case CTRL_KEY('b'): {
+      W->showLatency = !W->showLatency;
+      break;
+    }
+
     case CTRL_KEY('l'):
+    case FIND_TIMER:
     case '\x1b': {
       break;
     }
     
     default: {
+      if (readOnly(W)) break;
       editor_insert(E, c);
       break;
     }
   }
+  syncViews(W);
+  if (!prompted && !isTimer(c)) latency_since(W->latency, LATENCY_EDIT, start);
 }
 
-char* promptUser(window* W, char* prompt, callback_fn* callback) {
+void processInput(window* W, bool* go) {
+  processKey(W, go);
+
+  // apply the keys that are already waiting before the next refresh,
+  // but still refresh every FRAME_TIME ms while input keeps coming
+  struct timespec start, now;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  while (*go && input_pending(W->input)) {
+    processKey(W, go);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = (now.tv_sec - start.tv_sec) * 1000
+                 + (now.tv_nsec - start.tv_nsec) / 1000000;
+    if (elapsed >= FRAME_TIME) break;
+  }
+}
+
+// the keys of promptUser, *indexing set if index building was due
+static char* promptKeys(window* W, char* prompt, callback_fn* callback, bool* indexing) {
+  prompted = true;
   size_t bufsize = 128;
   size_t buflen = 0;
   char* buf = xmalloc(bufsize * sizeof(char));
@@ -652,6 +732,34 @@ char* promptUser(window* W, char* prompt, callback_fn* callback) {
     refresh(W);
     int c = readKey(W);
 
+    // the prompt stays while it is open
+    if (c == MESSAGE_TIMER) continue;
+
+    // indexes wait while a prompt is open, a search may be reading them
+    if (c == INDEX_TIMER) {
+      *indexing = true;
+      continue;
+    }
+
+    // pasted text, without line ends
+    if (c == PASTE_KEY) {
+      size_t n;
+      char* text = readPaste(W, &n);
+      for (size_t i = 0; i < n; i++) {
+        if (iscntrl((unsigned char)text[i]) || (unsigned char)text[i] >= 128) continue;
+        if (buflen == bufsize - 1) {
+          bufsize *= 2;
+          buf = xrealloc(buf, bufsize);
+        }
+        buf[buflen] = text[i];
+        buflen += 1;
+        buf[buflen] = '\0';
+      }
+      free(text);
+      if (callback != NULL) (*callback)(W, buf, c);
+      continue;
+    }
+
     // backspace to delete
     if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE) {
       if (buflen != 0) {
@@ -666,6 +774,7 @@ char* promptUser(window* W, char* prompt, callback_fn* callback) {
 
       if (buflen == 0) {
         setMessage(W, "");
+        if (callback != NULL) (*callback)(W, buf, c);
         free(buf);
         return NULL;
       }
@@ -702,105 +811,390 @@ char* promptUser(window* W, char* prompt, callback_fn* callback) {
   return buf;
 }
 
+char* promptUser(window* W, char* prompt, callback_fn* callback) {
+  // building goes on once the prompt is closed, rather than waking it
+  // every INDEX_TIME ms
+  bool indexing = false;
+  char* query = promptKeys(W, prompt, callback, &indexing);
+  if (indexing) input_timer(W->input, INDEX_TIME, INDEX_TIMER);
+  return query;
+}
+
 void findCallback(window* W, char* query, int key) {
-  static size_t lastMatch = 0; // store frontlen of lastMatch
+  static size_t from = 0;       // offset where the next match starts at or after
+  static bool pending = false;  // the cursor still has to move to that match
+  static char* started = NULL;  // query last started, NULL if none
 
+  finder* F = W->finder;
+  editor* E = W->editor;
   if (key == ENTER_KEY || key == '\x1b') {
-    lastMatch = 0;
+    // the text may only change once the worker is done with it
+    finder_stop(F);
+    from = 0;
+    pending = false;
+    free(started);
+    started = NULL;
     return;
   }
-  else if (key != ARROW_RIGHT && key != ARROW_DOWN) {
-    lastMatch = 0;
+  else if (key == ARROW_RIGHT || key == ARROW_DOWN) {
+    pending = true;
+  }
+  else {
+    const char* q = query != NULL ? query : "";
+    if (started == NULL || strcmp(started, q) != 0) {
+      // the query changed, search for it in the background; other keys
+      // keep the scan and the cursor at the current match
+      from = 0;
+      pending = false;
+      free(started);
+      started = xmalloc(strlen(q) + 1);
+      strcpy(started, q);
+      if (q[0] == '\0') {
+        finder_stop(F);
+        return;
+      }
+      finder_start(F, E->buffer, q, strlen(q));
+      pending = true;
+    }
   }
 
-  if (query == NULL) return;
+  if (F->S == NULL) return;
+
+  // move to the match once the worker has found it, wrapping around at the end
+  finder_lock(F);
+  size_t match;
+  bool found = finder_next(F, from, &match);
+  if (!found && F->done) found = finder_next(F, 0, &match);
+  if (pending && found) {
+    editor_goto(E, match);
+    from = match + 1;
+    pending = false;
+  }
+  else if (F->done) {
+    pending = false;
+  }
+  bool done = F->done;
+  finder_unlock(F);
+
+  // keep the match count moving while the worker scans
+  if (!done) input_timer(W->input, FIND_TIME, FIND_TIMER);
+}
 
+void find(window* W) {
   editor* E = W->editor;
-  char* s = gapbuf_str(E->buffer);
-  char* match;
-  match = strstr(s + lastMatch + strlen(query), query);
-  if (match != NULL) {
-    lastMatch = match - s;
+  size_t saved_cursor = storage_cursor(E->buffer);
+
+  char* query = promptUser(W, "Search: %s (Use Esc/Enter/Right)", findCallback);
+  if (query != NULL) {
+    free(query);
   }
   else {
-    match = strstr(s, query);
+    editor_goto(E, saved_cursor);
   }
-  if (match != NULL) {
-    size_t target_frontlen = match - s;
-    while (E->buffer->frontlen > target_frontlen) editor_backward(E);
-    while (E->buffer->frontlen < target_frontlen) editor_forward(E);
+}
+
+// ^R keeps no match count, since the regexp is scanned for on this
+// thread rather than by the finder: a pattern that matches nothing in
+// a huge file holds up the prompt for one scan of it
+void regexpCallback(window* W, char* query, int key) {
+  static size_t from = 0;         // offset where the next search starts
+  static regexp* X = NULL;        // query compiled, NULL if not valid
+  static char* compiled = NULL;   // query last compiled, NULL if none
+
+  if (key == ENTER_KEY || key == '\x1b') {
+    from = 0;
+    if (X != NULL) regexp_free(X);
+    X = NULL;
+    free(compiled);
+    compiled = NULL;
+    W->badRegexp = NULL;
+    return;
+  }
+
+  const char* q = query != NULL ? query : "";
+  if (compiled == NULL || strcmp(compiled, q) != 0) {
+    // the query changed, compile it again and search from the start
+    from = 0;
+    if (X != NULL) regexp_free(X);
+    X = NULL;
+    free(compiled);
+    compiled = xmalloc(strlen(q) + 1);
+    strcpy(compiled, q);
+    W->badRegexp = NULL;
+    const char* error;
+    if (q[0] != '\0') {
+      X = regexp_new(q, strlen(q), &error);
+      if (X == NULL) W->badRegexp = error;
+    }
   }
+  else if (key != ARROW_RIGHT && key != ARROW_DOWN) {
+    // other keys leave the cursor at the current match
+    return;
+  }
+
+  if (X == NULL) return;
 
-  free(s);
+  // scan the storage in place, wrapping around at the end
+  editor* E = W->editor;
+  size_t len = storage_len(E->buffer);
+  size_t start, end;
+  if (from > len) from = 0;
+  if (regexp_forward(X, E->buffer, from, &start, &end)
+      || regexp_forward(X, E->buffer, 0, &start, &end)) {
+    from = start + 1;
+    editor_goto(E, start);
+  }
 }
 
-void find(window* W) {
+void findRegexp(window* W) {
   editor* E = W->editor;
-  size_t saved_frontlen = E->buffer->frontlen;
+  size_t saved_cursor = storage_cursor(E->buffer);
 
-  char* query = promptUser(W, "Search: %s (Use Esc/Enter/Right)", findCallback);
+  char* query = promptUser(W, "Regexp: %s (Use Esc/Enter/Right)", regexpCallback);
   if (query != NULL) {
     free(query);
   }
   else {
-    while (E->buffer->frontlen > saved_frontlen) editor_backward(E);
-    while (E->buffer->frontlen < saved_frontlen) editor_forward(E);
+    editor_goto(E, saved_cursor);
+  }
+}
+
+// edits of every open file, which only grow while no file is closed
+static unsigned long allEdits(window* W) {
+  unsigned long edits = 0;
+  for (size_t i = 0; i < W->editorLen; i++) edits += W->editorList[i]->edits;
+  return edits;
+}
+
+// search every open file at once on the pool of threads
+static void searchFiles(window* W, const char* query, size_t n) {
+  storage** files = xmalloc(W->editorLen * sizeof(storage*));
+  for (size_t i = 0; i < W->editorLen; i++) files[i] = W->editorList[i]->buffer;
+  fanout_search(W->fanout, files, W->editorLen, query, n);
+  free(files);
+  W->hitedits = allEdits(W);
+}
+
+// make the hit current, switching to its file
+static void gotoHit(window* W, size_t hit) {
+  fanout* P = W->fanout;
+  W->activeIndex = P->hits[hit].file;
+  W->editor = W->editorList[W->activeIndex];
+  editor_goto(W->editor, P->hits[hit].offset);
+  setMessage(W, "Hit %zu of %zu%s: %s:%zu", hit + 1, P->numhits,
+             P->total > P->numhits ? "+" : "",
+             W->editor->filename != NULL ? W->editor->filename : "[No Name]",
+             W->editor->row);
+}
+
+void searchAll(window* W) {
+  char* query = promptUser(W, "Search all files: %s", NULL);
+  if (query == NULL) return;
+  searchFiles(W, query, strlen(query));
+  free(query);
+
+  fanout* P = W->fanout;
+  if (P->numhits == 0) {
+    setMessage(W, "No matches in %zu file%s", W->editorLen, W->editorLen == 1 ? "" : "s");
+    return;
+  }
+  size_t hit = fanout_find(P, W->activeIndex, storage_cursor(W->editor->buffer));
+  gotoHit(W, hit < P->numhits ? hit : 0);
+}
+
+void moveHit(window* W, int key) {
+  fanout* P = W->fanout;
+  if (P->querylen == 0) {
+    setMessage(W, "No search of all files yet, use ^G");
+    return;
+  }
+
+  // offsets are stale once a file changed, then search again
+  if (allEdits(W) != W->hitedits) searchFiles(W, P->query, P->querylen);
+  if (P->numhits == 0) {
+    setMessage(W, "No matches in %zu file%s", W->editorLen, W->editorLen == 1 ? "" : "s");
+    return;
+  }
+
+  // from the cursor, so switching files moves through the list too
+  size_t cursor = storage_cursor(W->editor->buffer);
+  size_t hit;
+  if (key == CTRL_KEY('n')) {
+    hit = fanout_find(P, W->activeIndex, cursor + 1);
+    if (hit == P->numhits) hit = 0;
+  }
+  else {
+    hit = fanout_find(P, W->activeIndex, cursor);
+    hit = hit > 0 ? hit - 1 : P->numhits - 1;
   }
+  gotoHit(W, hit);
+}
+
+// whether the last replacement prompt was confirmed, as an empty
+// replacement returns NULL like a cancelled one
+static bool withConfirmed = false;
+
+void withCallback(window* W, char* query, int key) {
+  (void) W;
+  (void) query;
+  withConfirmed = key == ENTER_KEY;
+}
+
+void replaceAll(window* W, bool pattern) {
+  editor* E = W->editor;
+  char* query = promptUser(W, pattern ? "Replace regexp: %s" : "Replace: %s", NULL);
+  if (query == NULL) return;
+
+  regexp* X = NULL;
+  if (pattern) {
+    const char* error;
+    X = regexp_new(query, strlen(query), &error);
+    if (X == NULL) {
+      setMessage(W, "Bad regexp: %s", error);
+      free(query);
+      return;
+    }
+  }
+
+  withConfirmed = false;
+  char* with = promptUser(W, "With: %s (Enter to replace all)", withCallback);
+  if (with == NULL && !withConfirmed) {
+    if (X != NULL) regexp_free(X);
+    free(query);
+    return;
+  }
+  size_t n = with != NULL ? strlen(with) : 0;
+
+  // every match in one scan, then the new text in one pass
+  replace* P = replace_new();
+  if (X != NULL) replace_regexp(P, E->buffer, X);
+  else replace_literal(P, E->buffer, query, strlen(query));
+  if (P->count > 0) {
+    size_t offset = replace_offset(P, storage_cursor(E->buffer), n);
+    editor_replace_buffer(E, replace_build(P, E->buffer, with, n), offset);
+    indexFile(W, E);
+  }
+  setMessage(W, "Replaced %zu occurrence%s", P->count, P->count == 1 ? "" : "s");
+
+  replace_free(P);
+  if (X != NULL) regexp_free(X);
+  if (with != NULL) free(with);
+  free(query);
+}
+
+// add E after the open editors and make it active
+static void addEditor(window* W, editor* E) {
+  if (W->editorLen + 1 >= W->editorLim) {
+    W->editorLim = 2 * W->editorLim;
+    editor** newList = xcalloc(W->editorLim, sizeof(editor*));
+    for (size_t i = 0; i < W->editorLen; i++) {
+      newList[i] = W->editorList[i];
+    }
+    free(W->editorList);
+    W->editorList = newList;
+  }
+  W->editorList[W->editorLen] = E;
+  W->editor = E;
+  W->activeIndex = W->editorLen;
+  W->editorLen += 1;
+}
+
+void showOccur(window* W) {
+  editor* E = W->editor;
+  if (isView(E)) {
+    setMessage(W, "Already an occur view");
+    return;
+  }
+  char* query = promptUser(W, "Occur: %s (Enter to show the lines)", NULL);
+  if (query == NULL) return;
+
+  // a file has one view, showing the last query
+  storage* V = occur_new(E->buffer, query, strlen(query));
+  char* name = xmalloc(strlen(query) + sizeof("occur: "));
+  strcpy(name, "occur: ");
+  strcat(name, query);
+  free(query);
+  for (size_t i = 0; i < W->editorLen; i++) {
+    editor* D = W->editorList[i];
+    if (isView(D) && ((occur*)D->buffer->text)->source == E->buffer) {
+      editor_replace_buffer(D, V, 0);
+      D->dirty = 0;
+      free(D->filename);
+      D->filename = name;
+      W->activeIndex = i;
+      W->editor = D;
+      setMessage(W, "%zu lines", ((occur*)V->text)->count);
+      return;
+    }
+  }
+
+  editor* D = editor_new_storage(W->storage);
+  editor_replace_buffer(D, V, 0);
+  D->dirty = 0;
+  D->filename = name;
+  addEditor(W, D);
+  setMessage(W, "%zu lines", ((occur*)V->text)->count);
+}
+
+void gotoSource(window* W) {
+  occur* V = W->editor->buffer->text;
+  size_t offset = occur_source(W->editor->buffer, storage_cursor(W->editor->buffer));
+  for (size_t i = 0; i < W->editorLen; i++) {
+    if (V->source != NULL && W->editorList[i]->buffer == V->source) {
+      W->activeIndex = i;
+      W->editor = W->editorList[i];
+      editor_goto(W->editor, offset);
+      return;
+    }
+  }
+  setMessage(W, "The file of this view was closed");
 }
 
 void openFile(window* W, char* filename) {
   editor* E = W->editor;
 
   // if current editor is not empty, open a new editor
-  char* s = gapbuf_str(E->buffer);
-  if (strcmp(s, "") != 0) {
-    if (W->editorLen + 1 >= W->editorLim) {
-      W->editorLim = 2 * W->editorLim;
-      editor** newList = xcalloc(W->editorLim, sizeof(editor*));
-      for (size_t i = 0; i < W->editorLen; i++) {
-        newList[i] = W->editorList[i];
-      }
-      free(W->editorList);
-      W->editorList = newList;
-    }
-    W->editorList[W->editorLen] = editor_new();
-    W->editor = W->editorList[W->editorLen];
-    W->activeIndex = W->editorLen;
-    W->editorLen += 1;
+  if (storage_len(E->buffer) != 0 || E->filename != NULL) {
+    addEditor(W, editor_new_storage(W->storage));
   }
-  free(s);
 
   E = W->editor;
 
   if (filename != NULL) {
-    // get all text in file into buffer
-    FILE* fp = fopen(filename, "r");
-    if (fp == NULL) {
-      fp = fopen(filename, "w");
-      fclose(fp);
-      fp = fopen(filename, "r");
-    }
-    if (fp == NULL) {
-      die(W, "fopen");
+    // get all text in file into buffer, creating the file if needed
+    int fd = open(filename, O_RDONLY | O_CREAT, 0644);
+    if (fd == -1) {
+      die(W, "open");
     }
     
     E->filename = filename;
 
-    char c;
-    size_t count = 0;
-    while((c = fgetc(fp)) != EOF) {
-      count += 1;
-      editor_insert(E, c);
-    }
-    fclose(fp);
-
-    // move cursor to start of file
-    for (size_t i = 0; i < count; i++) {
-      editor_backward(E);
+    if (!editor_load(E, fd)) {
+      die(W, "read");
     }
+    close(fd);
   }
 
   E->dirty = 0;
+  indexFile(W, E);
+}
+
+void indexFile(window* W, editor* E) {
+  if (!W->indexFiles || E->buffer->index != NULL) return;
+  E->buffer->index = trigram_new(E->buffer);
+  input_timer(W->input, INDEX_TIME, INDEX_TIMER);
+}
+
+void buildIndexes(window* W) {
+  // a few blocks of the first file not fully indexed, between keys
+  for (size_t i = 0; i < W->editorLen; i++) {
+    storage* S = W->editorList[i]->buffer;
+    if (S->index != NULL && S->index->unbuilt > 0) {
+      trigram_build(S->index, S, TRIGRAM_STEP);
+      input_timer(W->input, INDEX_TIME, INDEX_TIMER);
+      return;
+    }
+  }
 }
 
 void closeFile(window* W, bool* go) {
@@ -818,10 +1212,14 @@ void closeFile(window* W, bool* go) {
   }
   W->editorList[W->editorLen - 1] = NULL;
   W->editorLen -= 1;
+  // hits name files by their place in the list
+  fanout_clear(W->fanout);
+  syncViews(W);
   if (W->editorLen == 0) {
     *go = false;
     write(STDOUT_FILENO, "\x1b[2J", 4);
     write(STDOUT_FILENO, "\x1b[H", 3);
+    screen_invalidate(W->screen);
     return;
   }
   if (W->activeIndex >= W->editorLen) {
@@ -830,6 +1228,65 @@ void closeFile(window* W, bool* go) {
   W->editor = W->editorList[W->activeIndex];
 }
 
+// write the text over path itself, which keeps its inode, owner and
+// other links. A storage that still reads from the file it loaded is
+// copied first and replaces the old one, whose mapping now shows the
+// new file.
+static bool saveInPlace(window* W, const char* path) {
+  editor* E = W->editor;
+  storage* S = E->buffer;
+  storage* T = NULL;
+  if (S->ops->mapped) {
+    T = storage_new(S->ops);
+    size_t offset = 0;
+    size_t n;
+    const char* s;
+    while ((s = storage_next_span(S, &offset, storage_len(S), &n)) != NULL) {
+      storage_insert(T, s, n);
+    }
+    S = T;
+  }
+
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    int saved_errno = errno;
+    if (T != NULL) storage_free(T);
+    errno = saved_errno;
+    return false;
+  }
+  bool ok = storage_write(S, fd)
+    && (!W->syncOnSave || fsync(fd) != -1);
+  ok = close(fd) != -1 && ok;
+  int saved_errno = errno;
+  if (T != NULL) {
+    editor_replace_buffer(E, T, storage_cursor(E->buffer));
+    indexFile(W, E);
+  }
+  errno = saved_errno;
+  return ok;
+}
+
+// fsync the directory holding path, so a rename in it is on disk
+static bool syncDir(const char* path) {
+  const char* slash = strrchr(path, '/');
+  char* dir;
+  if (slash == NULL) {
+    dir = xmalloc(2);
+    strcpy(dir, ".");
+  }
+  else {
+    size_t n = slash == path ? 1 : (size_t)(slash - path);
+    dir = xmalloc(n + 1);
+    memcpy(dir, path, n);
+    dir[n] = '\0';
+  }
+  int fd = open(dir, O_RDONLY | O_DIRECTORY);
+  free(dir);
+  if (fd == -1) return false;
+  bool ok = fsync(fd) != -1;
+  return close(fd) != -1 && ok;
+}
+
 void saveFile(window* W) {
   editor* E = W->editor;
   if (E->filename == NULL) {
@@ -839,29 +1296,83 @@ void saveFile(window* W) {
       return;
     }
   }
-  size_t len = E->buffer->backlen + E->buffer->frontlen;
-  char* s = gapbuf_str(E->buffer);
-  int fd = open(E->filename, O_RDWR | O_CREAT, 0644);
-  if (fd != -1) {
-    if (ftruncate(fd, len) != -1) {
-      if ((size_t)write(fd, s, len) == len) {
-        close(fd);
-        free(s);
-        E->dirty = 0;
-        setMessage(W, "%d bytes written to disk", len);
-        return;
+  size_t len = storage_len(E->buffer);
+
+  // write a temporary file next to the target and rename it over the
+  // target, so a failed save never leaves a half written file behind.
+  // The old file may still be mapped by the storage and stays intact.
+  // A symlink is saved through to the file it names.
+  char* path = realpath(E->filename, NULL);
+  if (path == NULL) {
+    path = xmalloc(strlen(E->filename) + 1);
+    strcpy(path, E->filename);
+  }
+  struct stat st;
+  bool exists = stat(path, &st) == 0;
+
+  // renaming would split a file with several links from the others
+  bool ok = false;
+  if (exists && st.st_nlink > 1) {
+    ok = saveInPlace(W, path);
+  }
+  else {
+    size_t namelen = strlen(path);
+    char* tmpname = xmalloc(namelen + sizeof(".XXXXXX"));
+    strcpy(tmpname, path);
+    strcpy(tmpname + namelen, ".XXXXXX");
+
+    int fd = mkstemp(tmpname);
+    if (fd == -1) {
+      // can't create files in its directory, the file itself may do
+      ok = saveInPlace(W, path);
+    }
+    else if (exists && fchown(fd, st.st_uid, st.st_gid) == -1) {
+      // a file someone else owns keeps its owner only in place
+      close(fd);
+      unlink(tmpname);
+      ok = saveInPlace(W, path);
+    }
+    else {
+      ok = fchmod(fd, exists ? st.st_mode & 07777 : 0644) != -1
+        && storage_write(E->buffer, fd)
+        && (!W->syncOnSave || fsync(fd) != -1);
+      ok = close(fd) != -1 && ok;
+      ok = ok && rename(tmpname, path) != -1
+        && (!W->syncOnSave || syncDir(path));
+      if (!ok) {
+        int saved_errno = errno;
+        unlink(tmpname);
+        errno = saved_errno;
       }
     }
-    close(fd);
+    free(tmpname);
+  }
+  free(path);
+
+  if (ok) {
+    E->dirty = 0;
+    setMessage(W, "%zu bytes written to disk", len);
+  }
+  else {
+    setMessage(W, "Can't save! I/O error: %s", strerror(errno));
   }
-  free(s);
-  setMessage(W, "Can't save! I/O error: %s", strerror(errno));
 }
 
 void window_free(window* W) {
+  // views first, freeing its file empties a view
+  for (size_t i = 0; i < W->editorLen; i++) {
+    if (isView(W->editorList[i])) editor_free(W->editorList[i]);
+  }
   for (size_t i = 0; i < W->editorLen; i++) {
-    editor_free(W->editorList[i]);
+    if (!isView(W->editorList[i])) editor_free(W->editorList[i]);
   }
   free(W->editorList);
+  frame_free(W->frame);
+  frame_free(W->line);
+  screen_free(W->screen);
+  input_free(W->input);
+  finder_free(W->finder);
+  fanout_free(W->fanout);
+  latency_free(W->latency);
   free(W);
 }
@@ -1,7 +1,3 @@
-#define _DEFAULT_SOURCE
-#define _BSD_SOURCE
-#define _GNU_SOURCE
-
 #include <unistd.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -14,7 +10,13 @@
 #include <errno.h>
 #include <time.h>
 #include <stdarg.h>
-#include "gapbuf.h"
+#include "storage.h"
+#include "frame.h"
+#include "screen.h"
+#include "input.h"
+#include "finder.h"
+#include "fanout.h"
+#include "latency.h"
 #include "editor.h"
 
 #ifndef WINDOW_H
@@ -22,6 +24,12 @@
 
 #define CTRL_KEY(k) ((k) & 0x1f)
 #define MESSAGE_TIME (10)
+#define MESSAGE_TIMER (2000)  // key of the timer that clears the message
+#define FRAME_TIME (30)       // ms between refreshes while input keeps coming
+#define FIND_TIME (50)        // ms between match count updates while searching
+#define FIND_TIMER (2001)     // key of the timer that updates the match count
+#define INDEX_TIME (1)        // ms between slices of index building
+#define INDEX_TIMER (2002)    // key of the timer that builds indexes
 
 struct window_header {
   editor** editorList;              // Array of open editors (open files)
@@ -29,7 +37,22 @@ struct window_header {
   size_t editorLen;                 // editorLen = number of open editors
   size_t activeIndex;               // editorList[activeIndex] = editor
   editor* editor;                   // currently active editor
+  const storage_ops* storage;       // storage backend for newly opened files
+  bool syncOnSave;                  // fsync saved files before replacing the old ones
+  bool indexFiles;                  // keep a trigram index of every opened file
   struct termios orig_terminal;
+  frame* frame;                     // output of the frame being drawn
+  frame* line;                      // row being composed
+  screen* screen;                   // what the terminal shows
+  input* input;                     // keyboard input read but not processed
+  finder* finder;                   // matches of the query being typed,
+                                    // found in the background
+  const char* badRegexp;            // why the ^R query does not compile, shown
+                                    // at the right of the prompt, NULL if it does
+  fanout* fanout;                   // hits of the last search of every file
+  unsigned long hitedits;           // edits of every file when searched
+  latency* latency;                 // how long handling keys took, by stage
+  bool showLatency;                 // show it in the status bar
   size_t screenrows;                // total number of rows on screen
   size_t screencols;                // total number of cols on screen
   char message[80];
@@ -41,7 +64,7 @@ typedef void callback_fn (window* W, char* query, int key);
 
 void die(window* W, const char* s);               // debugging and display error
 
-window* window_new(void);                         // create new window
+window* window_new(const storage_ops* ops);       // create new window, editors use ops
 
 void enableRawMode(window* W);                    // enable raw mode
 void disableRawMode(window* W);                   // disable raw mode
@@ -51,7 +74,7 @@ int getScreenSize(size_t* numrows, size_t* numcols);
 void getWindowSize(window* W);
 
 void scroll(window* W);                           // adjust offset to scroll
-void refresh(window* W);                          // redraw everything
+void refresh(window* W);                          // redraw what changed
 void renderFileBar(window* W);                    // draw file bar
 void renderText(window* W);                       // render text file
 void renderStatusBar(window* W);                  // render status bar
@@ -63,13 +86,27 @@ int readKey(window* W);                           // read key presses
 void moveCursor(window* W, int key);              // move cursor with arrow keys
 void movePage(window* W, int key);                // move to next/previous page
 void processKey(window* W, bool* go);             // process key press
+void processInput(window* W, bool* go);           // process a key press and all
+                                                  // input already waiting
 
 char* promptUser(window* W, char* prompt, callback_fn* callback);
                                                   // prompt user for input
 
 void find(window* W);                             // find word and move cursor
+void findRegexp(window* W);                       // find regular expression and
+                                                  // move cursor
+void searchAll(window* W);                        // search every open file, go to
+                                                  // the first hit from the cursor
+void moveHit(window* W, int key);                 // go to the next or previous hit
+void replaceAll(window* W, bool pattern);         // replace every match of a string,
+                                                  // or a regular expression if pattern
+void showOccur(window* W);                        // show the lines holding a string in
+                                                  // a read-only view of the file
+void gotoSource(window* W);                       // go to the cursor of a view in its file
 
 void openFile(window* W, char* filename);         // open text file
+void indexFile(window* W, editor* E);             // start indexing the text of E
+void buildIndexes(window* W);                     // build a slice of the indexes
 void closeFile(window* W, bool* go);              // close currently active file
 void saveFile(window* W);                         // save edited file
 